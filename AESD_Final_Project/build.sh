@@ -6,29 +6,40 @@ TOPDIR=$(dirname "$(realpath "$0")")
 export BR2_EXTERNAL="${TOPDIR}/mnet_external"
 BUILDROOT_DIR="${TOPDIR}/buildroot"
 
+# Pi 4 image by default; MNET_DEFCONFIG=mnet_virt_aarch64_defconfig builds
+# the emulated performance test image in its own output directory
+DEFCONFIG="${MNET_DEFCONFIG:-raspberrypi4_64_defconfig}"
+MAKE_ARGS=(-C "${BUILDROOT_DIR}")
+CONFIG="${BUILDROOT_DIR}/.config"
+if [ "${DEFCONFIG}" != raspberrypi4_64_defconfig ]; then
+    OUTPUT_DIR="${BUILDROOT_DIR}/output-${DEFCONFIG%_defconfig}"
+    MAKE_ARGS+=(O="${OUTPUT_DIR}")
+    CONFIG="${OUTPUT_DIR}/.config"
+fi
+
 # Step 1: Apply default config only if .config doesn’t exist
-if [ ! -f "${BUILDROOT_DIR}/.config" ]; then
-    echo "[INFO] No existing Buildroot config found. Applying default defconfig..."
-    make -C "${BUILDROOT_DIR}" raspberrypi4_64_defconfig
+if [ ! -f "${CONFIG}" ]; then
+    echo "[INFO] No existing Buildroot config found. Applying ${DEFCONFIG}..."
+    make "${MAKE_ARGS[@]}" "${DEFCONFIG}"
 fi
 
 # Step 2: Ensure MNET stays enabled
-if ! grep -q "BR2_PACKAGE_MNET=y" "${BUILDROOT_DIR}/.config" 2>/dev/null; then
+if ! grep -q "BR2_PACKAGE_MNET=y" "${CONFIG}" 2>/dev/null; then
     echo "[INFO] Enabling MNET external package..."
-    echo "BR2_PACKAGE_MNET=y" >> "${BUILDROOT_DIR}/.config"
-    make -C "${BUILDROOT_DIR}" olddefconfig
+    echo "BR2_PACKAGE_MNET=y" >> "${CONFIG}"
+    make "${MAKE_ARGS[@]}" olddefconfig
 fi
 
 # Step 2.5: Ensure BME280 stays enabled
-if ! grep -q "BR2_PACKAGE_BME280=y" "${BUILDROOT_DIR}/.config" 2>/dev/null; then
+if ! grep -q "BR2_PACKAGE_BME280=y" "${CONFIG}" 2>/dev/null; then
     echo "[INFO] Enabling BME280 driver external package..."
-    echo "BR2_PACKAGE_BME280=y" >> "${BUILDROOT_DIR}/.config"
-    make -C "${BUILDROOT_DIR}" olddefconfig
+    echo "BR2_PACKAGE_BME280=y" >> "${CONFIG}"
+    make "${MAKE_ARGS[@]}" olddefconfig
 fi
 
 # Step 3: Build
 echo "[INFO] Starting Buildroot build..."
-make -C "${BUILDROOT_DIR}" -j"$(nproc)"
+make "${MAKE_ARGS[@]}" -j"$(nproc)"
 
 echo "[INFO] Build completed successfully!"
 
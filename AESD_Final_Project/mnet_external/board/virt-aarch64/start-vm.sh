@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Boot the mnet_virt_aarch64_defconfig image, let it run the performance
+# suite and collect the results in a host directory shared over virtio-9p.
+# Exits non-zero unless the guest reported every benchmark as done.
+#
+set -eu
+
+BOARD_DIR=$(dirname "$(realpath "$0")")
+IMAGES=$(realpath "$BOARD_DIR/../../..")/buildroot/output-mnet_virt_aarch64/images
+RESULTS=
+SMP=2
+MEM=1024
+EXTRA=
+
+usage() {
+    cat >&2 <<USAGE
+usage: $0 [-i IMAGES] [-o RESULTS] [-c CPUS] [-m MB] [-a KERNEL_ARGS]
+  -i  buildroot images directory (default $IMAGES)
+  -o  results directory, created if missing (default results-<date>)
+  -c  guest CPUs (default 2)
+  -m  guest memory in MB (default 1024)
+  -a  extra kernel command line, e.g. "mnetperf.sizes=64 mnetperf.time=2"
+USAGE
+    exit 2
+}
+
+while getopts i:o:c:m:a:h opt; do
+    case $opt in
+    i) IMAGES=$OPTARG ;;
+    o) RESULTS=$OPTARG ;;
+    c) SMP=$OPTARG ;;
+    m) MEM=$OPTARG ;;
+    a) EXTRA=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+
+RESULTS=${RESULTS:-results-$(date +%Y%m%d-%H%M%S)}
+mkdir -p "$RESULTS"
+
+# The emulator buildroot built, else the one on PATH
+EMU="$IMAGES/../host/bin/qemu-system-aarch64"
+[ -x "$EMU" ] || EMU=qemu-system-aarch64
+
+# The rootfs is opened read-only (snapshot) so every run boots the same image
+"$EMU" -M virt -cpu cortex-a72 -smp "$SMP" -m "$MEM" -nographic \
+    -kernel "$IMAGES/Image" \
+    -append "rootwait root=/dev/vda console=ttyAMA0 $EXTRA" \
+    -netdev user,id=eth0 -device virtio-net-device,netdev=eth0 \
+    -drive file="$IMAGES/rootfs.ext4",if=none,format=raw,id=hd0,snapshot=on \
+    -device virtio-blk-device,drive=hd0 \
+    -fsdev local,id=results,path="$RESULTS",security_model=none \
+    -device virtio-9p-device,fsdev=results,mount_tag=mnetperf
+
+status=$(cat "$RESULTS/status" 2>/dev/null || echo "no status")
+echo "results in $RESULTS: $status"
+[ "$status" = ok ]
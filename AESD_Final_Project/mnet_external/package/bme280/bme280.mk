@@ -1,19 +1,12 @@
 ##############################################################
 #
-# BME280 Kernel Module (GitHub source)
+# BME280 Kernel Module (in-tree source)
 #
 ##############################################################
 
-# Commit hash you want Buildroot to checkout
-BME280_VERSION = a7c91b92e34f3b4e6e7f93c75ff128c322ab1234
-
-# GitHub SSH URL (recommended so Buildroot uses your SSH key)
-# MUST be ssh format when private repo or when using CI
-BME280_SITE = git@github.com:<username>/<repo>.git
-
-BME280_SITE_METHOD = git
-# Set to YES only if repo contains submodules
-BME280_GIT_SUBMODULES = NO
+BME280_VERSION = 1.0
+BME280_SITE = $(BR2_EXTERNAL_MNET_EXTERNAL_PATH)/package/bme280/src
+BME280_SITE_METHOD = local
 
 
 ##############################################################
@@ -0,0 +1,21 @@
+################################################################################
+# mnet-bench package description
+################################################################################
+
+MNET_BENCH_VERSION = 1.0
+MNET_BENCH_SITE = $(BR2_EXTERNAL_MNET_EXTERNAL_PATH)/package/mnet-bench/src
+MNET_BENCH_SITE_METHOD = local
+
+define MNET_BENCH_BUILD_CMDS
+	$(TARGET_MAKE_ENV) $(MAKE) $(TARGET_CONFIGURE_OPTS) -C $(@D)
+endef
+
+define MNET_BENCH_INSTALL_TARGET_CMDS
+	$(INSTALL) -D -m 755 $(@D)/mnet-loadgen $(TARGET_DIR)/usr/bin/mnet-loadgen
+	$(INSTALL) -D -m 755 $(@D)/mnet-netns-bench.sh \
+		$(TARGET_DIR)/usr/bin/mnet-netns-bench
+	$(INSTALL) -D -m 755 $(@D)/mnet-replay $(TARGET_DIR)/usr/bin/mnet-replay
+	$(INSTALL) -D -m 755 $(@D)/bme280-bench $(TARGET_DIR)/usr/bin/bme280-bench
+endef
+
+$(eval $(generic-package))
@@ -0,0 +1,131 @@
+/*
+ * bme280-bench - read latency of the bme280 driver's sysfs attributes.
+ *
+ * Every read of temp_mdegc, pressure_pa or humidity_raw goes to the chip
+ * over SMBus, so the time per read is the cost of the driver plus the I2C
+ * adapter. Each attribute is read COUNT times with pread() at offset 0,
+ * which makes sysfs call the driver's show() again, and one JSON object
+ * per attribute is printed: the last value, reads/s and latency
+ * percentiles.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *const attrs[] = {
+    "temp_mdegc",
+    "pressure_pa",
+    "humidity_raw",
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "bme280-bench: %s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, unsigned int n, double p)
+{
+    unsigned int i = p * n;
+
+    return sorted[i < n ? i : n - 1];
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: bme280-bench [-n COUNT] [-L LABEL] DEVDIR\n"
+            "  -n  reads per attribute (default 1000)\n"
+            "  -L  label copied into the JSON output\n"
+            "  DEVDIR is the sensor's sysfs directory, e.g.\n"
+            "  /sys/bus/i2c/devices/1-0076\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *label = "";
+    unsigned int count = 1000, i, a;
+    char path[4096], val[64];
+    uint64_t *lat, t0, t1, total;
+    ssize_t len;
+    int c, fd;
+
+    while ((c = getopt(argc, argv, "n:L:h")) != -1) {
+        switch (c) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'L':
+            label = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || !count)
+        usage();
+
+    lat = calloc(count, sizeof(*lat));
+    if (!lat)
+        die("calloc");
+
+    for (a = 0; a < sizeof(attrs) / sizeof(attrs[0]); a++) {
+        snprintf(path, sizeof(path), "%s/%s", argv[optind], attrs[a]);
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+            die(path);
+
+        len = 0;
+        total = 0;
+        for (i = 0; i < count; i++) {
+            t0 = now_ns();
+            len = pread(fd, val, sizeof(val) - 1, 0);
+            t1 = now_ns();
+            if (len < 0)
+                die(path);
+            lat[i] = t1 - t0;
+            total += lat[i];
+        }
+        close(fd);
+
+        val[len] = '\0';
+        val[strcspn(val, "\n")] = '\0';
+        qsort(lat, count, sizeof(*lat), cmp_u64);
+
+        printf("{\"label\":\"%s\",\"attr\":\"%s\",\"value\":\"%s\","
+               "\"reads\":%u,\"reads_per_s\":%" PRIu64 ",",
+               label, attrs[a], val, count,
+               total ? (uint64_t)count * 1000000000 / total : 0);
+        printf("\"latency_ns\":{\"p50\":%" PRIu64 ",\"p99\":%" PRIu64 ","
+               "\"max\":%" PRIu64 "}}\n",
+               percentile(lat, count, 0.50), percentile(lat, count, 0.99),
+               lat[count - 1]);
+    }
+    free(lat);
+    return 0;
+}
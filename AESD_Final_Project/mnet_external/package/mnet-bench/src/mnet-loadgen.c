@@ -0,0 +1,432 @@
+/*
+ * mnet-loadgen - UDP load generator and sink for the mnet benchmarks.
+ *
+ * One process, two threads: the sender (optionally moved into another
+ * network namespace) sends fixed-size UDP datagrams with sendmmsg() at a
+ * fixed rate, the receiver drains them with recvmmsg() in the current
+ * namespace, or the other way round with -R. Each datagram carries a
+ * sequence number and its CLOCK_MONOTONIC send time, so one-way latency
+ * is exact on a single host.
+ *
+ * At the end one JSON object is printed: TX/RX packets and pps, loss,
+ * latency percentiles and CPU time per received packet, both for the
+ * whole system (from /proc/stat, so it includes the kernel datapath) and
+ * for this process alone.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH_MAX       256
+#define SIZE_MAX_UDP    65507
+
+/* Latency histogram: exact below 128 ns, then 128 buckets per octave */
+#define HIST_SUB_BITS   7
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS    ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct payload {
+    uint64_t seq;
+    uint64_t tx_ns;
+};
+
+struct opts {
+    const char *netns;          // sender namespace, NULL: current
+    int reverse;                // receiver in netns, sender in the current
+    const char *label;
+    struct sockaddr_in dst;
+    unsigned int size;          // UDP payload bytes
+    unsigned int rate;          // packets/s, 0: as fast as possible
+    unsigned int duration;      // seconds
+    unsigned int batch;
+};
+
+struct result {
+    uint64_t tx_packets;
+    uint64_t rx_packets;
+    uint64_t tx_ns;             // sender run time
+    uint64_t rx_ns;             // first to last received packet
+    uint64_t hist[HIST_BUCKETS];
+    uint64_t lat_max;
+};
+
+static struct opts opt = {
+    .size = 64,
+    .rate = 100000,
+    .duration = 10,
+    .batch = 32,
+};
+static struct result res;
+static volatile int tx_done;
+static int rx_fd;
+static int tx_nsfd = -1;        // namespace the sender moves to
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "mnet-loadgen: %s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+/* -------------------- Histogram -------------------- */
+static unsigned int hist_bucket(uint64_t v)
+{
+    int e;
+
+    if (v < HIST_SUB)
+        return v;
+    e = 63 - __builtin_clzll(v);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB +
+           ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Lower bound of bucket @b */
+static uint64_t hist_value(unsigned int b)
+{
+    unsigned int e;
+
+    if (b < HIST_SUB)
+        return b;
+    e = b / HIST_SUB + HIST_SUB_BITS - 1;
+    return (uint64_t)(HIST_SUB + b % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total,
+                                double p)
+{
+    uint64_t rank = (uint64_t)(p * total), seen = 0;
+    unsigned int b;
+
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > rank)
+            return hist_value(b);
+    }
+    return 0;
+}
+
+/* -------------------- CPU accounting -------------------- */
+/* Busy time of all CPUs in ns, from the first line of /proc/stat */
+static uint64_t system_busy_ns(void)
+{
+    unsigned long long v[8] = { 0 };
+    FILE *f = fopen("/proc/stat", "r");
+    uint64_t busy;
+
+    if (!f)
+        return 0;
+    if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0],
+               &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    /* Everything but idle and iowait */
+    busy = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+    return busy * (1000000000ull / sysconf(_SC_CLK_TCK));
+}
+
+static uint64_t process_cpu_ns(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+/* -------------------- Sender -------------------- */
+static void *tx_thread(void *arg)
+{
+    struct mmsghdr msg[BATCH_MAX];
+    struct iovec iov[BATCH_MAX];
+    uint64_t start, end, due, t;
+    unsigned int i, n;
+    struct payload *p;
+    int fd, ret;
+    char *buf;
+
+    (void)arg;
+
+    /* setns() only moves this thread */
+    if (tx_nsfd >= 0 && setns(tx_nsfd, CLONE_NEWNET))
+        die("setns");
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        die("socket");
+    if (connect(fd, (struct sockaddr *)&opt.dst, sizeof(opt.dst)))
+        die("connect");
+
+    buf = calloc(opt.batch, opt.size);
+    if (!buf)
+        die("calloc");
+
+    memset(msg, 0, sizeof(msg));
+    for (i = 0; i < opt.batch; i++) {
+        iov[i].iov_base = buf + i * opt.size;
+        iov[i].iov_len = opt.size;
+        msg[i].msg_hdr.msg_iov = &iov[i];
+        msg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    start = now_ns();
+    end = start + opt.duration * 1000000000ull;
+    while ((t = now_ns()) < end) {
+        n = opt.batch;
+        if (opt.rate) {
+            /* Packets due by now, sleep until the next one if none */
+            due = (t - start) * opt.rate / 1000000000ull + 1;
+            if (due <= res.tx_packets) {
+                struct timespec ts;
+                uint64_t next = start + res.tx_packets * 1000000000ull /
+                                opt.rate;
+
+                ts.tv_sec = next / 1000000000ull;
+                ts.tv_nsec = next % 1000000000ull;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+                continue;
+            }
+            if (due - res.tx_packets < n)
+                n = due - res.tx_packets;
+        }
+
+        t = now_ns();
+        for (i = 0; i < n; i++) {
+            p = (struct payload *)(buf + i * opt.size);
+            p->seq = res.tx_packets + i;
+            p->tx_ns = t;
+        }
+
+        ret = sendmmsg(fd, msg, n, 0);
+        if (ret < 0) {
+            if (errno == ENOBUFS || errno == EAGAIN)
+                continue;
+            die("sendmmsg");
+        }
+        res.tx_packets += ret;
+    }
+    res.tx_ns = now_ns() - start;
+
+    close(fd);
+    free(buf);
+    tx_done = 1;
+    return NULL;
+}
+
+/* -------------------- Receiver -------------------- */
+static void rx_loop(void)
+{
+    struct mmsghdr msg[BATCH_MAX];
+    struct iovec iov[BATCH_MAX];
+    uint64_t first = 0, last = 0, drain = 0, t, lat;
+    const struct payload *p;
+    char *buf;
+    int i, n;
+
+    buf = calloc(BATCH_MAX, opt.size);
+    if (!buf)
+        die("calloc");
+
+    memset(msg, 0, sizeof(msg));
+    for (i = 0; i < BATCH_MAX; i++) {
+        iov[i].iov_base = buf + i * opt.size;
+        iov[i].iov_len = opt.size;
+        msg[i].msg_hdr.msg_iov = &iov[i];
+        msg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Stop 500 ms after the sender, or at the first timeout after that */
+    for (;;) {
+        n = recvmmsg(rx_fd, msg, BATCH_MAX, MSG_WAITFORONE, NULL);
+        t = now_ns();
+        if (tx_done && !drain)
+            drain = t + 500000000ull;
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                die("recvmmsg");
+            if (drain)
+                break;
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (msg[i].msg_len < sizeof(*p))
+                continue;
+            p = (const struct payload *)(buf + i * opt.size);
+            lat = t - p->tx_ns;
+            res.hist[hist_bucket(lat)]++;
+            if (lat > res.lat_max)
+                res.lat_max = lat;
+        }
+        res.rx_packets += n;
+        if (!first)
+            first = t;
+        last = t;
+
+        if (drain && t > drain)
+            break;
+    }
+    res.rx_ns = last - first;
+    free(buf);
+}
+
+/* -------------------- Main -------------------- */
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: mnet-loadgen -d ADDR [-p PORT] [-s SIZE] [-r PPS] [-t SECS]\n"
+            "                    [-b BATCH] [-n NETNS_PATH [-R]] [-L LABEL]\n"
+            "  -d  destination IPv4 address, also bound by the receiver\n"
+            "  -p  UDP port (default 9000)\n"
+            "  -s  UDP payload size, >= 16 (default 64)\n"
+            "  -r  packets per second, 0 for as fast as possible (default 100000)\n"
+            "  -t  duration in seconds (default 10)\n"
+            "  -b  sendmmsg batch (default 32, max 256)\n"
+            "  -n  run the sender in this network namespace (/var/run/netns/...)\n"
+            "  -R  run the receiver in the -n namespace instead, the sender here\n"
+            "  -L  label copied into the JSON output\n");
+    exit(2);
+}
+
+static uint64_t rate_of(uint64_t packets, uint64_t ns)
+{
+    return ns ? packets * 1000000000ull / ns : 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t sys0, sys1, proc0, proc1, loss, total = 0;
+    struct sockaddr_in bind_addr;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    int rcvbuf = 16 << 20;
+    pthread_t tx;
+    int c, nsfd, port = 9000;
+    unsigned int b;
+
+    opt.dst.sin_family = AF_INET;
+    while ((c = getopt(argc, argv, "d:p:s:r:t:b:n:RL:h")) != -1) {
+        switch (c) {
+        case 'd':
+            if (inet_pton(AF_INET, optarg, &opt.dst.sin_addr) != 1)
+                usage();
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 's':
+            opt.size = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            opt.rate = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            opt.duration = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            opt.batch = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            opt.netns = optarg;
+            break;
+        case 'R':
+            opt.reverse = 1;
+            break;
+        case 'L':
+            opt.label = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (!opt.dst.sin_addr.s_addr || port <= 0 || port > 65535 ||
+        opt.size < sizeof(struct payload) || opt.size > SIZE_MAX_UDP ||
+        !opt.batch || opt.batch > BATCH_MAX || !opt.duration ||
+        (opt.reverse && !opt.netns))
+        usage();
+    opt.dst.sin_port = htons(port);
+
+    if (opt.netns) {
+        nsfd = open(opt.netns, O_RDONLY | O_CLOEXEC);
+        if (nsfd < 0)
+            die(opt.netns);
+        if (opt.reverse) {
+            /* The sender comes back here, the receiver stays there */
+            tx_nsfd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+            if (tx_nsfd < 0 || setns(nsfd, CLONE_NEWNET))
+                die(opt.netns);
+            close(nsfd);
+        } else {
+            tx_nsfd = nsfd;
+        }
+    }
+
+    /* The receiver is ready before the first packet leaves */
+    rx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (rx_fd < 0)
+        die("socket");
+    setsockopt(rx_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+    if (setsockopt(rx_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+        die("SO_RCVTIMEO");
+    bind_addr = opt.dst;
+    if (bind(rx_fd, (struct sockaddr *)&bind_addr, sizeof(bind_addr)))
+        die("bind");
+
+    sys0 = system_busy_ns();
+    proc0 = process_cpu_ns();
+
+    if (pthread_create(&tx, NULL, tx_thread, NULL))
+        die("pthread_create");
+    rx_loop();
+    pthread_join(tx, NULL);
+
+    sys1 = system_busy_ns();
+    proc1 = process_cpu_ns();
+
+    for (b = 0; b < HIST_BUCKETS; b++)
+        total += res.hist[b];
+    loss = res.tx_packets > res.rx_packets ? res.tx_packets - res.rx_packets : 0;
+
+    printf("{\"label\":\"%s\",\"size\":%u,\"rate\":%u,\"duration_s\":%u,"
+           "\"batch\":%u,",
+           opt.label ? opt.label : "", opt.size, opt.rate, opt.duration,
+           opt.batch);
+    printf("\"tx_packets\":%" PRIu64 ",\"rx_packets\":%" PRIu64 ","
+           "\"tx_pps\":%" PRIu64 ",\"rx_pps\":%" PRIu64 ","
+           "\"loss\":%" PRIu64 ",\"loss_pct\":%.4f,",
+           res.tx_packets, res.rx_packets,
+           rate_of(res.tx_packets, res.tx_ns), rate_of(res.rx_packets, res.rx_ns),
+           loss, res.tx_packets ? 100.0 * loss / res.tx_packets : 0.0);
+    printf("\"latency_ns\":{\"p50\":%" PRIu64 ",\"p99\":%" PRIu64 ","
+           "\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "},",
+           hist_percentile(res.hist, total, 0.50),
+           hist_percentile(res.hist, total, 0.99),
+           hist_percentile(res.hist, total, 0.999), res.lat_max);
+    printf("\"cpu_ns_per_pkt\":%" PRIu64 ",\"proc_cpu_ns_per_pkt\":%" PRIu64 "}\n",
+           res.rx_packets ? (sys1 - sys0) / res.rx_packets : 0,
+           res.rx_packets ? (proc1 - proc0) / res.rx_packets : 0);
+    return 0;
+}
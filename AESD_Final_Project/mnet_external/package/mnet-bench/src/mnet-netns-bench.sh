@@ -0,0 +1,131 @@
+#!/bin/sh
+#
+# End-to-end mnet benchmark on one host, no hardware needed.
+#
+# A veth pair connects a "generator" network namespace to the root
+# namespace, where its peer is the lower device of mnet (named eth0 when
+# that name is free). mnet-loadgen sends from the generator namespace and
+# receives in the root one:
+#   mirror  to the lower device's address, through the rx_handler and
+#           the mirror clone to mnet0;
+#   bridge  to mnet0's address, bridged from the lower device;
+# or the other way round:
+#   tx      from mnet0's address into the generator namespace, through
+#           mnet_start_xmit() and the lower device, once through the
+#           lower qdisc (direct_xmit=0) and once straight to the veth
+#           driver (direct_xmit=1), unless -x picks one. The lower device
+#           gets a pfifo_fast qdisc, as a NIC would have, instead of
+#           veth's noqueue.
+# One JSON line per run is printed on stdout.
+#
+set -eu
+
+MODE=mirror
+SIZES=64
+RATE=100000
+DURATION=10
+MODULE=mnet
+XMIT="0 1"
+NS=mnb-gen
+PORT=9000
+
+usage() {
+    cat >&2 <<EOF
+usage: $0 [-m mirror|bridge|tx] [-s SIZE[,SIZE...]] [-r PPS] [-t SECS]
+       [-k MODULE] [-x 0|1]
+  -m  path to measure (default mirror)
+  -s  UDP payload sizes, one run each (default 64)
+  -r  packets per second, 0 for as fast as possible (default 100000)
+  -t  seconds per run (default 10)
+  -k  path to mnet.ko, or module name for modprobe (default mnet)
+  -x  tx only: run with this direct_xmit setting only
+EOF
+    exit 2
+}
+
+while getopts m:s:r:t:k:x:h opt; do
+    case $opt in
+    m) MODE=$OPTARG ;;
+    s) SIZES=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    t) DURATION=$OPTARG ;;
+    k) MODULE=$OPTARG ;;
+    x) XMIT=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+
+case $MODE in
+mirror|bridge) MNET_MODE=$MODE ;;
+tx) MNET_MODE=bridge ;;
+*) usage ;;
+esac
+
+[ "$(id -u)" -eq 0 ] || { echo "$0: must run as root" >&2; exit 1; }
+
+if grep -q '^mnet ' /proc/modules; then
+    echo "$0: mnet is already loaded, unload it first" >&2
+    exit 1
+fi
+
+# mnet attaches to eth0 by default; keep a real eth0 out of the way
+LOWER=eth0
+if ip link show eth0 >/dev/null 2>&1; then
+    LOWER=mnbeth0
+fi
+
+cleanup() {
+    set +e
+    grep -q '^mnet ' /proc/modules && rmmod mnet
+    ip link del "$LOWER" 2>/dev/null
+    ip netns del "$NS" 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+ip netns add "$NS"
+ip link add "$LOWER" type veth peer name gen0 netns "$NS"
+ip -n "$NS" link set lo up
+ip -n "$NS" addr add 10.77.0.1/24 dev gen0
+ip -n "$NS" link set gen0 up
+ip link set "$LOWER" up
+
+if [ -f "$MODULE" ]; then
+    insmod "$MODULE" lower="$LOWER" mode="$MNET_MODE"
+else
+    modprobe "$MODULE" lower="$LOWER" mode="$MNET_MODE"
+fi
+ip link set mnet0 up
+
+case $MODE in
+mirror)
+    ip addr add 10.77.0.2/24 dev "$LOWER"
+    ;;
+bridge)
+    # mnet0 does not answer ARP
+    ip addr add 10.77.0.2/24 dev mnet0
+    ip -n "$NS" neigh replace 10.77.0.2 \
+        lladdr "$(cat /sys/class/net/mnet0/address)" dev gen0
+    ;;
+tx)
+    # nor does it resolve
+    ip addr add 10.77.0.2/24 dev mnet0
+    ip neigh replace 10.77.0.1 \
+        lladdr "$(ip netns exec "$NS" cat /sys/class/net/gen0/address)" \
+        dev mnet0
+    tc qdisc replace dev "$LOWER" root pfifo_fast
+    ;;
+esac
+
+for size in $(echo "$SIZES" | tr ',' ' '); do
+    if [ "$MODE" != tx ]; then
+        mnet-loadgen -n "/var/run/netns/$NS" -d 10.77.0.2 -p "$PORT" \
+            -s "$size" -r "$RATE" -t "$DURATION" -L "$MODE"
+        continue
+    fi
+    for x in $XMIT; do
+        echo "$x" > /sys/class/net/mnet0/mnet/direct_xmit
+        [ "$x" = 1 ] && label=tx-direct || label=tx-queued
+        mnet-loadgen -n "/var/run/netns/$NS" -R -d 10.77.0.1 -p "$PORT" \
+            -s "$size" -r "$RATE" -t "$DURATION" -L "$label"
+    done
+done
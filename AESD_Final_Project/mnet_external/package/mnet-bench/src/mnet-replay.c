@@ -0,0 +1,740 @@
+/*
+ * mnet-replay - replay a capture through mnet0 (or any Ethernet device).
+ *
+ * The pcap or pcapng file is mapped and indexed once, then its frames are
+ * copied into a PACKET_TX_RING (TPACKET_V2) ahead of time, so the only
+ * work at a frame's due time is to flip its slot to SEND_REQUEST and call
+ * send(). Frames go out:
+ *  - at their original spacing, optionally sped up (-x), with the wait
+ *    split into an absolute clock_nanosleep(), timer slack set to 1 ns,
+ *    and a spin on the clock for the last -S microseconds. Every frame due
+ *    by the time the wait ends leaves in the same send();
+ *  - or as fast as the ring drains (-t), one send() per -b frames.
+ * -q bypasses mnet0's qdisc (PACKET_QDISC_BYPASS), so each frame goes
+ * straight into mnet_start_xmit().
+ *
+ * At the end one JSON object is printed: frames and bytes sent, achieved
+ * and original packet rate, send() calls and the timing error, that is how
+ * late each frame was handed to the kernel against its schedule, as
+ * p50/p99/max. Frames longer than the interface's MTU allows are left out
+ * at load and counted as skipped. The socket has PACKET_LOSS set, so a
+ * frame the kernel still rejects is dropped instead of stalling the ring.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_MAX       65536
+#define TX_DATA_OFF     (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))
+
+/* Timing error histogram: exact below 128 ns, then 128 buckets per octave */
+#define HIST_SUB_BITS   7
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS    ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/* pcap and pcapng, native byte order */
+#define PCAP_MAGIC_US   0xa1b2c3d4
+#define PCAP_MAGIC_NS   0xa1b23c4d
+#define PCAPNG_SHB      0x0a0d0d0a
+#define PCAPNG_IDB      0x00000001
+#define PCAPNG_SPB      0x00000003
+#define PCAPNG_EPB      0x00000006
+#define PCAPNG_MAGIC    0x1a2b3c4d
+#define PCAPNG_IF_MAX   64
+#define LINKTYPE_ETHERNET 1
+
+struct frame {
+    const uint8_t *data;
+    uint32_t len;
+    uint64_t ts;                // ns since the first frame
+};
+
+struct opts {
+    const char *ifname;
+    const char *label;
+    const char *file;
+    double speed;               // original timing divided by this
+    int topspeed;
+    unsigned int loops;
+    unsigned int frames;        // TX ring slots
+    unsigned int batch;         // -t: frames per send()
+    unsigned int spin_us;
+    int bypass;
+    int cpu;
+    int prio;                   // SCHED_FIFO priority, 0: normal
+};
+
+static struct opts opt = {
+    .ifname = "mnet0",
+    .speed = 1.0,
+    .loops = 1,
+    .frames = 4096,
+    .batch = 64,
+    .spin_us = 50,
+    .cpu = -1,
+};
+
+static struct frame *frames;
+static size_t nframes;
+static uint32_t len_max;        // MTU + ETH_HLEN, at most FRAME_MAX
+static uint64_t skipped;        // not Ethernet or longer than len_max
+
+static struct {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t sends;
+    uint64_t waits;             // ring full, waited for completions
+    uint64_t hist[HIST_BUCKETS];
+    uint64_t lag_max;
+} res;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "mnet-replay: %s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "mnet-replay: %s: %s\n", opt.file, what);
+    exit(1);
+}
+
+/* -------------------- Histogram -------------------- */
+static unsigned int hist_bucket(uint64_t v)
+{
+    int e;
+
+    if (v < HIST_SUB)
+        return v;
+    e = 63 - __builtin_clzll(v);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB +
+           ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Lower bound of bucket @b */
+static uint64_t hist_value(unsigned int b)
+{
+    unsigned int e;
+
+    if (b < HIST_SUB)
+        return b;
+    e = b / HIST_SUB + HIST_SUB_BITS - 1;
+    return (uint64_t)(HIST_SUB + b % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total,
+                                double p)
+{
+    uint64_t rank = (uint64_t)(p * total), seen = 0;
+    unsigned int b;
+
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > rank)
+            return hist_value(b);
+    }
+    return 0;
+}
+
+/* -------------------- Capture files -------------------- */
+/* What tpacket_snd() accepts: MTU + ETH_HLEN, 4 more for an 802.1Q tag */
+static int frame_fits(const uint8_t *data, uint32_t len)
+{
+    if (len < ETH_HLEN)
+        return 0;
+    if (len <= len_max)
+        return 1;
+    return len <= len_max + 4 && len <= FRAME_MAX &&
+           (data[12] << 8 | data[13]) == ETH_P_8021Q;
+}
+
+static void frame_add(const uint8_t *data, uint32_t len, uint64_t ts,
+                      size_t *cap)
+{
+    if (!frame_fits(data, len)) {
+        skipped++;
+        return;
+    }
+    if (nframes == *cap) {
+        *cap = *cap ? *cap * 2 : 65536;
+        frames = realloc(frames, *cap * sizeof(*frames));
+        if (!frames)
+            die("realloc");
+    }
+    frames[nframes].data = data;
+    frames[nframes].len = len;
+    frames[nframes].ts = ts;
+    nframes++;
+}
+
+static void load_pcap(const uint8_t *p, size_t size)
+{
+    uint32_t magic = *(const uint32_t *)p, caplen;
+    uint32_t linktype = *(const uint32_t *)(p + 20);
+    uint64_t mul = magic == PCAP_MAGIC_NS ? 1 : 1000, ts;
+    size_t off = 24, cap = 0;
+
+    if (linktype != LINKTYPE_ETHERNET)
+        fail("not an Ethernet capture");
+
+    while (off + 16 <= size) {
+        caplen = *(const uint32_t *)(p + off + 8);
+        if (off + 16 + caplen > size)
+            break;              // cut short while being written
+        ts = *(const uint32_t *)(p + off) * 1000000000ull +
+             *(const uint32_t *)(p + off + 4) * mul;
+        frame_add(p + off + 16, caplen, ts, &cap);
+        off += 16 + caplen;
+    }
+}
+
+/* if_tsresol of an IDB, as ns per unit; 0 if not representable */
+static uint64_t pcapng_tsres(const uint8_t *opts, const uint8_t *end)
+{
+    uint16_t code, len;
+    uint64_t div = 1;
+    uint8_t res;
+
+    while (opts + 4 <= end) {
+        code = *(const uint16_t *)opts;
+        len = *(const uint16_t *)(opts + 2);
+        if (!code)
+            break;
+        if (code == 9 && len == 1) {
+            res = opts[4];
+            if (res & 0x80 || res > 9)
+                return 0;       // binary or finer than ns
+            while (res--)
+                div *= 10;
+            return 1000000000ull / div;
+        }
+        opts += 4 + ((len + 3) & ~3u);
+    }
+    return 1000;                // default: microseconds
+}
+
+static void load_pcapng(const uint8_t *p, size_t size)
+{
+    uint64_t tsres[PCAPNG_IF_MAX];
+    uint32_t type, len, ifid, caplen;
+    unsigned int nif = 0;
+    size_t off = 0, cap = 0;
+    uint64_t ts;
+
+    while (off + 12 <= size) {
+        type = *(const uint32_t *)(p + off);
+        len = *(const uint32_t *)(p + off + 4);
+        if (len < 12 || len & 3 || off + len > size)
+            break;
+
+        switch (type) {
+        case PCAPNG_SHB:
+            if (*(const uint32_t *)(p + off + 8) != PCAPNG_MAGIC)
+                fail("pcapng in foreign byte order");
+            nif = 0;            // interfaces are per section
+            break;
+        case PCAPNG_IDB:
+            if (nif == PCAPNG_IF_MAX)
+                fail("too many interfaces");
+            tsres[nif] = *(const uint16_t *)(p + off + 8) ==
+                         LINKTYPE_ETHERNET ?
+                         pcapng_tsres(p + off + 16, p + off + len - 4) : 0;
+            nif++;
+            break;
+        case PCAPNG_EPB:
+            ifid = *(const uint32_t *)(p + off + 8);
+            caplen = *(const uint32_t *)(p + off + 20);
+            if (ifid >= nif || !tsres[ifid] || 28 + caplen + 4 > len) {
+                skipped++;
+                break;
+            }
+            ts = ((uint64_t)*(const uint32_t *)(p + off + 12) << 32 |
+                  *(const uint32_t *)(p + off + 16)) * tsres[ifid];
+            frame_add(p + off + 28, caplen, ts, &cap);
+            break;
+        case PCAPNG_SPB:
+            /* No timestamp: sent back to back */
+            if (!nif || !tsres[0]) {
+                skipped++;
+                break;
+            }
+            caplen = len - 16;
+            if (caplen > *(const uint32_t *)(p + off + 8))
+                caplen = *(const uint32_t *)(p + off + 8);
+            frame_add(p + off + 12, caplen,
+                      nframes ? frames[nframes - 1].ts : 0, &cap);
+            break;
+        }
+        off += len;
+    }
+}
+
+/* Frames the interface can take, from its MTU */
+static void iface_len_max(void)
+{
+    struct ifreq ifr = { 0 };
+    int s;
+
+    if (strlen(opt.ifname) >= IFNAMSIZ) {
+        errno = ENAMETOOLONG;
+        die(opt.ifname);
+    }
+    strcpy(ifr.ifr_name, opt.ifname);
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0)
+        die("socket");
+    if (ioctl(s, SIOCGIFMTU, &ifr))
+        die(opt.ifname);
+    close(s);
+
+    len_max = ifr.ifr_mtu + ETH_HLEN;
+    if (len_max > FRAME_MAX)
+        len_max = FRAME_MAX;
+}
+
+static void load(void)
+{
+    struct stat sb;
+    uint8_t *p;
+    uint32_t magic;
+    uint64_t ts0;
+    size_t i;
+    int fd;
+
+    fd = open(opt.file, O_RDONLY);
+    if (fd < 0)
+        die(opt.file);
+    if (fstat(fd, &sb))
+        die(opt.file);
+    if (sb.st_size < 24)
+        fail("too short");
+
+    /* Frames are copied from the mapping straight into the TX ring */
+    p = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (p == MAP_FAILED)
+        die("mmap");
+    close(fd);
+    madvise(p, sb.st_size, MADV_WILLNEED);
+
+    magic = *(uint32_t *)p;
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS)
+        load_pcap(p, sb.st_size);
+    else if (magic == PCAPNG_SHB)
+        load_pcapng(p, sb.st_size);
+    else
+        fail("not pcap or pcapng in native byte order");
+    if (!nframes)
+        fail("no Ethernet frames that fit the MTU");
+
+    /* Replay time starts at the first frame; a clock stepping back waits 0 */
+    ts0 = frames[0].ts;
+    for (i = 0; i < nframes; i++) {
+        frames[i].ts = frames[i].ts > ts0 ? frames[i].ts - ts0 : 0;
+        if (i && frames[i].ts < frames[i - 1].ts)
+            frames[i].ts = frames[i - 1].ts;
+    }
+}
+
+/* -------------------- TX ring -------------------- */
+static int fd;
+static uint8_t *ring;
+static unsigned int frame_size;
+
+static inline struct tpacket2_hdr *slot(uint64_t n)
+{
+    return (struct tpacket2_hdr *)(ring + (size_t)(n % opt.frames) *
+                                   frame_size);
+}
+
+static void ring_setup(void)
+{
+    struct sockaddr_ll sll = { 0 };
+    struct tpacket_req req;
+    unsigned int page = getpagesize(), max = 0, block;
+    int ver = TPACKET_V2, one = 1;
+    size_t i;
+
+    for (i = 0; i < nframes; i++)
+        if (frames[i].len > max)
+            max = frames[i].len;
+
+    /* Smallest power of two slot that holds the largest frame */
+    frame_size = TPACKET_ALIGNMENT;
+    while (frame_size < TX_DATA_OFF + max)
+        frame_size <<= 1;
+    block = frame_size > page ? frame_size : page;
+
+    fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0)
+        die("socket");
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)))
+        die("PACKET_VERSION");
+    if (opt.bypass &&
+        setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)))
+        die("PACKET_QDISC_BYPASS");
+    /*
+     * Without it the kernel parks on a frame it rejects, marked
+     * WRONG_FORMAT, and never gets to the slots after it
+     */
+    if (setsockopt(fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)))
+        die("PACKET_LOSS");
+
+    /* Whole blocks only */
+    opt.frames -= opt.frames % (block / frame_size);
+    if (!opt.frames)
+        opt.frames = block / frame_size;
+    req.tp_block_size = block;
+    req.tp_frame_size = frame_size;
+    req.tp_frame_nr = opt.frames;
+    req.tp_block_nr = opt.frames / (block / frame_size);
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)))
+        die("PACKET_TX_RING");
+
+    ring = mmap(NULL, (size_t)req.tp_block_size * req.tp_block_nr,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (ring == MAP_FAILED)
+        die("mmap ring");
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = 0;       // frames carry their own EtherType
+    sll.sll_ifindex = if_nametoindex(opt.ifname);
+    if (!sll.sll_ifindex)
+        die(opt.ifname);
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)))
+        die("bind");
+}
+
+/*
+ * Cursors into the ring, counting frames since the start:
+ *   done <= req <= load <= done + opt.frames
+ * [done, req) are with the kernel, [req, load) are copied in and wait for
+ * their time, [load, done + opt.frames) are free.
+ */
+static uint64_t c_done, c_req, c_load, c_total;
+
+/*
+ * Take back the slots the kernel has finished with, in order. Sent and
+ * rejected frames alike come back as AVAILABLE (PACKET_LOSS).
+ */
+static void reclaim(void)
+{
+    struct tpacket2_hdr *h;
+    uint32_t status;
+
+    while (c_done < c_req) {
+        h = slot(c_done);
+        status = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+        if (status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))
+            break;
+        c_done++;
+    }
+}
+
+/* Copy frames into the free slots */
+static void preload(void)
+{
+    const struct frame *f;
+    struct tpacket2_hdr *h;
+
+    while (c_load < c_total && c_load < c_done + opt.frames) {
+        f = &frames[c_load % nframes];
+        h = slot(c_load);
+        memcpy((uint8_t *)h + TX_DATA_OFF, f->data, f->len);
+        h->tp_len = f->len;
+        c_load++;
+    }
+}
+
+/*
+ * Let the kernel send what is requested. A frame it rejects is dropped
+ * and its slot released (PACKET_LOSS); the frames after it still go.
+ */
+static void kick(void)
+{
+    if (send(fd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN &&
+        errno != ENOBUFS)
+        die("send");
+    res.sends++;
+}
+
+/* Hand @n preloaded frames to the kernel */
+static void request(unsigned int n)
+{
+    struct tpacket2_hdr *h;
+
+    while (n--) {
+        h = slot(c_req);
+        res.bytes += h->tp_len;
+        __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST,
+                         __ATOMIC_RELEASE);
+        c_req++;
+        res.packets++;
+    }
+    kick();
+}
+
+/* Nothing free: sleep until the kernel completes a frame */
+static void wait_room(void)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+    res.waits++;
+    poll(&pfd, 1, 10);
+    reclaim();
+}
+
+/* Due time of frame @n, in CLOCK_MONOTONIC ns */
+static uint64_t due(uint64_t n, uint64_t start, uint64_t span)
+{
+    uint64_t loop = n / nframes, t = frames[n % nframes].ts;
+
+    return start + (uint64_t)((loop * span + t) / opt.speed);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static void wait_until(uint64_t t)
+{
+    uint64_t spin = opt.spin_us * 1000ull, now = now_ns();
+    struct timespec ts;
+
+    if (t > now + spin) {
+        t -= spin;
+        ts.tv_sec = t / 1000000000ull;
+        ts.tv_nsec = t % 1000000000ull;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        t += spin;
+    }
+    while (now_ns() < t)
+        cpu_relax();
+}
+
+static void replay_timed(uint64_t start)
+{
+    /* One loop lasts as long as the capture plus one mean gap */
+    uint64_t span = frames[nframes - 1].ts +
+                    (nframes > 1 ? frames[nframes - 1].ts / (nframes - 1) : 0);
+    uint64_t now, lag, t;
+    unsigned int n;
+
+    while (c_req < c_total) {
+        reclaim();
+        preload();
+        if (c_req == c_load) {
+            wait_room();
+            continue;
+        }
+
+        wait_until(due(c_req, start, span));
+
+        /* Everything due by now leaves together */
+        now = now_ns();
+        for (n = 0; c_req + n < c_load; n++) {
+            t = due(c_req + n, start, span);
+            if (t > now)
+                break;
+            lag = now - t;
+            res.hist[hist_bucket(lag)]++;
+            if (lag > res.lag_max)
+                res.lag_max = lag;
+        }
+        request(n);
+    }
+}
+
+static void replay_topspeed(void)
+{
+    unsigned int n;
+
+    while (c_req < c_total) {
+        reclaim();
+        preload();
+        n = c_load - c_req;
+        if (!n) {
+            wait_room();
+            continue;
+        }
+        request(n < opt.batch ? n : opt.batch);
+    }
+}
+
+/* -------------------- Main -------------------- */
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: mnet-replay [-i IFACE] [-x SPEED | -t [-b BATCH]] [-l LOOPS]\n"
+            "                   [-n FRAMES] [-S USECS] [-q] [-a CPU] [-p PRIO]\n"
+            "                   [-L LABEL] FILE\n"
+            "  -i  interface (default mnet0)\n"
+            "  -x  replay SPEED times faster than captured (default 1)\n"
+            "  -t  as fast as possible, BATCH frames per send() (default 64)\n"
+            "  -l  play the file LOOPS times (default 1)\n"
+            "  -n  TX ring slots (default 4096)\n"
+            "  -S  spin for the last USECS of each wait (default 50)\n"
+            "  -q  bypass the interface's qdisc\n"
+            "  -a  pin to this CPU\n"
+            "  -p  run SCHED_FIFO at this priority\n"
+            "  -L  label copied into the JSON output\n"
+            "FILE is pcap or pcapng with Ethernet frames.\n");
+    exit(2);
+}
+
+static uint64_t rate_of(uint64_t packets, uint64_t ns)
+{
+    return ns ? packets * 1000000000ull / ns : 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct sched_param sp;
+    uint64_t start, end, total = 0, orig_ns;
+    cpu_set_t set;
+    unsigned int b;
+    int c;
+
+    while ((c = getopt(argc, argv, "i:x:tb:l:n:S:qa:p:L:h")) != -1) {
+        switch (c) {
+        case 'i':
+            opt.ifname = optarg;
+            break;
+        case 'x':
+            opt.speed = strtod(optarg, NULL);
+            break;
+        case 't':
+            opt.topspeed = 1;
+            break;
+        case 'b':
+            opt.batch = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            opt.loops = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            opt.frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            opt.spin_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            opt.bypass = 1;
+            break;
+        case 'a':
+            opt.cpu = atoi(optarg);
+            break;
+        case 'p':
+            opt.prio = atoi(optarg);
+            break;
+        case 'L':
+            opt.label = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || !(opt.speed > 0) || !opt.loops ||
+        !opt.frames || !opt.batch)
+        usage();
+    opt.file = argv[optind];
+
+    iface_len_max();
+    load();
+    c_total = (uint64_t)nframes * opt.loops;
+    ring_setup();
+
+    if (opt.cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(opt.cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set))
+            die("sched_setaffinity");
+    }
+    if (opt.prio) {
+        sp.sched_priority = opt.prio;
+        if (sched_setscheduler(0, SCHED_FIFO, &sp))
+            die("sched_setscheduler");
+    }
+    /* hrtimer wakeups exactly at the requested time */
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    /* The first ring's worth is copied in before the clock starts */
+    preload();
+    start = now_ns();
+    if (opt.topspeed)
+        replay_topspeed();
+    else
+        replay_timed(start);
+
+    /* Wait for the last frames to leave */
+    while (c_done < c_req) {
+        kick();
+        wait_room();
+        res.waits--;
+    }
+    end = now_ns();
+
+    for (b = 0; b < HIST_BUCKETS; b++)
+        total += res.hist[b];
+    orig_ns = frames[nframes - 1].ts;
+
+    printf("{\"label\":\"%s\",\"file\":\"%s\",\"mode\":\"%s\","
+           "\"speed\":%.3f,\"loops\":%u,\"ring_frames\":%u,",
+           opt.label ? opt.label : "", opt.file,
+           opt.topspeed ? "topspeed" : "timed", opt.speed, opt.loops,
+           opt.frames);
+    printf("\"packets\":%" PRIu64 ",\"bytes\":%" PRIu64 ","
+           "\"skipped\":%" PRIu64 ","
+           "\"seconds\":%.6f,\"pps\":%" PRIu64 ",\"mbps\":%.1f,",
+           res.packets, res.bytes, skipped,
+           (end - start) / 1e9, rate_of(res.packets, end - start),
+           end > start ? res.bytes * 8e3 / (end - start) : 0.0);
+    printf("\"file_pps\":%" PRIu64 ",\"sends\":%" PRIu64 ","
+           "\"ring_waits\":%" PRIu64 ",",
+           rate_of(nframes > 1 ? nframes - 1 : 0, orig_ns),
+           res.sends, res.waits);
+    if (opt.topspeed) {
+        printf("\"timing_error_ns\":null}\n");
+    } else {
+        printf("\"timing_error_ns\":{\"p50\":%" PRIu64 ",\"p99\":%" PRIu64
+               ",\"max\":%" PRIu64 "}}\n",
+               hist_percentile(res.hist, total, 0.50),
+               hist_percentile(res.hist, total, 0.99), res.lag_max);
+    }
+    return 0;
+}
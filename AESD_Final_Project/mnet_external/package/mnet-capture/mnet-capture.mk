@@ -0,0 +1,22 @@
+################################################################################
+# mnet-capture package description
+################################################################################
+
+MNET_CAPTURE_VERSION = 1.0
+MNET_CAPTURE_SITE = $(BR2_EXTERNAL_MNET_EXTERNAL_PATH)/package/mnet-capture/src
+MNET_CAPTURE_SITE_METHOD = local
+
+define MNET_CAPTURE_BUILD_CMDS
+	$(TARGET_MAKE_ENV) $(MAKE) $(TARGET_CONFIGURE_OPTS) -C $(@D)
+endef
+
+define MNET_CAPTURE_INSTALL_TARGET_CMDS
+	$(INSTALL) -D -m 755 $(@D)/mnet-capture $(TARGET_DIR)/usr/bin/mnet-capture
+endef
+
+define MNET_CAPTURE_INSTALL_INIT_SYSV
+	$(INSTALL) -D -m 755 $(MNET_CAPTURE_PKGDIR)/S70mnet-capture \
+		$(TARGET_DIR)/etc/init.d/S70mnet-capture
+endef
+
+$(eval $(generic-package))
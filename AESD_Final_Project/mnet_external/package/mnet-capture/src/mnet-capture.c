@@ -0,0 +1,957 @@
+/*
+ * mnet-capture - pcapng capture daemon for mnet0 (or any Ethernet device).
+ *
+ * Two threads and no system call per packet:
+ *
+ *  - the reader maps a TPACKET_V3 ring and walks it a block at a time,
+ *    after one poll() per block. Each packet becomes a pcapng Enhanced
+ *    Packet Block in a 1 MiB staging chunk; VLAN tags the NIC stripped are
+ *    put back. Full chunks go to the writer through a small queue, one
+ *    lock round trip per chunk.
+ *  - the writer puts each chunk into the current output file. With -m
+ *    direct (default) it uses O_DIRECT pwrite() of whole chunks, so the
+ *    capture never fills the page cache, which on a Pi is what makes a
+ *    buffered writer stall at SD card speed. With -m mmap, or where the
+ *    filesystem refuses O_DIRECT, the chunk is copied into a shared
+ *    mapping of the file, whose writeback is started at once and whose
+ *    pages are dropped once written.
+ *
+ * Output files are preallocated with fallocate() so that writes never wait
+ * for block allocation and a mapped file cannot hit SIGBUS on a full disk.
+ * Files are named PREFIX-YYYYmmdd-HHMMSS-N.pcapng and rotated by size
+ * (-C) or age (-G), SIGHUP rotates at once. Each file is a complete pcapng
+ * section: SHB, IDB, packets, and an Interface Statistics Block with the
+ * kernel's received/dropped counts. -W keeps only the newest files.
+ *
+ * If the writer falls behind, the reader waits for a free chunk and the
+ * kernel ring absorbs the backlog; once it is full the kernel drops, and
+ * the drops show in the ISB and the final report. SIGUSR1 prints the
+ * counters, which are also printed as one JSON line on exit.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE      (1u << 20)      // staging chunk, multiple of ALIGN
+#define ALIGN           4096            // O_DIRECT offset and length unit
+#define PREALLOC_STEP   (64ull << 20)   // without -C, grow files this much
+#define SNAPLEN_MAX     262144
+
+/* pcapng */
+#define BT_SHB          0x0a0d0d0a
+#define BT_IDB          0x00000001
+#define BT_ISB          0x00000005
+#define BT_EPB          0x00000006
+#define BYTE_ORDER_MAGIC 0x1a2b3c4d
+#define LINKTYPE_ETHERNET 1
+#define OPT_ENDOFOPT    0
+#define OPT_SHB_USERAPPL 4
+#define OPT_IF_NAME     2
+#define OPT_IF_TSRESOL  9
+#define OPT_ISB_IFRECV  4
+#define OPT_ISB_IFDROP  5
+#define EPB_HDR_LEN     28              // type .. original length
+#define VLAN_HLEN       4
+
+enum out_mode {
+    OUT_DIRECT,
+    OUT_MMAP,
+};
+
+struct opts {
+    const char *ifname;
+    const char *prefix;
+    uint64_t rotate_bytes;      // 0: no size rotation
+    unsigned int rotate_secs;   // 0: no time rotation
+    unsigned int keep;          // files kept, 0: all
+    unsigned int snaplen;
+    unsigned int block_size;    // TPACKET_V3 block
+    unsigned int block_nr;
+    unsigned int chunks;        // staging chunks
+    enum out_mode mode;
+    int cpu_reader;             // -1: not pinned
+    int cpu_writer;
+    int daemon;
+    const char *pidfile;
+};
+
+/* One staging chunk: bytes of one output file, in order */
+struct chunk {
+    uint8_t *buf;
+    size_t len;
+    unsigned int file;          // sequence number of the output file
+    time_t start;               // when that file was started
+    int first;                  // opens the file
+    int last;                   // closes the file
+};
+
+struct stats {
+    uint64_t packets;           // written to pcapng
+    uint64_t bytes;             // captured bytes written
+    uint64_t kernel_packets;    // seen by the ring, PACKET_STATISTICS
+    uint64_t kernel_drops;
+    uint64_t kernel_freezes;    // times the ring was full
+    uint64_t blocks;            // ring blocks walked
+    uint64_t reader_waits;      // no free chunk, reader blocked
+    uint64_t file_bytes;        // written to disk, headers included
+    uint64_t files;
+    uint64_t write_ns_max;      // slowest chunk write
+};
+
+static struct opts opt = {
+    .ifname = "mnet0",
+    .rotate_bytes = 1024ull << 20,
+    .snaplen = SNAPLEN_MAX,
+    .block_size = 1u << 20,
+    .block_nr = 32,
+    .chunks = 32,
+    .mode = OUT_DIRECT,
+    .cpu_reader = -1,
+    .cpu_writer = -1,
+};
+
+static struct stats st;
+static volatile sig_atomic_t stop, rotate_now, report_now;
+
+/* Chunk queue between reader and writer */
+static struct chunk *chunks;
+static unsigned int q_fill, q_drain, q_count;
+static int q_done, q_error;
+static pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t q_not_full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t q_not_empty = PTHREAD_COND_INITIALIZER;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void msg(int prio, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    if (opt.daemon) {
+        vsyslog(prio, fmt, ap);
+    } else {
+        fputs("mnet-capture: ", stderr);
+        vfprintf(stderr, fmt, ap);
+        fputc('\n', stderr);
+    }
+    va_end(ap);
+}
+
+static void die(const char *what)
+{
+    msg(LOG_ERR, "%s: %s", what, strerror(errno));
+    exit(1);
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        msg(LOG_WARNING, "cannot pin to CPU %d", cpu);
+}
+
+/* -------------------- Chunk queue -------------------- */
+/* Reader: the chunk to fill next, waiting for the writer if none is free */
+static struct chunk *chunk_get(void)
+{
+    struct chunk *c;
+
+    pthread_mutex_lock(&q_lock);
+    if (q_count == opt.chunks)
+        st.reader_waits++;
+    while (q_count == opt.chunks && !q_error)
+        pthread_cond_wait(&q_not_full, &q_lock);
+    c = q_error ? NULL : &chunks[q_fill];
+    pthread_mutex_unlock(&q_lock);
+
+    if (c) {
+        c->len = 0;
+        c->first = 0;
+        c->last = 0;
+    }
+    return c;
+}
+
+/* Reader: hand the chunk from chunk_get() to the writer */
+static void chunk_put(void)
+{
+    pthread_mutex_lock(&q_lock);
+    q_fill = (q_fill + 1) % opt.chunks;
+    q_count++;
+    pthread_cond_signal(&q_not_empty);
+    pthread_mutex_unlock(&q_lock);
+}
+
+/* -------------------- Output stream (reader side) -------------------- */
+/*
+ * The reader writes one byte stream per output file. It is cut into
+ * chunks at CHUNK_SIZE, so every chunk but the last of a file is full and
+ * each file offset the writer sees is ALIGN aligned.
+ */
+struct stream {
+    struct chunk *cur;
+    unsigned int file;          // sequence number of the current file
+    time_t start;
+    uint64_t file_len;          // bytes of the current file so far
+    uint64_t file_packets;
+    uint64_t rotate_at;         // CLOCK_MONOTONIC ns, 0: never
+};
+
+static int stream_next(struct stream *s)
+{
+    chunk_put();
+    s->cur = chunk_get();
+    if (!s->cur)
+        return -1;
+    s->cur->file = s->file;
+    s->cur->start = s->start;
+    return 0;
+}
+
+static int stream_write(struct stream *s, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    size_t n;
+
+    while (len) {
+        if (s->cur->len == CHUNK_SIZE && stream_next(s))
+            return -1;
+        n = CHUNK_SIZE - s->cur->len;
+        if (n > len)
+            n = len;
+        memcpy(s->cur->buf + s->cur->len, p, n);
+        s->cur->len += n;
+        p += n;
+        len -= n;
+    }
+    s->file_len += p - (const uint8_t *)data;
+    return 0;
+}
+
+static int stream_u32(struct stream *s, uint32_t v)
+{
+    return stream_write(s, &v, sizeof(v));
+}
+
+/* Option header and value padded to 32 bits */
+static int stream_opt(struct stream *s, uint16_t code, const void *val,
+                      uint16_t len)
+{
+    static const uint8_t zero[4];
+    uint16_t hdr[2] = { code, len };
+
+    if (stream_write(s, hdr, sizeof(hdr)) || stream_write(s, val, len))
+        return -1;
+    return stream_write(s, zero, -len & 3);
+}
+
+/* -------------------- pcapng blocks -------------------- */
+static int write_shb(struct stream *s)
+{
+    static const char appl[] = "mnet-capture";
+    uint32_t len = 28 + 4 + ((sizeof(appl) - 1 + 3) & ~3u) + 4;
+    struct {
+        uint32_t type, len, magic;
+        uint16_t major, minor;
+        int64_t section_len;
+    } __attribute__((packed)) hdr = {
+        BT_SHB, len, BYTE_ORDER_MAGIC, 1, 0, -1,
+    };
+
+    if (stream_write(s, &hdr, sizeof(hdr)) ||
+        stream_opt(s, OPT_SHB_USERAPPL, appl, sizeof(appl) - 1) ||
+        stream_opt(s, OPT_ENDOFOPT, NULL, 0))
+        return -1;
+    return stream_u32(s, len);
+}
+
+static int write_idb(struct stream *s)
+{
+    size_t name_len = strlen(opt.ifname);
+    uint8_t tsresol = 9;        // nanoseconds
+    uint32_t len = 16 + 4 + ((name_len + 3) & ~3u) + 4 + 4 + 4 + 4;
+    struct {
+        uint32_t type, len;
+        uint16_t linktype, reserved;
+        uint32_t snaplen;
+    } hdr = { BT_IDB, len, LINKTYPE_ETHERNET, 0, opt.snaplen };
+
+    if (stream_write(s, &hdr, sizeof(hdr)) ||
+        stream_opt(s, OPT_IF_NAME, opt.ifname, name_len) ||
+        stream_opt(s, OPT_IF_TSRESOL, &tsresol, 1) ||
+        stream_opt(s, OPT_ENDOFOPT, NULL, 0))
+        return -1;
+    return stream_u32(s, len);
+}
+
+static int write_isb(struct stream *s)
+{
+    uint32_t len = 20 + (4 + 8) * 2 + 4 + 4;
+    struct timespec ts;
+    uint64_t t, recv, drop;
+    struct {
+        uint32_t type, len, if_id, ts_high, ts_low;
+    } hdr;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    t = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    hdr = (typeof(hdr)){ BT_ISB, len, 0, t >> 32, (uint32_t)t };
+    recv = st.kernel_packets;
+    drop = st.kernel_drops;
+
+    if (stream_write(s, &hdr, sizeof(hdr)) ||
+        stream_opt(s, OPT_ISB_IFRECV, &recv, sizeof(recv)) ||
+        stream_opt(s, OPT_ISB_IFDROP, &drop, sizeof(drop)) ||
+        stream_opt(s, OPT_ENDOFOPT, NULL, 0))
+        return -1;
+    return stream_u32(s, len);
+}
+
+static int write_epb(struct stream *s, const struct tpacket3_hdr *ppd)
+{
+    static const uint8_t zero[4];
+    const uint8_t *data = (const uint8_t *)ppd + ppd->tp_mac;
+    uint32_t caplen = ppd->tp_snaplen, origlen = ppd->tp_len;
+    uint64_t t = (uint64_t)ppd->tp_sec * 1000000000ull + ppd->tp_nsec;
+    int vlan = (ppd->tp_status & TP_STATUS_VLAN_VALID) &&
+               caplen >= 2 * ETH_ALEN;
+    uint8_t tag[VLAN_HLEN];
+    uint32_t hdr[7], len;
+
+    if (vlan) {
+        uint16_t tpid = (ppd->tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+                        ppd->hv1.tp_vlan_tpid : ETH_P_8021Q;
+
+        *(uint16_t *)tag = htons(tpid);
+        *(uint16_t *)(tag + 2) = htons(ppd->hv1.tp_vlan_tci);
+        caplen += VLAN_HLEN;
+        origlen += VLAN_HLEN;
+    }
+    if (caplen > opt.snaplen)
+        caplen = opt.snaplen;
+
+    len = EPB_HDR_LEN + ((caplen + 3) & ~3u) + 4;
+    hdr[0] = BT_EPB;
+    hdr[1] = len;
+    hdr[2] = 0;
+    hdr[3] = t >> 32;
+    hdr[4] = (uint32_t)t;
+    hdr[5] = caplen;
+    hdr[6] = origlen;
+
+    if (stream_write(s, hdr, sizeof(hdr)))
+        return -1;
+    if (vlan) {
+        if (stream_write(s, data, 2 * ETH_ALEN) ||
+            stream_write(s, tag, VLAN_HLEN) ||
+            stream_write(s, data + 2 * ETH_ALEN,
+                         caplen - 2 * ETH_ALEN - VLAN_HLEN))
+            return -1;
+    } else if (stream_write(s, data, caplen)) {
+        return -1;
+    }
+    if (stream_write(s, zero, -caplen & 3) || stream_u32(s, len))
+        return -1;
+
+    st.packets++;
+    st.bytes += caplen;
+    s->file_packets++;
+    return 0;
+}
+
+/* -------------------- Reader -------------------- */
+static int sock_fd;
+static uint8_t *ring;
+
+/* Fold the kernel counters, which PACKET_STATISTICS resets on each read */
+static void kernel_stats(void)
+{
+    struct tpacket_stats_v3 ks;
+    socklen_t len = sizeof(ks);
+
+    if (getsockopt(sock_fd, SOL_PACKET, PACKET_STATISTICS, &ks, &len))
+        return;
+    st.kernel_packets += ks.tp_packets;
+    st.kernel_drops += ks.tp_drops;
+    st.kernel_freezes += ks.tp_freeze_q_cnt;
+}
+
+/* One JSON line on stdout, or syslog in the background */
+static void report(void)
+{
+    char line[512];
+
+    snprintf(line, sizeof(line),
+             "{\"interface\":\"%s\",\"packets\":%" PRIu64 ",\"bytes\":%"
+             PRIu64 ",\"kernel_packets\":%" PRIu64 ",\"kernel_drops\":%"
+             PRIu64 ",\"ring_full\":%" PRIu64 ",\"blocks\":%" PRIu64 ","
+             "\"reader_waits\":%" PRIu64 ",\"files\":%" PRIu64 ","
+             "\"file_bytes\":%" PRIu64 ",\"write_ms_max\":%" PRIu64 "}",
+               opt.ifname, st.packets, st.bytes, st.kernel_packets,
+             st.kernel_drops, st.kernel_freezes, st.blocks, st.reader_waits,
+             __atomic_load_n(&st.files, __ATOMIC_RELAXED),
+             __atomic_load_n(&st.file_bytes, __ATOMIC_RELAXED),
+             __atomic_load_n(&st.write_ns_max, __ATOMIC_RELAXED) / 1000000);
+    if (opt.daemon) {
+        syslog(LOG_INFO, "%s", line);
+    } else {
+        puts(line);
+        fflush(stdout);
+    }
+}
+
+static int file_begin(struct stream *s)
+{
+    s->file++;
+    s->start = time(NULL);
+    s->file_len = 0;
+    s->file_packets = 0;
+    s->rotate_at = opt.rotate_secs ?
+                   now_ns() + opt.rotate_secs * 1000000000ull : 0;
+    s->cur->file = s->file;
+    s->cur->start = s->start;
+    s->cur->first = 1;
+    return write_shb(s) || write_idb(s) ? -1 : 0;
+}
+
+/* Close the current file and, unless @final, start the next one */
+static int file_end(struct stream *s, int final)
+{
+    kernel_stats();
+    if (write_isb(s))
+        return -1;
+    s->cur->last = 1;
+    if (final) {
+        chunk_put();
+        s->cur = NULL;
+        return 0;
+    }
+    if (stream_next(s))
+        return -1;
+    return file_begin(s);
+}
+
+static int ring_setup(void)
+{
+    struct sock_filter snap = BPF_STMT(BPF_RET | BPF_K, opt.snaplen);
+    struct sock_fprog prog = { .len = 1, .filter = &snap };
+    struct tpacket_req3 req = { 0 };
+    struct sockaddr_ll sll = { 0 };
+    int ver = TPACKET_V3;
+
+    sock_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (sock_fd < 0)
+        die("socket");
+    if (setsockopt(sock_fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)))
+        die("PACKET_VERSION");
+
+    req.tp_block_size = opt.block_size;
+    req.tp_block_nr = opt.block_nr;
+    req.tp_frame_size = 2048;
+    req.tp_frame_nr = (uint64_t)opt.block_size * opt.block_nr /
+                      req.tp_frame_size;
+    req.tp_retire_blk_tov = 50;     // ms, bounds latency at low rates
+    if (setsockopt(sock_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+        die("PACKET_RX_RING");
+
+    ring = mmap(NULL, (size_t)opt.block_size * opt.block_nr,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE,
+                sock_fd, 0);
+    if (ring == MAP_FAILED) {
+        /* MAP_LOCKED needs RLIMIT_MEMLOCK, not worth failing for */
+        ring = mmap(NULL, (size_t)opt.block_size * opt.block_nr,
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    sock_fd, 0);
+        if (ring == MAP_FAILED)
+            die("mmap ring");
+    }
+
+    /* The kernel copies only snaplen bytes into the ring */
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                   sizeof(prog)))
+        die("SO_ATTACH_FILTER");
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = if_nametoindex(opt.ifname);
+    if (!sll.sll_ifindex)
+        die(opt.ifname);
+    if (bind(sock_fd, (struct sockaddr *)&sll, sizeof(sll)))
+        die("bind");
+
+    /* Counters from before the bind belong to no interface */
+    kernel_stats();
+    memset(&st, 0, sizeof(st));
+    return 0;
+}
+
+static void *reader_thread(void *arg)
+{
+    struct pollfd pfd = { .fd = sock_fd, .events = POLLIN | POLLERR };
+    struct stream s = { 0 };
+    struct tpacket_block_desc *bd;
+    struct tpacket3_hdr *ppd;
+    unsigned int blk = 0, i, n;
+    uint32_t plen;
+
+    (void)arg;
+    pin(opt.cpu_reader);
+
+    s.cur = chunk_get();
+    if (!s.cur || file_begin(&s))
+        goto out;
+
+    while (!stop) {
+        bd = (struct tpacket_block_desc *)(ring +
+                                           (size_t)blk * opt.block_size);
+
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+              TP_STATUS_USER)) {
+            /* Idle: the only time the reader sleeps in the kernel */
+            if (poll(&pfd, 1, 1000) < 0 && errno != EINTR)
+                break;
+        } else {
+            n = bd->hdr.bh1.num_pkts;
+            ppd = (struct tpacket3_hdr *)((uint8_t *)bd +
+                                          bd->hdr.bh1.offset_to_first_pkt);
+            for (i = 0; i < n; i++) {
+                plen = EPB_HDR_LEN + ppd->tp_snaplen + VLAN_HLEN + 8;
+                if (opt.rotate_bytes && s.file_packets &&
+                    s.file_len + plen > opt.rotate_bytes &&
+                    file_end(&s, 0))
+                    goto out;
+                if (write_epb(&s, ppd))
+                    goto out;
+                ppd = (struct tpacket3_hdr *)((uint8_t *)ppd +
+                                              ppd->tp_next_offset);
+            }
+            __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                             __ATOMIC_RELEASE);
+            blk = (blk + 1) % opt.block_nr;
+            st.blocks++;
+        }
+
+        if (rotate_now || (s.rotate_at && now_ns() >= s.rotate_at)) {
+            rotate_now = 0;
+            if (file_end(&s, 0))
+                goto out;
+        }
+        if (report_now) {
+            report_now = 0;
+            kernel_stats();
+            report();
+        }
+    }
+
+    file_end(&s, 1);
+out:
+    pthread_mutex_lock(&q_lock);
+    q_done = 1;
+    pthread_cond_signal(&q_not_empty);
+    pthread_mutex_unlock(&q_lock);
+    return NULL;
+}
+
+/* -------------------- Writer -------------------- */
+struct outfile {
+    int fd;
+    enum out_mode mode;
+    uint64_t off;               // bytes written
+    uint64_t alloc;             // bytes preallocated
+    char path[4096];
+};
+
+static char (*kept)[4096];      // -W: paths of the files still on disk
+static unsigned int kept_next;
+
+static void file_forget_old(const char *path)
+{
+    char *slot = kept[kept_next];
+
+    if (slot[0] && unlink(slot))
+        msg(LOG_WARNING, "unlink %s: %s", slot, strerror(errno));
+    snprintf(slot, sizeof(kept[0]), "%s", path);
+    kept_next = (kept_next + 1) % opt.keep;
+}
+
+static int file_open(struct outfile *f, const struct chunk *c)
+{
+    struct tm tm;
+    char stamp[32];
+
+    localtime_r(&c->start, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf(f->path, sizeof(f->path), "%s-%s-%u.pcapng", opt.prefix,
+             stamp, c->file);
+
+    f->mode = opt.mode;
+    f->fd = -1;
+    if (f->mode == OUT_DIRECT) {
+        f->fd = open(f->path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (f->fd < 0 && errno == EINVAL) {
+            msg(LOG_WARNING, "%s: no O_DIRECT here, using mmap", f->path);
+            opt.mode = f->mode = OUT_MMAP;
+        }
+    }
+    if (f->fd < 0)
+        f->fd = open(f->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (f->fd < 0) {
+        msg(LOG_ERR, "open %s: %s", f->path, strerror(errno));
+        return -1;
+    }
+    f->off = 0;
+    f->alloc = 0;
+    if (opt.keep)
+        file_forget_old(f->path);
+    __atomic_add_fetch(&st.files, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*
+ * Reserve blocks up to @end. A direct file keeps its size, so readers see
+ * only what was written; a mapped file must be that large to be mapped.
+ */
+static int file_reserve(struct outfile *f, uint64_t end)
+{
+    uint64_t want;
+
+    if (end <= f->alloc)
+        return 0;
+    want = opt.rotate_bytes ? opt.rotate_bytes + CHUNK_SIZE :
+                              f->alloc + PREALLOC_STEP;
+    if (want < end)
+        want = end;
+    want = (want + ALIGN - 1) & ~(uint64_t)(ALIGN - 1);
+
+    if (fallocate(f->fd, f->mode == OUT_DIRECT ? FALLOC_FL_KEEP_SIZE : 0,
+                  f->alloc, want - f->alloc)) {
+        if (errno != EOPNOTSUPP) {
+            msg(LOG_ERR, "fallocate %s: %s", f->path, strerror(errno));
+            return -1;
+        }
+        /* No preallocation here: mapped files become sparse */
+        if (f->mode == OUT_MMAP && ftruncate(f->fd, want)) {
+            msg(LOG_ERR, "ftruncate %s: %s", f->path, strerror(errno));
+            return -1;
+        }
+    }
+    f->alloc = want;
+    return 0;
+}
+
+static int write_direct(struct outfile *f, const struct chunk *c)
+{
+    size_t head = c->len & ~(size_t)(ALIGN - 1);
+    ssize_t ret;
+    int flags;
+
+    if (head) {
+        ret = pwrite(f->fd, c->buf, head, f->off);
+        if (ret != (ssize_t)head)
+            return -1;
+    }
+    if (head == c->len)
+        return 0;
+
+    /* The unaligned tail of a file's last chunk goes through the cache */
+    flags = fcntl(f->fd, F_GETFL);
+    if (flags < 0 || fcntl(f->fd, F_SETFL, flags & ~O_DIRECT))
+        return -1;
+    ret = pwrite(f->fd, c->buf + head, c->len - head, f->off + head);
+    return ret == (ssize_t)(c->len - head) ? 0 : -1;
+}
+
+static int write_mmap(struct outfile *f, const struct chunk *c)
+{
+    size_t map_len = (c->len + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    void *map;
+
+    map = mmap(NULL, map_len, PROT_WRITE, MAP_SHARED, f->fd, f->off);
+    if (map == MAP_FAILED)
+        return -1;
+    memcpy(map, c->buf, c->len);
+    munmap(map, map_len);
+
+    /* Start writeback now, drop the previous chunk once it is on disk */
+    sync_file_range(f->fd, f->off, c->len, SYNC_FILE_RANGE_WRITE);
+    if (f->off >= CHUNK_SIZE) {
+        sync_file_range(f->fd, f->off - CHUNK_SIZE, CHUNK_SIZE,
+                        SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(f->fd, f->off - CHUNK_SIZE, CHUNK_SIZE,
+                      POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+static int file_write(struct outfile *f, const struct chunk *c)
+{
+    uint64_t t0 = now_ns(), dt;
+    int ret;
+
+    if (file_reserve(f, f->off + c->len))
+        return -1;
+    ret = f->mode == OUT_DIRECT ? write_direct(f, c) : write_mmap(f, c);
+    if (ret) {
+        msg(LOG_ERR, "write %s: %s", f->path, strerror(errno));
+        return -1;
+    }
+    f->off += c->len;
+    __atomic_add_fetch(&st.file_bytes, c->len, __ATOMIC_RELAXED);
+
+    dt = now_ns() - t0;
+    if (dt > st.write_ns_max)
+        __atomic_store_n(&st.write_ns_max, dt, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Give back the preallocation past the data */
+static int file_close(struct outfile *f)
+{
+    int ret = 0;
+
+    if (ftruncate(f->fd, f->off) || fsync(f->fd)) {
+        msg(LOG_ERR, "close %s: %s", f->path, strerror(errno));
+        ret = -1;
+    }
+    close(f->fd);
+    f->fd = -1;
+    return ret;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct outfile f = { .fd = -1 };
+    struct chunk *c;
+    int err = 0;
+
+    (void)arg;
+    pin(opt.cpu_writer);
+
+    for (;;) {
+        pthread_mutex_lock(&q_lock);
+        while (!q_count && !q_done)
+            pthread_cond_wait(&q_not_empty, &q_lock);
+        if (!q_count) {
+            pthread_mutex_unlock(&q_lock);
+            break;
+        }
+        c = &chunks[q_drain];
+        pthread_mutex_unlock(&q_lock);
+
+        if (!err && c->first && file_open(&f, c))
+            err = 1;
+        if (!err && f.fd >= 0 && c->len && file_write(&f, c))
+            err = 1;
+        if (f.fd >= 0 && (c->last || err) && file_close(&f))
+            err = 1;
+
+        pthread_mutex_lock(&q_lock);
+        q_drain = (q_drain + 1) % opt.chunks;
+        q_count--;
+        if (err && !q_error) {
+            q_error = 1;
+            stop = 1;
+        }
+        pthread_cond_signal(&q_not_full);
+        pthread_mutex_unlock(&q_lock);
+    }
+
+    if (f.fd >= 0)
+        file_close(&f);
+    return NULL;
+}
+
+/* -------------------- Main -------------------- */
+static void on_signal(int sig)
+{
+    if (sig == SIGHUP)
+        rotate_now = 1;
+    else if (sig == SIGUSR1)
+        report_now = 1;
+    else
+        stop = 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: mnet-capture -w PREFIX [-i IFACE] [-C MB] [-G SECS] [-W N]\n"
+            "       [-s SNAPLEN] [-b KB] [-n BLOCKS] [-B CHUNKS] [-m direct|mmap]\n"
+            "       [-a CPU[,CPU]] [-D] [-P PIDFILE]\n"
+            "  -w  output files are PREFIX-YYYYmmdd-HHMMSS-N.pcapng\n"
+            "  -i  interface (default mnet0)\n"
+            "  -C  rotate after MB megabytes, 0: never (default 1024)\n"
+            "  -G  rotate after SECS seconds, 0: never (default 0)\n"
+            "  -W  keep only the newest N files (default all)\n"
+            "  -s  bytes captured per packet (default %u)\n"
+            "  -b  TPACKET_V3 block size in KB, power of two (default 1024)\n"
+            "  -n  TPACKET_V3 blocks (default 32)\n"
+            "  -B  1 MiB staging chunks between reader and writer (default 32)\n"
+            "  -m  O_DIRECT writes (default) or a shared mapping of the file\n"
+            "  -a  pin the reader, and the writer, to these CPUs\n"
+            "  -D  run in the background, log to syslog\n"
+            "  -P  write the daemon's pid here\n"
+            "SIGHUP rotates, SIGUSR1 prints counters, SIGINT/SIGTERM stop.\n",
+            SNAPLEN_MAX);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction sa = { .sa_handler = on_signal };
+    pthread_t reader, writer;
+    unsigned int i;
+    uint8_t *mem;
+    char *end;
+    FILE *pf;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:i:C:G:W:s:b:n:B:m:a:DP:h")) != -1) {
+        switch (c) {
+        case 'w':
+            opt.prefix = optarg;
+            break;
+        case 'i':
+            opt.ifname = optarg;
+            break;
+        case 'C':
+            opt.rotate_bytes = strtoull(optarg, NULL, 0) << 20;
+            break;
+        case 'G':
+            opt.rotate_secs = strtoul(optarg, NULL, 0);
+            break;
+        case 'W':
+            opt.keep = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            opt.snaplen = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            opt.block_size = strtoul(optarg, NULL, 0) << 10;
+            break;
+        case 'n':
+            opt.block_nr = strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            opt.chunks = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (!strcmp(optarg, "direct"))
+                opt.mode = OUT_DIRECT;
+            else if (!strcmp(optarg, "mmap"))
+                opt.mode = OUT_MMAP;
+            else
+                usage();
+            break;
+        case 'a':
+            opt.cpu_reader = strtol(optarg, &end, 0);
+            if (*end == ',')
+                opt.cpu_writer = strtol(end + 1, NULL, 0);
+            break;
+        case 'D':
+            opt.daemon = 1;
+            break;
+        case 'P':
+            opt.pidfile = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc || !opt.prefix || !opt.snaplen || !opt.block_nr ||
+        opt.snaplen < 2 * ETH_ALEN + VLAN_HLEN ||
+        opt.chunks < 2 || opt.block_size < (unsigned int)getpagesize() ||
+        (opt.block_size & (opt.block_size - 1)))
+        usage();
+    /* A packet has to fit in one ring block */
+    if (opt.snaplen > opt.block_size - 256)
+        opt.snaplen = opt.block_size - 256;
+
+    ring_setup();
+
+    if (opt.daemon) {
+        openlog("mnet-capture", LOG_PID, LOG_DAEMON);
+        if (daemon(0, 0))
+            die("daemon");
+    }
+
+    /* Staging memory, page aligned for O_DIRECT and locked if allowed */
+    mem = mmap(NULL, (size_t)opt.chunks * CHUNK_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (mem == MAP_FAILED)
+        die("mmap chunks");
+    mlock(mem, (size_t)opt.chunks * CHUNK_SIZE);
+    chunks = calloc(opt.chunks, sizeof(*chunks));
+    if (!chunks)
+        die("calloc");
+    for (i = 0; i < opt.chunks; i++)
+        chunks[i].buf = mem + (size_t)i * CHUNK_SIZE;
+    if (opt.keep) {
+        kept = calloc(opt.keep, sizeof(*kept));
+        if (!kept)
+            die("calloc");
+    }
+
+    if (opt.pidfile) {
+        pf = fopen(opt.pidfile, "w");
+        if (pf) {
+            fprintf(pf, "%d\n", getpid());
+            fclose(pf);
+        }
+    }
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (pthread_create(&writer, NULL, writer_thread, NULL) ||
+        pthread_create(&reader, NULL, reader_thread, NULL))
+        die("pthread_create");
+
+    /* Signals land here, the reader polls with a timeout */
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+
+    kernel_stats();
+    report();
+    if (opt.pidfile)
+        unlink(opt.pidfile);
+    return q_error ? 1 : 0;
+}
@@ -6,14 +6,30 @@ MNET_VERSION = 1.0
 MNET_SITE = $(BR2_EXTERNAL_MNET_EXTERNAL_PATH)/package/mnet
 MNET_SITE_METHOD = local
 
+# Also seen by the kernel-module build and install hooks
+ifeq ($(BR2_PACKAGE_MNET_KUNIT_TEST),y)
+MNET_MODULE_MAKE_OPTS += CONFIG_MNET_KUNIT_TEST=y
+endif
+
 define MNET_BUILD_CMDS
 	$(MAKE) -C $(LINUX_DIR) \
 		M=$(@D) \
 		ARCH=$(KERNEL_ARCH) \
 		CROSS_COMPILE="$(TARGET_CROSS)" \
+		$(MNET_MODULE_MAKE_OPTS) \
 		modules
 endef
 
+# Copy-break buffers come from page_pool, which BPF_SYSCALL selects.
+# The KUnit suite needs KUnit built in, and its debugfs for the results.
+define MNET_LINUX_CONFIG_FIXUPS
+	$(call KCONFIG_ENABLE_OPT,CONFIG_BPF_SYSCALL)
+	$(call KCONFIG_ENABLE_OPT,CONFIG_PAGE_POOL_STATS)
+	$(if $(BR2_PACKAGE_MNET_KUNIT_TEST),
+		$(call KCONFIG_ENABLE_OPT,CONFIG_KUNIT)
+		$(call KCONFIG_ENABLE_OPT,CONFIG_KUNIT_DEBUGFS))
+endef
+
 define MNET_INSTALL_TARGET_CMDS
 	$(INSTALL) -D -m 644 $(@D)/src/mnet.ko \
 		$(TARGET_DIR)/lib/modules/$(LINUX_VERSION_PROBED)/kernel/drivers/net/mnet.ko
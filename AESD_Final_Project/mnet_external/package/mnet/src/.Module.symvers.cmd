@@ -1 +0,0 @@
-cmd_/home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/Module.symvers :=  sed 's/ko$$/o/'  /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/modules.order | scripts/mod/modpost -m -a    -o /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/Module.symvers -e -i Module.symvers -T - 
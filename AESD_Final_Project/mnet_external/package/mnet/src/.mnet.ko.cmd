@@ -1 +0,0 @@
-cmd_/home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/mnet.ko := /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/buildroot/output/host/bin/aarch64-buildroot-linux-gnu-ld -r -EL  -maarch64elf -z noexecstack --no-warn-rwx-segments --build-id=sha1  -T scripts/module.lds -o /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/mnet.ko /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/mnet.o /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/mnet.mod.o;  true
@@ -1 +0,0 @@
-cmd_/home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/mnet.mod := printf '%s\n'   mnet.o | awk '!x[$$0]++ { print("/home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/"$$0) }' > /home/krevoor/AESD/final-project-kaif-shahid-shaikh/AESD_Final_Project/mnet_external/package/mnet/src/mnet.mod
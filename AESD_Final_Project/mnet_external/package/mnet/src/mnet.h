@@ -0,0 +1,506 @@
+#ifndef _MNET_H
+#define _MNET_H
+
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/if_vlan.h>
+#include <linux/jump_label.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/u64_stats_sync.h>
+
+#include "mnet_encap.h"
+#include "mnet_genl.h"
+
+#define DRV_NAME "mnet"
+#define DRV_VERSION "3.2"
+
+struct dentry;
+struct seq_file;
+struct page_pool;
+
+/* -------------------- Modes -------------------- */
+enum mnet_mode {
+    MNET_MODE_MIRROR,   // clone everything from the lower ports up to mnet0
+    MNET_MODE_BRIDGE,   // learning bridge between the lower ports and mnet0
+};
+
+/* -------------------- Runtime config -------------------- */
+#define MNET_SNAPLEN_MIN    64
+#define MNET_COPYBREAK_DEF  256
+#define MNET_COPYBREAK_MAX  1024
+
+/* Replaced as a whole under RTNL, read under RCU, see mnet_config.c */
+struct mnet_config {
+    enum mnet_mode mode;
+    bool flow_offload;
+    bool rx_tstamp;             // stamp RX in the rx_handler if not done yet
+    bool top_talkers;           // feed the top talkers table
+    bool sketch;                // feed the HLL/count-min sketches
+    bool profile;               // count frames by size and protocol
+    bool direct_xmit;           // bypass the lower qdisc, see mnet_xmit.c
+    u32 sketch_epoch;           // seconds between sketch resets, 0: never
+    u32 snaplen;                // mirrored frames are cut to this, 0: off
+    u32 copybreak;              // RX frames up to this are copied, 0: off
+    u32 sample_rate;            // mirror one frame in sample_rate per CPU
+    __be32 collector_addr;      // encapsulated mirror destination
+    __be16 collector_port;      // UDP, 0: encapsulation off
+    u32 collector_trunc;        // encapsulated frames cut to this, 0: off
+    char collector_dev[IFNAMSIZ];   // egress device, "": by route
+    DECLARE_BITMAP(vlan_mirror, VLAN_N_VID);  // VIDs mirrored to mnet0
+    struct rcu_head rcu;
+};
+
+/* -------------------- Optional stages -------------------- */
+/*
+ * Optional per-packet work sits behind static keys that are on only while
+ * the config enables it, so a disabled stage is a patched-out NOP rather
+ * than a load and a test. See mnet_stage_keys_update().
+ */
+DECLARE_STATIC_KEY_FALSE(mnet_key_rx_tstamp);
+DECLARE_STATIC_KEY_FALSE(mnet_key_top_talkers);
+DECLARE_STATIC_KEY_FALSE(mnet_key_sketch);
+DECLARE_STATIC_KEY_FALSE(mnet_key_profile);
+DECLARE_STATIC_KEY_FALSE(mnet_key_flow_offload);
+DECLARE_STATIC_KEY_FALSE(mnet_key_mirror_filter);   // VLAN filter, sampling
+DECLARE_STATIC_KEY_FALSE(mnet_key_collector);
+
+/* Boolean stage @_name of struct mnet_config is on */
+#define mnet_stage(_name, cfg) \
+    (static_branch_unlikely(&mnet_key_##_name) && (cfg)->_name)
+
+/* -------------------- Per-CPU counters -------------------- */
+enum mnet_stat {
+    MNET_STAT_RX_PACKETS,
+    MNET_STAT_RX_BYTES,
+    MNET_STAT_TX_PACKETS,
+    MNET_STAT_TX_BYTES,
+    MNET_STAT_RX_DROPPED,
+    MNET_STAT_TX_DROPPED,
+    MNET_STAT_VLAN_FILTERED,
+    MNET_STAT_SAMPLE_SKIPPED,
+    MNET_STAT_ENCAP_PACKETS,
+    MNET_STAT_ENCAP_BYTES,
+    MNET_STAT_ENCAP_DROPPED,
+    MNET_STAT_FWD_PACKETS,
+    MNET_STAT_FLOOD_PACKETS,
+    MNET_STAT_DIRECT_PACKETS,
+    MNET_STAT_DIRECT_FALLBACK,
+    MNET_STAT_RX_COPY,
+    MNET_STAT_RX_CLONE,
+    MNET_STAT_FDB_HIT,
+    MNET_STAT_FDB_MISS,
+    MNET_STAT_FLOW_HIT,
+    MNET_STAT_FLOW_MISS,
+    MNET_STAT_FQ_DROP_CODEL,
+    MNET_STAT_FQ_DROP_OVERLIMIT,
+    MNET_STAT_TX_BAND0_PACKETS,     // per band packets/bytes pairs
+    MNET_STAT_TX_BAND0_BYTES,
+    MNET_STAT_TX_BAND1_PACKETS,
+    MNET_STAT_TX_BAND1_BYTES,
+    MNET_STAT_TX_BAND2_PACKETS,
+    MNET_STAT_TX_BAND2_BYTES,
+    MNET_STAT_TX_BAND3_PACKETS,
+    MNET_STAT_TX_BAND3_BYTES,
+    MNET_STAT_NUM,
+};
+
+struct mnet_pcpu_stats {
+    u64_stats_t cnt[MNET_STAT_NUM];
+    struct u64_stats_sync syncp;
+    u32 sample_seq;             // mirror sampling, only touched by this CPU
+};
+
+extern const char mnet_stat_names[MNET_STAT_NUM][ETH_GSTRING_LEN];
+
+/* -------------------- skb->cb while queued in mnet -------------------- */
+struct mnet_skb_cb {
+    u32 enqueue_time;           // codel_time_t
+};
+
+#define MNET_SKB_CB(skb) ((struct mnet_skb_cb *)(skb)->cb)
+
+/* -------------------- Lower ports -------------------- */
+#define MNET_LOWER_BUS_LEN  32      // ethtool bus-info
+#define MNET_LOWER_SPEC_LEN 48
+
+struct mnet_lower_slot;
+
+struct mnet_port {
+    struct list_head list;      // priv->ports, RCU protected
+    struct net_device *dev;     // lower device (eth0, ...)
+    struct net_device *mnet;    // owning mnet device
+    struct mnet_lower_slot *slot;
+    bool tx_swts;               // lower driver does its own SW TX stamps
+    unsigned int old_mtu;       // RTNL, mnet_change_mtu() rollback
+};
+
+/*
+ * One entry of the 'lower' list: "NAME", "mac=ADDR" or "bus=BUS-INFO".
+ * It outlives its port. When the device is unregistered the slot waits
+ * for one with the same name, permanent MAC or bus-info and attaches it.
+ */
+struct mnet_lower_slot {
+    struct list_head list;      // priv->lower_slots, RTNL
+    char spec[MNET_LOWER_SPEC_LEN];     // the entry as written
+    char name[IFNAMSIZ];        // "" unless given by name
+    u8 addr[ETH_ALEN];          // zero: unknown
+    char bus[MNET_LOWER_BUS_LEN];       // "": unknown
+    struct mnet_port *port;     // NULL while the device is away
+    unsigned long detached;     // jiffies
+};
+
+/* -------------------- Forwarding database -------------------- */
+#define MNET_FDB_HASH_BITS  8
+#define MNET_FDB_HASH_SIZE  (1 << MNET_FDB_HASH_BITS)
+#define MNET_FDB_MAX        4096
+
+struct mnet_fdb_entry {
+    struct hlist_node hlist;
+    struct mnet_port *port;     // port the address was last seen on
+    unsigned long updated;      // jiffies of last RX from this address
+    unsigned char addr[ETH_ALEN];
+    u16 vid;
+    struct rcu_head rcu;
+};
+
+/* -------------------- Flow offload -------------------- */
+#define MNET_FLOW_HASH_BITS 10
+#define MNET_FLOW_HASH_SIZE (1 << MNET_FLOW_HASH_BITS)
+#define MNET_FLOW_MAX       8192
+
+struct mnet_flow_key {
+    __be32 saddr;
+    __be32 daddr;
+    __be16 sport;
+    __be16 dport;
+    u8 proto;
+    u8 pad[3];
+};
+
+struct mnet_flow {
+    struct hlist_node hlist;
+    struct mnet_flow_key key;
+    struct mnet_port *port;     // lower device the flow leaves through
+    unsigned int mtu;
+    unsigned long created;
+    unsigned long used;
+    u8 l2hdr[ETH_HLEN];         // next-hop MAC, our MAC, ETH_P_IP
+    struct rcu_head rcu;
+};
+
+/* -------------------- Top talkers -------------------- */
+#define MNET_TOP_SETS       64      // per CPU
+#define MNET_TOP_WAYS       4
+
+struct mnet_top;
+
+/* -------------------- Sketches -------------------- */
+#define MNET_HLL_BITS       10
+#define MNET_HLL_REGS       (1 << MNET_HLL_BITS)
+#define MNET_HLL_ALPHA      47221   // 0.7213 / (1 + 1.079 / 1024), 16.16
+#define MNET_CMS_DEPTH      4
+#define MNET_CMS_WIDTH      128
+#define MNET_CMS_PREFIX     24      // count-min key: source /24
+#define MNET_SKETCH_EPOCH_MAX   86400
+
+struct mnet_sketch;
+
+/* -------------------- Traffic profile -------------------- */
+struct mnet_profile;
+
+/* -------------------- Encapsulated mirror -------------------- */
+struct mnet_encap;
+
+/* -------------------- Traffic generator -------------------- */
+struct mnet_bench;
+
+/* -------------------- Batched lower TX -------------------- */
+#define MNET_XMIT_HIST_BUCKETS  7       // batch sizes 1, 2, 3-4, ... 33-64
+
+struct mnet_xmit_batch;
+
+/* -------------------- TX scheduler -------------------- */
+#define MNET_NUM_BANDS      4       // TX queues of mnet0, band 0 first
+#define MNET_FQ_FLOWS       256     // per band
+#define MNET_FQ_FLOW_LIMIT  256
+#define MNET_FQ_STAGE_MAX   65536   // per CPU, ethtool tx ring size
+#define MNET_FQ_COAL_USECS_MAX  10000
+
+struct mnet_fq;
+
+struct mnet_priv {
+    struct net_device *dev;
+    struct mnet_pcpu_stats __percpu *pcpu_stats;
+    spinlock_t lock;
+    struct napi_struct napi;
+
+    struct mnet_config __rcu *cfg;  // see mnet_config.c
+    struct list_head ports;     // lower devices, eth0 first
+    unsigned int num_ports;
+    struct list_head lower_slots;   // RTNL, see mnet_set_lower()
+    bool mtu_sync;              // mnet_change_mtu() is updating the ports
+
+    struct hlist_head fdb_hash[MNET_FDB_HASH_SIZE];
+    spinlock_t fdb_lock;        // serialises FDB writers, readers use RCU
+    atomic_t fdb_count;
+    u32 fdb_salt;
+    unsigned long ageing_time;  // jiffies
+    struct delayed_work fdb_gc_work;
+
+    struct hlist_head flow_hash[MNET_FLOW_HASH_SIZE];
+    spinlock_t flow_lock;
+    atomic_t flow_count;
+    u32 flow_salt;
+    unsigned long flow_timeout; // jiffies
+    struct delayed_work flow_gc_work;
+
+    struct mnet_fq *fq;         // NULL unless the fq scheduler is enabled
+
+    struct mnet_top __percpu *top;
+    u32 top_salt;
+
+    struct mnet_sketch __percpu *sketch;
+    u32 sketch_salt;
+    __be32 sketch_query;        // prefix reported by debugfs 'sketch'
+
+    struct mnet_encap *encap;
+
+    struct mnet_xmit_batch __percpu *xmit;
+
+    struct page_pool * __percpu *rx_pool;   // copy-break buffers
+
+    struct mnet_profile __percpu *profile;
+
+    struct mnet_bench *bench;   // NULL without debugfs
+
+    u8 dscp_map[64];            // DSCP -> band
+    u8 pcp_map[8];              // 802.1p -> band
+    bool prio_strict;
+    u32 prio_weight[MNET_NUM_BANDS];
+
+    u64 event_threshold[MNET_STAT_NUM];     // per second, 0: no event
+    u64 event_last[MNET_STAT_NUM];
+    DECLARE_BITMAP(event_over, MNET_STAT_NUM);
+    struct delayed_work event_work;
+};
+
+/* Counter updates on one CPU's block, the caller owns @s */
+static inline void __mnet_stats_add(struct mnet_pcpu_stats *s,
+                                    enum mnet_stat idx, u64 val)
+{
+    u64_stats_update_begin(&s->syncp);
+    u64_stats_add(&s->cnt[idx], val);
+    u64_stats_update_end(&s->syncp);
+}
+
+/* Packet and byte counters are adjacent in enum mnet_stat */
+static inline void __mnet_stats_pkt(struct mnet_pcpu_stats *s,
+                                    enum mnet_stat idx, unsigned int len)
+{
+    u64_stats_update_begin(&s->syncp);
+    u64_stats_inc(&s->cnt[idx]);
+    u64_stats_add(&s->cnt[idx + 1], len);
+    u64_stats_update_end(&s->syncp);
+}
+
+static inline void mnet_stats_add(struct mnet_priv *priv, enum mnet_stat idx,
+                                  u64 val)
+{
+    __mnet_stats_add(this_cpu_ptr(priv->pcpu_stats), idx, val);
+}
+
+static inline void mnet_stats_inc(struct mnet_priv *priv, enum mnet_stat idx)
+{
+    mnet_stats_add(priv, idx, 1);
+}
+
+static inline void mnet_stats_pkt(struct mnet_priv *priv, enum mnet_stat idx,
+                                  unsigned int len)
+{
+    __mnet_stats_pkt(this_cpu_ptr(priv->pcpu_stats), idx, len);
+}
+
+/*
+ * Mirror filters: VLAN membership, then 1-in-sample_rate sampling on the
+ * sequence in @s. Returns the counter to bump when the frame is filtered
+ * out, MNET_STAT_NUM when it is to be mirrored.
+ */
+static inline enum mnet_stat mnet_mirror_filter(const struct mnet_config *cfg,
+                                                struct mnet_pcpu_stats *s,
+                                                u16 vid)
+{
+    if (!static_branch_unlikely(&mnet_key_mirror_filter))
+        return MNET_STAT_NUM;
+    if (!test_bit(vid, cfg->vlan_mirror))
+        return MNET_STAT_VLAN_FILTERED;
+    if (cfg->sample_rate > 1 && ++s->sample_seq % cfg->sample_rate)
+        return MNET_STAT_SAMPLE_SKIPPED;
+    return MNET_STAT_NUM;
+}
+
+/*
+ * VLAN ID used as part of the FDB key. On RX the core has already moved the
+ * tag into skb->vlan_tci; on TX it may still be in-band.
+ */
+static inline u16 mnet_skb_vid(const struct sk_buff *skb)
+{
+    const struct vlan_ethhdr *veth;
+
+    if (skb_vlan_tag_present(skb))
+        return skb_vlan_tag_get_id(skb);
+
+    veth = (const struct vlan_ethhdr *)skb_mac_header(skb);
+    if (skb_tail_pointer(skb) - (unsigned char *)veth >= VLAN_ETH_HLEN &&
+        eth_type_vlan(veth->h_vlan_proto))
+        return ntohs(veth->h_vlan_TCI) & VLAN_VID_MASK;
+    return 0;
+}
+
+/* mnet_main.c */
+rx_handler_result_t mnet_rx_handler(struct sk_buff **pskb);
+void mnet_forward_tx(struct mnet_priv *priv, struct sk_buff *skb);
+void mnet_stats_fold(struct mnet_priv *priv, u64 *out);
+void mnet_stats_read_cpu(struct mnet_priv *priv, int cpu, u64 *out);
+u64 mnet_stats_read(struct mnet_priv *priv, enum mnet_stat idx);
+int mnet_set_lower(struct mnet_priv *priv, const char *names);
+ssize_t mnet_lower_print(struct mnet_priv *priv, char *buf);
+
+/* mnet_config.c */
+int mnet_config_init(struct mnet_priv *priv, enum mnet_mode mode,
+                     bool flow_offload, u32 snaplen, u32 sample_rate);
+void mnet_config_fini(struct mnet_priv *priv);
+int mnet_mode_parse(const char *str);
+struct mnet_config *mnet_config_dup(struct mnet_priv *priv);
+int mnet_config_commit(struct mnet_priv *priv, struct mnet_config *cfg);
+void mnet_stage_keys_force(struct mnet_priv *priv, bool force);
+int mnet_stage_keys_show(struct seq_file *m, void *v);
+
+/* mnet_fdb.c */
+int mnet_fdb_cache_init(void);
+void mnet_fdb_cache_fini(void);
+void mnet_fdb_init(struct mnet_priv *priv);
+void mnet_fdb_fini(struct mnet_priv *priv);
+struct mnet_fdb_entry *mnet_fdb_find_rcu(struct mnet_priv *priv,
+                                         const unsigned char *addr, u16 vid);
+void mnet_fdb_learn(struct mnet_priv *priv, struct mnet_port *port,
+                    const unsigned char *addr, u16 vid);
+void mnet_fdb_delete_by_port(struct mnet_priv *priv, struct mnet_port *port);
+void mnet_fdb_flush(struct mnet_priv *priv);
+int mnet_fdb_show(struct seq_file *m, void *v);
+
+/* mnet_flow.c */
+int mnet_flow_cache_init(void);
+void mnet_flow_cache_fini(void);
+void mnet_flow_init(struct mnet_priv *priv);
+void mnet_flow_fini(struct mnet_priv *priv);
+bool mnet_flow_rx(struct mnet_priv *priv, struct sk_buff **pskb);
+bool mnet_flow_key_peek(const struct sk_buff *skb, struct mnet_flow_key *key);
+void mnet_flow_learn(struct mnet_priv *priv, struct sk_buff *skb,
+                     struct mnet_port *port);
+void mnet_flow_delete_by_port(struct mnet_priv *priv, struct mnet_port *port);
+int mnet_flow_show(struct seq_file *m, void *v);
+
+/* mnet_top.c */
+extern const struct file_operations mnet_top_fops;
+int mnet_top_init(struct mnet_priv *priv);
+void mnet_top_fini(struct mnet_priv *priv);
+void mnet_top_update(struct mnet_priv *priv, const struct mnet_flow_key *key,
+                     unsigned int len);
+void mnet_top_reset(struct mnet_priv *priv);
+
+/* mnet_sketch.c */
+extern const struct file_operations mnet_sketch_fops;
+int mnet_sketch_init(struct mnet_priv *priv);
+void mnet_sketch_fini(struct mnet_priv *priv);
+void mnet_sketch_update(struct mnet_priv *priv, const struct mnet_config *cfg,
+                        __be32 saddr, unsigned int len);
+
+/* mnet_profile.c */
+int mnet_profile_init(struct mnet_priv *priv);
+void mnet_profile_fini(struct mnet_priv *priv);
+void mnet_profile_rx(struct mnet_priv *priv, const struct sk_buff *skb);
+void mnet_profile_tx(struct mnet_priv *priv, const struct sk_buff *skb);
+int mnet_profile_show(struct seq_file *m, void *v);
+
+/* mnet_encap.c */
+int mnet_encap_init(struct mnet_priv *priv);
+void mnet_encap_fini(struct mnet_priv *priv);
+void mnet_encap_rebuild(struct mnet_priv *priv);
+void mnet_encap_rx(struct mnet_priv *priv, const struct mnet_config *cfg,
+                   struct sk_buff *skb);
+void mnet_encap_netdev_event(struct mnet_priv *priv, struct net_device *dev,
+                             unsigned long event);
+int mnet_encap_parse(struct mnet_config *cfg, const char *buf);
+ssize_t mnet_encap_print(const struct mnet_config *cfg, char *buf);
+
+/* mnet_xmit.c */
+int mnet_xmit_init(struct mnet_priv *priv);
+void mnet_xmit_fini(struct mnet_priv *priv);
+void mnet_xmit_batched(struct mnet_priv *priv, struct sk_buff *skb,
+                       bool direct);
+void mnet_xmit_flush(struct mnet_priv *priv);
+void mnet_xmit_hist_read(struct mnet_priv *priv, u64 *hist);
+int mnet_xmit_show(struct seq_file *m, void *v);
+
+/* mnet_rxcopy.c */
+int mnet_rxcopy_init(struct mnet_priv *priv);
+void mnet_rxcopy_fini(struct mnet_priv *priv);
+struct sk_buff *mnet_rx_dup(struct mnet_priv *priv,
+                            const struct mnet_config *cfg,
+                            struct sk_buff *skb, u32 snaplen);
+int mnet_rxcopy_show(struct seq_file *m, void *v);
+
+/* mnet_bench.c */
+void mnet_bench_init(struct mnet_priv *priv, struct dentry *parent);
+void mnet_bench_fini(struct mnet_priv *priv);
+
+/* mnet_sched.c */
+int mnet_fq_init(struct mnet_priv *priv, u32 limit, u32 target_us,
+                 u32 interval_us);
+void mnet_fq_fini(struct mnet_priv *priv);
+void mnet_fq_xmit(struct mnet_priv *priv, struct sk_buff *skb);
+int mnet_fq_poll(struct napi_struct *napi, int budget);
+void mnet_fq_purge(struct mnet_priv *priv);
+void mnet_fq_set_mtu(struct mnet_priv *priv);
+u32 mnet_fq_band_qlen(struct mnet_priv *priv, int band);
+u32 mnet_fq_stage_limit(struct mnet_priv *priv);
+int mnet_fq_set_stage_limit(struct mnet_priv *priv, u32 limit);
+void mnet_fq_get_coalesce(struct mnet_priv *priv, u32 *usecs, u32 *frames);
+int mnet_fq_set_coalesce(struct mnet_priv *priv, u32 usecs, u32 frames);
+int mnet_fq_show(struct seq_file *m, void *v);
+
+/* mnet_prio.c */
+extern const struct file_operations mnet_prio_fops;
+void mnet_prio_init(struct mnet_priv *priv, bool strict, const u32 *weight);
+u8 mnet_prio_classify(struct mnet_priv *priv, struct sk_buff *skb);
+u16 mnet_select_queue(struct net_device *dev, struct sk_buff *skb,
+                      struct net_device *sb_dev);
+void mnet_prio_tx(struct mnet_priv *priv, struct sk_buff *skb);
+int mnet_prio_parse(struct mnet_priv *priv, const char *cmd);
+int mnet_prio_show(struct seq_file *m, void *v);
+
+/* mnet_vlan.c */
+extern const struct file_operations mnet_vlan_filter_fops;
+void mnet_vlan_setup(struct net_device *dev);
+int mnet_vlan_rx_add_vid(struct net_device *dev, __be16 proto, u16 vid);
+int mnet_vlan_rx_kill_vid(struct net_device *dev, __be16 proto, u16 vid);
+int mnet_vlan_port_add(struct mnet_priv *priv, struct mnet_port *port);
+void mnet_vlan_port_del(struct mnet_priv *priv, struct mnet_port *port);
+int mnet_vlan_filter_parse(unsigned long *map, const char *cmd);
+ssize_t mnet_vlan_filter_print(const unsigned long *map, char *buf,
+                               size_t size);
+
+/* mnet_genl.c */
+int mnet_genl_init(struct mnet_priv *priv);
+void mnet_genl_fini(struct mnet_priv *priv);
+void mnet_genl_notify_lower(struct mnet_priv *priv, struct net_device *lower,
+                            enum mnet_lower_state state);
+
+/* mnet_ethtool.c */
+extern const struct ethtool_ops mnet_ethtool_ops;
+bool mnet_lower_tx_swts(struct net_device *lower);
+
+#endif /* _MNET_H */
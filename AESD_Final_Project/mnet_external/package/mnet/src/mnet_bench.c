@@ -0,0 +1,665 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/ip.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/rtnetlink.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <linux/udp.h>
+#include <linux/uaccess.h>
+#include <net/ip.h>
+
+#include "mnet.h"
+
+/*
+ * Built-in traffic generator, in the spirit of pktgen.
+ *
+ * debugfs mnet/bench/ holds the parameters (mode, size, flows, rate,
+ * threads, count). Writing "start" to 'run' starts one kthread per CPU,
+ * up to 'threads', each building IPv4/UDP frames and injecting them:
+ *  rx      into mnet_rx_handler() as if received on the first lower port;
+ *  tx      into mnet_start_xmit() of mnet0, one frame per call, so with
+ *          direct_xmit the cycles are the handoff latency to the driver.
+ * The other modes time one hot-path step in isolation, on one prebuilt
+ * frame and the bench's own counters:
+ *  clone   skb_clone() and free, as the mirror does per frame above
+ *          copybreak (rx mode covers the copy);
+ *  filter  the mirror VLAN filter and sampling, VID = flow % 4096; only
+ *          its static key test while neither is set, see 'stage_keys';
+ *  stats   a per-CPU packet/byte counter update.
+ * 'result' shows per thread and total packets/s, bytes/s, wall ns per
+ * packet and the cycles spent inside mnet (or the step) per packet, which
+ * excludes building the frame. Cycles are get_cycles() units: the TSC on
+ * x86, the architected timer on arm64.
+ *
+ * 'stage_keys' lists the static keys of the optional stages. Writing
+ * "forced" turns them all on, leaving each stage to its config test as
+ * before the keys, so rx and tx with every stage off can be timed with
+ * and without the keys; "auto" makes them follow the config again.
+ *
+ * Frames come from 198.18.0.0/15 (RFC 2544), one source address per flow,
+ * and are addressed to a locally administered MAC nobody owns.
+ */
+
+#define MNET_BENCH_SIZE_MAX     9018
+#define MNET_BENCH_FLOWS_MAX    65536
+#define MNET_BENCH_SRC_NET      0xc6120000      // 198.18.0.0
+#define MNET_BENCH_DST_ADDR     0xc6130001      // 198.19.0.1
+#define MNET_BENCH_PORT         9               // discard
+
+static const u8 mnet_bench_dst[ETH_ALEN] = { 0x02, 0x6d, 0x6e, 0x65, 0x74, 0x01 };
+static const u8 mnet_bench_src[ETH_ALEN] = { 0x02, 0x6d, 0x6e, 0x65, 0x74, 0x02 };
+
+struct mnet_bench_thread;
+
+struct mnet_bench_mode {
+    const char *name;
+    /* Inject one frame of @flow; false stops the thread */
+    bool (*inject)(struct mnet_bench_thread *t, u32 flow);
+};
+
+struct mnet_bench_thread {
+    struct task_struct *task;
+    struct mnet_priv *priv;
+    const struct mnet_bench_mode *mode;
+    struct mnet_pcpu_stats __percpu *stats;
+    struct sk_buff *skb;        // prebuilt frame of the clone mode
+    int cpu;
+    u32 size;
+    u32 flows;
+    u64 count;                  // packets to send, 0: until stopped
+    u64 interval;               // ns between packets, 0: flat out
+    /* Written by the thread, read by 'result' */
+    u64 packets;
+    u64 bytes;
+    u64 cycles;                 // inside mnet only
+    u64 errors;
+    u64 start_ns;
+    u64 end_ns;
+    bool done;
+};
+
+struct mnet_bench {
+    struct mnet_priv *priv;
+    struct mutex lock;          // run state, thr
+    u32 mode;                   // index in mnet_bench_modes
+    u32 size;                   // frame length, no FCS
+    u32 flows;
+    u32 rate;                   // packets/s over all threads, 0: flat out
+    u32 threads;
+    u64 count;                  // per thread
+    struct mnet_pcpu_stats __percpu *stats;     // for the stats mode
+    struct mnet_bench_thread *thr;
+    unsigned int nthr;
+};
+
+/* -------------------- Frames -------------------- */
+static struct sk_buff *mnet_bench_skb(const struct mnet_bench_thread *t,
+                                      u32 flow)
+{
+    struct sk_buff *skb;
+    struct ethhdr *eth;
+    struct udphdr *uh;
+    struct iphdr *iph;
+
+    skb = alloc_skb(NET_IP_ALIGN + t->size, GFP_KERNEL);
+    if (!skb)
+        return NULL;
+    skb_reserve(skb, NET_IP_ALIGN);
+
+    eth = skb_put(skb, t->size);
+    ether_addr_copy(eth->h_dest, mnet_bench_dst);
+    ether_addr_copy(eth->h_source, mnet_bench_src);
+    eth->h_proto = htons(ETH_P_IP);
+
+    iph = (struct iphdr *)(eth + 1);
+    memset(iph, 0, sizeof(*iph) + sizeof(*uh));
+    iph->version = 4;
+    iph->ihl = sizeof(*iph) >> 2;
+    iph->tot_len = htons(t->size - ETH_HLEN);
+    iph->ttl = 64;
+    iph->protocol = IPPROTO_UDP;
+    iph->saddr = htonl(MNET_BENCH_SRC_NET + flow);
+    iph->daddr = htonl(MNET_BENCH_DST_ADDR);
+    ip_send_check(iph);
+
+    uh = (struct udphdr *)(iph + 1);
+    uh->source = htons(MNET_BENCH_PORT);
+    uh->dest = htons(MNET_BENCH_PORT);
+    uh->len = htons(t->size - ETH_HLEN - sizeof(*iph));
+
+    skb_reset_mac_header(skb);
+    skb_set_network_header(skb, ETH_HLEN);
+    skb_set_transport_header(skb, ETH_HLEN + sizeof(*iph));
+    return skb;
+}
+
+/* -------------------- Modes -------------------- */
+static bool mnet_bench_rx(struct mnet_bench_thread *t, u32 flow)
+{
+    rx_handler_result_t res;
+    struct mnet_port *port;
+    struct sk_buff *skb;
+    cycles_t start;
+
+    skb = mnet_bench_skb(t, flow);
+    if (!skb) {
+        t->errors++;
+        return true;
+    }
+
+    /* What __netif_receive_skb_core() provides to an rx_handler */
+    local_bh_disable();
+    rcu_read_lock();
+    port = list_first_or_null_rcu(&t->priv->ports, struct mnet_port, list);
+    if (!port) {
+        rcu_read_unlock();
+        local_bh_enable();
+        kfree_skb(skb);
+        return false;
+    }
+    skb->protocol = eth_type_trans(skb, port->dev);
+    skb_reset_mac_len(skb);
+
+    start = get_cycles();
+    res = mnet_rx_handler(&skb);
+    t->cycles += get_cycles() - start;
+
+    /* The frame would go on to the lower device's stack, not ours */
+    if (res == RX_HANDLER_PASS)
+        consume_skb(skb);
+    rcu_read_unlock();
+    local_bh_enable();
+
+    t->packets++;
+    t->bytes += t->size;
+    return true;
+}
+
+static bool mnet_bench_tx(struct mnet_bench_thread *t, u32 flow)
+{
+    struct net_device *dev = t->priv->dev;
+    struct netdev_queue *txq;
+    struct sk_buff *skb;
+    netdev_tx_t ret;
+    cycles_t start;
+    u16 queue;
+
+    skb = mnet_bench_skb(t, flow);
+    if (!skb) {
+        t->errors++;
+        return true;
+    }
+    skb->dev = dev;
+    skb->protocol = htons(ETH_P_IP);
+
+    /* What dev_queue_xmit() provides to a queueless LLTX device */
+    rcu_read_lock_bh();
+    queue = mnet_select_queue(dev, skb, NULL);
+    skb_set_queue_mapping(skb, queue);
+    txq = netdev_get_tx_queue(dev, queue);
+
+    start = get_cycles();
+    ret = netdev_start_xmit(skb, dev, txq, false);
+    t->cycles += get_cycles() - start;
+    rcu_read_unlock_bh();
+
+    if (!dev_xmit_complete(ret)) {
+        kfree_skb(skb);
+        t->errors++;
+        return true;
+    }
+
+    t->packets++;
+    t->bytes += t->size;
+    return true;
+}
+
+static bool mnet_bench_clone(struct mnet_bench_thread *t, u32 flow)
+{
+    struct sk_buff *clone;
+    cycles_t start;
+
+    if (!t->skb) {
+        t->skb = mnet_bench_skb(t, flow);
+        if (!t->skb)
+            return false;
+    }
+
+    local_bh_disable();
+    start = get_cycles();
+    clone = skb_clone(t->skb, GFP_ATOMIC);
+    if (clone)
+        consume_skb(clone);
+    t->cycles += get_cycles() - start;
+    local_bh_enable();
+
+    if (!clone) {
+        t->errors++;
+        return true;
+    }
+    t->packets++;
+    t->bytes += t->size;
+    return true;
+}
+
+static bool mnet_bench_filter(struct mnet_bench_thread *t, u32 flow)
+{
+    struct mnet_pcpu_stats *s;
+    enum mnet_stat why;
+    cycles_t start;
+
+    local_bh_disable();
+    rcu_read_lock();
+    s = this_cpu_ptr(t->stats);
+    start = get_cycles();
+    why = mnet_mirror_filter(rcu_dereference(t->priv->cfg), s,
+                             flow % VLAN_N_VID);
+    if (why != MNET_STAT_NUM)
+        __mnet_stats_add(s, why, 1);
+    t->cycles += get_cycles() - start;
+    rcu_read_unlock();
+    local_bh_enable();
+
+    t->packets++;
+    t->bytes += t->size;
+    return true;
+}
+
+static bool mnet_bench_stats(struct mnet_bench_thread *t, u32 flow)
+{
+    cycles_t start;
+
+    local_bh_disable();
+    start = get_cycles();
+    __mnet_stats_pkt(this_cpu_ptr(t->stats), MNET_STAT_RX_PACKETS, t->size);
+    t->cycles += get_cycles() - start;
+    local_bh_enable();
+
+    t->packets++;
+    t->bytes += t->size;
+    return true;
+}
+
+static const struct mnet_bench_mode mnet_bench_modes[] = {
+    { "rx",     mnet_bench_rx },
+    { "tx",     mnet_bench_tx },
+    { "clone",  mnet_bench_clone },
+    { "filter", mnet_bench_filter },
+    { "stats",  mnet_bench_stats },
+};
+
+/* -------------------- Threads -------------------- */
+static int mnet_bench_thread_fn(void *arg)
+{
+    struct mnet_bench_thread *t = arg;
+    u32 flow = t->cpu % t->flows;
+    u64 next, now;
+    u32 wait_us;
+
+    t->start_ns = ktime_get_ns();
+    next = t->start_ns;
+
+    while (!kthread_should_stop() && (!t->count || t->packets < t->count)) {
+        if (t->interval) {
+            now = ktime_get_ns();
+            if (now < next) {
+                wait_us = div_u64(next - now, NSEC_PER_USEC);
+                if (wait_us > 100)
+                    usleep_range(wait_us - 50, wait_us);
+                else
+                    cpu_relax();
+                continue;
+            }
+            next += t->interval;
+        }
+
+        if (!t->mode->inject(t, flow))
+            break;
+        if (++flow == t->flows)
+            flow = 0;
+        cond_resched();
+    }
+
+    WRITE_ONCE(t->end_ns, ktime_get_ns());
+    WRITE_ONCE(t->done, true);
+    kfree_skb(t->skb);
+    t->skb = NULL;
+
+    /* Results stay readable until the next start or module unload */
+    set_current_state(TASK_INTERRUPTIBLE);
+    while (!kthread_should_stop()) {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+static void mnet_bench_stop(struct mnet_bench *b)
+{
+    unsigned int i;
+
+    lockdep_assert_held(&b->lock);
+
+    for (i = 0; i < b->nthr; i++) {
+        if (b->thr[i].task) {
+            kthread_stop(b->thr[i].task);
+            b->thr[i].task = NULL;
+        }
+    }
+}
+
+static int mnet_bench_start(struct mnet_bench *b)
+{
+    struct mnet_bench_thread *thr, *t;
+    unsigned int n = 0, want;
+    int cpu, ret = 0;
+
+    lockdep_assert_held(&b->lock);
+
+    if (b->size < ETH_ZLEN || b->size > MNET_BENCH_SIZE_MAX ||
+        !b->flows || b->flows > MNET_BENCH_FLOWS_MAX || !b->threads)
+        return -EINVAL;
+
+    mnet_bench_stop(b);
+
+    cpus_read_lock();
+    want = min(b->threads, num_online_cpus());
+    thr = kcalloc(want, sizeof(*thr), GFP_KERNEL);
+    if (!thr) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    kfree(b->thr);
+    b->thr = thr;
+    b->nthr = 0;
+
+    for_each_online_cpu(cpu) {
+        if (n == want)
+            break;
+        t = &thr[n];
+        t->priv = b->priv;
+        t->mode = &mnet_bench_modes[b->mode];
+        t->stats = b->stats;
+        t->cpu = cpu;
+        t->size = b->size;
+        t->flows = b->flows;
+        t->count = b->count;
+        if (b->rate)
+            t->interval = div_u64((u64)NSEC_PER_SEC * want, b->rate);
+
+        t->task = kthread_create_on_node(mnet_bench_thread_fn, t,
+                                         cpu_to_node(cpu), "mnet_bench/%d",
+                                         cpu);
+        if (IS_ERR(t->task)) {
+            ret = PTR_ERR(t->task);
+            t->task = NULL;
+            mnet_bench_stop(b);
+            goto out;
+        }
+        kthread_bind(t->task, cpu);
+        b->nthr = ++n;
+    }
+
+    for (n = 0; n < b->nthr; n++)
+        wake_up_process(thr[n].task);
+out:
+    cpus_read_unlock();
+    return ret;
+}
+
+/* -------------------- debugfs -------------------- */
+static int mnet_bench_result_show(struct seq_file *m, void *v)
+{
+    struct mnet_bench *b = m->private;
+    u64 packets, bytes, cycles, ns, pps, bps;
+    u64 tot_pps = 0, tot_bps = 0, tot_packets = 0, tot_cycles = 0;
+    u64 tot_ns = 0;
+    const struct mnet_bench_thread *t;
+    unsigned int i;
+
+    mutex_lock(&b->lock);
+    seq_puts(m, "cpu   packets        pps          bytes/s        ns/pkt   cycles/pkt errors\n");
+    for (i = 0; i < b->nthr; i++) {
+        t = &b->thr[i];
+        packets = READ_ONCE(t->packets);
+        bytes = READ_ONCE(t->bytes);
+        cycles = READ_ONCE(t->cycles);
+        ns = (READ_ONCE(t->done) ? READ_ONCE(t->end_ns) : ktime_get_ns()) -
+             READ_ONCE(t->start_ns);
+
+        pps = ns ? mul_u64_u64_div_u64(packets, NSEC_PER_SEC, ns) : 0;
+        bps = ns ? mul_u64_u64_div_u64(bytes, NSEC_PER_SEC, ns) : 0;
+        seq_printf(m, "%-5d %-14llu %-12llu %-14llu %-8llu %-10llu %llu\n",
+                   t->cpu, packets, pps, bps,
+                   packets ? div64_u64(ns, packets) : 0,
+                   packets ? div64_u64(cycles, packets) : 0,
+                   READ_ONCE(t->errors));
+
+        tot_pps += pps;
+        tot_bps += bps;
+        tot_packets += packets;
+        tot_cycles += cycles;
+        tot_ns += ns;
+    }
+    /* ns/pkt of the total is the per-thread average, not 1 / pps */
+    seq_printf(m, "total %-14llu %-12llu %-14llu %-8llu %llu\n", tot_packets,
+               tot_pps, tot_bps,
+               tot_packets ? div64_u64(tot_ns, tot_packets) : 0,
+               tot_packets ? div64_u64(tot_cycles, tot_packets) : 0);
+    mutex_unlock(&b->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mnet_bench_result);
+
+static int mnet_bench_run_show(struct seq_file *m, void *v)
+{
+    struct mnet_bench *b = m->private;
+    unsigned int i, running = 0;
+
+    mutex_lock(&b->lock);
+    for (i = 0; i < b->nthr; i++)
+        running += b->thr[i].task && !READ_ONCE(b->thr[i].done);
+    mutex_unlock(&b->lock);
+
+    seq_printf(m, "%s\n", running ? "running" : "idle");
+    return 0;
+}
+
+static int mnet_bench_run_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_bench_run_show, inode->i_private);
+}
+
+/* "start" or "stop" */
+static ssize_t mnet_bench_run_write(struct file *file, const char __user *ubuf,
+                                    size_t count, loff_t *ppos)
+{
+    struct mnet_bench *b = ((struct seq_file *)file->private_data)->private;
+    char buf[8];
+    int ret = 0;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    mutex_lock(&b->lock);
+    if (sysfs_streq(buf, "start"))
+        ret = mnet_bench_start(b);
+    else if (sysfs_streq(buf, "stop"))
+        mnet_bench_stop(b);
+    else
+        ret = -EINVAL;
+    mutex_unlock(&b->lock);
+
+    return ret ? ret : count;
+}
+
+static const struct file_operations mnet_bench_run_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_bench_run_open,
+    .read    = seq_read,
+    .write   = mnet_bench_run_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static int mnet_bench_mode_show(struct seq_file *m, void *v)
+{
+    struct mnet_bench *b = m->private;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(mnet_bench_modes); i++)
+        seq_printf(m, i == READ_ONCE(b->mode) ? "%s[%s]" : "%s%s",
+                   i ? " " : "", mnet_bench_modes[i].name);
+    seq_putc(m, '\n');
+    return 0;
+}
+
+static int mnet_bench_mode_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_bench_mode_show, inode->i_private);
+}
+
+static ssize_t mnet_bench_mode_write(struct file *file,
+                                     const char __user *ubuf,
+                                     size_t count, loff_t *ppos)
+{
+    struct mnet_bench *b = ((struct seq_file *)file->private_data)->private;
+    char buf[16];
+    unsigned int i;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    for (i = 0; i < ARRAY_SIZE(mnet_bench_modes); i++) {
+        if (sysfs_streq(buf, mnet_bench_modes[i].name)) {
+            WRITE_ONCE(b->mode, i);
+            return count;
+        }
+    }
+    return -EINVAL;
+}
+
+static const struct file_operations mnet_bench_mode_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_bench_mode_open,
+    .read    = seq_read,
+    .write   = mnet_bench_mode_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static int mnet_bench_keys_show(struct seq_file *m, void *v)
+{
+    return mnet_stage_keys_show(m, v);
+}
+
+static int mnet_bench_keys_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_bench_keys_show, inode->i_private);
+}
+
+/* "auto" or "forced" */
+static ssize_t mnet_bench_keys_write(struct file *file,
+                                     const char __user *ubuf,
+                                     size_t count, loff_t *ppos)
+{
+    struct mnet_bench *b = ((struct seq_file *)file->private_data)->private;
+    bool force;
+    char buf[8];
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    if (sysfs_streq(buf, "forced"))
+        force = true;
+    else if (sysfs_streq(buf, "auto"))
+        force = false;
+    else
+        return -EINVAL;
+
+    rtnl_lock();
+    mnet_stage_keys_force(b->priv, force);
+    rtnl_unlock();
+    return count;
+}
+
+static const struct file_operations mnet_bench_keys_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_bench_keys_open,
+    .read    = seq_read,
+    .write   = mnet_bench_keys_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/* -------------------- Init / Exit -------------------- */
+void mnet_bench_init(struct mnet_priv *priv, struct dentry *parent)
+{
+    struct mnet_bench *b;
+    struct dentry *dir;
+
+    b = kzalloc(sizeof(*b), GFP_KERNEL);
+    if (!b)
+        return;
+
+    b->stats = netdev_alloc_pcpu_stats(struct mnet_pcpu_stats);
+    if (!b->stats) {
+        kfree(b);
+        return;
+    }
+
+    b->priv = priv;
+    mutex_init(&b->lock);
+    b->size = ETH_ZLEN;
+    b->flows = 1;
+    b->threads = 1;
+    b->count = 10000000;
+
+    dir = debugfs_create_dir("bench", parent);
+    debugfs_create_file("mode", 0644, dir, b, &mnet_bench_mode_fops);
+    debugfs_create_u32("size", 0644, dir, &b->size);
+    debugfs_create_u32("flows", 0644, dir, &b->flows);
+    debugfs_create_u32("rate", 0644, dir, &b->rate);
+    debugfs_create_u32("threads", 0644, dir, &b->threads);
+    debugfs_create_u64("count", 0644, dir, &b->count);
+    debugfs_create_file("run", 0644, dir, b, &mnet_bench_run_fops);
+    debugfs_create_file("result", 0444, dir, b, &mnet_bench_result_fops);
+    debugfs_create_file("stage_keys", 0644, dir, b, &mnet_bench_keys_fops);
+
+    priv->bench = b;
+}
+
+/* Once the debugfs files are gone */
+void mnet_bench_fini(struct mnet_priv *priv)
+{
+    struct mnet_bench *b = priv->bench;
+
+    if (!b)
+        return;
+
+    mutex_lock(&b->lock);
+    mnet_bench_stop(b);
+    mutex_unlock(&b->lock);
+
+    free_percpu(b->stats);
+    kfree(b->thr);
+    kfree(b);
+    priv->bench = NULL;
+}
@@ -0,0 +1,566 @@
+#include <linux/kernel.h>
+#include <linux/bitmap.h>
+#include <linux/device.h>
+#include <linux/rtnetlink.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "mnet.h"
+
+/*
+ * Runtime configuration.
+ *
+ * Everything the datapath looks at that can change without reloading the
+ * module lives in one struct mnet_config. The rx_handler and TX take a
+ * single rcu_dereference() of priv->cfg per packet; writers build a new
+ * copy under RTNL and publish it with rcu_assign_pointer(), so a packet
+ * always sees one consistent config and none are dropped by the switch.
+ *
+ * The control interface is /sys/class/net/mnet0/mnet/.
+ *
+ * Each optional stage also has a static key, set to match a config right
+ * after it is published. The datapath tests the key, then the config: a
+ * packet racing a switch sees the stage as its own config says, and while
+ * the key is off nothing is tested at all.
+ */
+
+/* -------------------- Stage keys -------------------- */
+DEFINE_STATIC_KEY_FALSE(mnet_key_rx_tstamp);
+DEFINE_STATIC_KEY_FALSE(mnet_key_top_talkers);
+DEFINE_STATIC_KEY_FALSE(mnet_key_sketch);
+DEFINE_STATIC_KEY_FALSE(mnet_key_profile);
+DEFINE_STATIC_KEY_FALSE(mnet_key_flow_offload);
+DEFINE_STATIC_KEY_FALSE(mnet_key_mirror_filter);
+DEFINE_STATIC_KEY_FALSE(mnet_key_collector);
+
+static const struct {
+    const char *name;
+    struct static_key_false *key;
+} mnet_stage_keys[] = {
+    { "rx_tstamp",     &mnet_key_rx_tstamp },
+    { "top_talkers",   &mnet_key_top_talkers },
+    { "sketch",        &mnet_key_sketch },
+    { "profile",       &mnet_key_profile },
+    { "flow_offload",  &mnet_key_flow_offload },
+    { "mirror_filter", &mnet_key_mirror_filter },
+    { "collector",     &mnet_key_collector },
+};
+
+/* Every key on whatever the config, as before there were keys. RTNL */
+static bool mnet_stage_keys_forced;
+
+static void mnet_stage_key_set(struct static_key_false *key, bool on)
+{
+    if (on || mnet_stage_keys_forced)
+        static_branch_enable(key);
+    else
+        static_branch_disable(key);
+}
+
+/* Match the keys to @cfg, which is published; RTNL */
+static void mnet_stage_keys_update(const struct mnet_config *cfg)
+{
+    mnet_stage_key_set(&mnet_key_rx_tstamp, cfg->rx_tstamp);
+    mnet_stage_key_set(&mnet_key_top_talkers, cfg->top_talkers);
+    mnet_stage_key_set(&mnet_key_sketch, cfg->sketch);
+    mnet_stage_key_set(&mnet_key_profile, cfg->profile);
+    mnet_stage_key_set(&mnet_key_flow_offload, cfg->flow_offload);
+    mnet_stage_key_set(&mnet_key_mirror_filter,
+                       cfg->sample_rate > 1 ||
+                       !bitmap_full(cfg->vlan_mirror, VLAN_N_VID));
+    mnet_stage_key_set(&mnet_key_collector, cfg->collector_port);
+}
+
+/* For the bench: compare the keyed datapath with config tests alone */
+void mnet_stage_keys_force(struct mnet_priv *priv, bool force)
+{
+    ASSERT_RTNL();
+    mnet_stage_keys_forced = force;
+    mnet_stage_keys_update(rtnl_dereference(priv->cfg));
+}
+
+int mnet_stage_keys_show(struct seq_file *m, void *v)
+{
+    int i;
+
+    seq_printf(m, "%s\n", READ_ONCE(mnet_stage_keys_forced) ?
+               "forced" : "auto");
+    for (i = 0; i < ARRAY_SIZE(mnet_stage_keys); i++)
+        seq_printf(m, "%-16s %d\n", mnet_stage_keys[i].name,
+                   static_key_enabled(mnet_stage_keys[i].key));
+    return 0;
+}
+
+/* -------------------- Update -------------------- */
+int mnet_mode_parse(const char *str)
+{
+    if (sysfs_streq(str, "mirror"))
+        return MNET_MODE_MIRROR;
+    if (sysfs_streq(str, "bridge"))
+        return MNET_MODE_BRIDGE;
+    return -EINVAL;
+}
+
+/* Writable copy of the current config, to be passed to mnet_config_commit() */
+struct mnet_config *mnet_config_dup(struct mnet_priv *priv)
+{
+    ASSERT_RTNL();
+    return kmemdup(rtnl_dereference(priv->cfg), sizeof(struct mnet_config),
+                   GFP_KERNEL);
+}
+
+/*
+ * Publish @cfg, applying what a mode or offload change needs on the ports
+ * first. On error @cfg is freed and the old config stays in place.
+ */
+int mnet_config_commit(struct mnet_priv *priv, struct mnet_config *cfg)
+{
+    struct mnet_config *old = rtnl_dereference(priv->cfg);
+    struct mnet_port *port;
+    int inc, ret;
+
+    ASSERT_RTNL();
+
+    /* A bridge port has to see frames for every address behind it */
+    if (old->mode != cfg->mode) {
+        inc = cfg->mode == MNET_MODE_BRIDGE ? 1 : -1;
+        list_for_each_entry(port, &priv->ports, list) {
+            ret = dev_set_promiscuity(port->dev, inc);
+            if (ret)
+                goto unwind;
+        }
+    }
+
+    rcu_assign_pointer(priv->cfg, cfg);
+    mnet_stage_keys_update(cfg);
+
+    if (old->flow_offload && !cfg->flow_offload)
+        mnet_flow_delete_by_port(priv, NULL);
+
+    if (old->collector_addr != cfg->collector_addr ||
+        old->collector_port != cfg->collector_port ||
+        strcmp(old->collector_dev, cfg->collector_dev))
+        mnet_encap_rebuild(priv);
+
+    kfree_rcu(old, rcu);
+    return 0;
+
+unwind:
+    list_for_each_entry_continue_reverse(port, &priv->ports, list)
+        dev_set_promiscuity(port->dev, -inc);
+    kfree(cfg);
+    return ret;
+}
+
+/* -------------------- sysfs -------------------- */
+static inline struct mnet_priv *mnet_dev_priv(struct device *d)
+{
+    return netdev_priv(to_net_dev(d));
+}
+
+/* Copy, let @update modify and commit the config, all under RTNL */
+static ssize_t mnet_config_store(struct device *d, const char *buf,
+                                 size_t count,
+                                 int (*update)(struct mnet_config *cfg,
+                                               const char *buf))
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    struct mnet_config *cfg;
+    int ret;
+
+    /* Same as bonding: taking RTNL here can deadlock with unregister */
+    if (!rtnl_trylock())
+        return restart_syscall();
+
+    cfg = mnet_config_dup(priv);
+    if (!cfg) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    ret = update(cfg, buf);
+    if (ret)
+        kfree(cfg);
+    else
+        ret = mnet_config_commit(priv, cfg);
+out:
+    rtnl_unlock();
+    return ret ? ret : count;
+}
+
+static ssize_t mode_show(struct device *d, struct device_attribute *attr,
+                         char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    enum mnet_mode mode;
+
+    rcu_read_lock();
+    mode = rcu_dereference(priv->cfg)->mode;
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%s\n",
+                      mode == MNET_MODE_BRIDGE ? "bridge" : "mirror");
+}
+
+static int mnet_update_mode(struct mnet_config *cfg, const char *buf)
+{
+    int mode = mnet_mode_parse(buf);
+
+    if (mode < 0)
+        return mode;
+    cfg->mode = mode;
+    return 0;
+}
+
+static ssize_t mode_store(struct device *d, struct device_attribute *attr,
+                          const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_mode);
+}
+static DEVICE_ATTR_RW(mode);
+
+/* On/off switches of struct mnet_config */
+#define MNET_CONFIG_BOOL_ATTR(_name)                                        \
+static ssize_t _name##_show(struct device *d,                               \
+                            struct device_attribute *attr, char *buf)       \
+{                                                                           \
+    struct mnet_priv *priv = mnet_dev_priv(d);                              \
+    bool on;                                                                \
+                                                                            \
+    rcu_read_lock();                                                        \
+    on = rcu_dereference(priv->cfg)->_name;                                 \
+    rcu_read_unlock();                                                      \
+                                                                            \
+    return sysfs_emit(buf, "%d\n", on);                                     \
+}                                                                           \
+                                                                            \
+static int mnet_update_##_name(struct mnet_config *cfg, const char *buf)    \
+{                                                                           \
+    return kstrtobool(buf, &cfg->_name);                                    \
+}                                                                           \
+                                                                            \
+static ssize_t _name##_store(struct device *d,                              \
+                             struct device_attribute *attr,                 \
+                             const char *buf, size_t count)                 \
+{                                                                           \
+    return mnet_config_store(d, buf, count, mnet_update_##_name);           \
+}                                                                           \
+static DEVICE_ATTR_RW(_name)
+
+MNET_CONFIG_BOOL_ATTR(flow_offload);
+MNET_CONFIG_BOOL_ATTR(rx_tstamp);
+MNET_CONFIG_BOOL_ATTR(top_talkers);
+MNET_CONFIG_BOOL_ATTR(sketch);
+MNET_CONFIG_BOOL_ATTR(profile);
+MNET_CONFIG_BOOL_ATTR(direct_xmit);
+
+static ssize_t sketch_epoch_show(struct device *d,
+                                 struct device_attribute *attr, char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    u32 secs;
+
+    rcu_read_lock();
+    secs = rcu_dereference(priv->cfg)->sketch_epoch;
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%u\n", secs);
+}
+
+static int mnet_update_sketch_epoch(struct mnet_config *cfg, const char *buf)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val > MNET_SKETCH_EPOCH_MAX)
+        return -EINVAL;
+    cfg->sketch_epoch = val;
+    return 0;
+}
+
+static ssize_t sketch_epoch_store(struct device *d,
+                                  struct device_attribute *attr,
+                                  const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_sketch_epoch);
+}
+static DEVICE_ATTR_RW(sketch_epoch);
+
+static ssize_t snaplen_show(struct device *d, struct device_attribute *attr,
+                            char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    u32 snaplen;
+
+    rcu_read_lock();
+    snaplen = rcu_dereference(priv->cfg)->snaplen;
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%u\n", snaplen);
+}
+
+static int mnet_update_snaplen(struct mnet_config *cfg, const char *buf)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val && val < MNET_SNAPLEN_MIN)
+        return -EINVAL;
+    cfg->snaplen = val;
+    return 0;
+}
+
+static ssize_t snaplen_store(struct device *d, struct device_attribute *attr,
+                             const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_snaplen);
+}
+static DEVICE_ATTR_RW(snaplen);
+
+static ssize_t copybreak_show(struct device *d, struct device_attribute *attr,
+                              char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    u32 copybreak;
+
+    rcu_read_lock();
+    copybreak = rcu_dereference(priv->cfg)->copybreak;
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%u\n", copybreak);
+}
+
+static int mnet_update_copybreak(struct mnet_config *cfg, const char *buf)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val > MNET_COPYBREAK_MAX)
+        return -EINVAL;
+    cfg->copybreak = val;
+    return 0;
+}
+
+static ssize_t copybreak_store(struct device *d, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_copybreak);
+}
+static DEVICE_ATTR_RW(copybreak);
+
+static ssize_t sample_rate_show(struct device *d,
+                                struct device_attribute *attr, char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    u32 rate;
+
+    rcu_read_lock();
+    rate = rcu_dereference(priv->cfg)->sample_rate;
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%u\n", rate);
+}
+
+static int mnet_update_sample_rate(struct mnet_config *cfg, const char *buf)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    cfg->sample_rate = max(val, 1U);
+    return 0;
+}
+
+static ssize_t sample_rate_store(struct device *d,
+                                 struct device_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_sample_rate);
+}
+static DEVICE_ATTR_RW(sample_rate);
+
+static ssize_t vlan_filter_show(struct device *d,
+                                struct device_attribute *attr, char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    ssize_t len;
+
+    rcu_read_lock();
+    len = mnet_vlan_filter_print(rcu_dereference(priv->cfg)->vlan_mirror,
+                                 buf, PAGE_SIZE);
+    rcu_read_unlock();
+    return len;
+}
+
+static int mnet_update_vlan_filter(struct mnet_config *cfg, const char *buf)
+{
+    return mnet_vlan_filter_parse(cfg->vlan_mirror, buf);
+}
+
+static ssize_t vlan_filter_store(struct device *d,
+                                 struct device_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_vlan_filter);
+}
+static DEVICE_ATTR_RW(vlan_filter);
+
+static ssize_t collector_show(struct device *d, struct device_attribute *attr,
+                              char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    ssize_t len;
+
+    rcu_read_lock();
+    len = mnet_encap_print(rcu_dereference(priv->cfg), buf);
+    rcu_read_unlock();
+    return len;
+}
+
+static ssize_t collector_store(struct device *d, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_encap_parse);
+}
+static DEVICE_ATTR_RW(collector);
+
+static ssize_t collector_trunc_show(struct device *d,
+                                    struct device_attribute *attr, char *buf)
+{
+    struct mnet_priv *priv = mnet_dev_priv(d);
+    u32 trunc;
+
+    rcu_read_lock();
+    trunc = rcu_dereference(priv->cfg)->collector_trunc;
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%u\n", trunc);
+}
+
+static int mnet_update_collector_trunc(struct mnet_config *cfg,
+                                       const char *buf)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val && val < MNET_SNAPLEN_MIN)
+        return -EINVAL;
+    cfg->collector_trunc = val;
+    return 0;
+}
+
+static ssize_t collector_trunc_store(struct device *d,
+                                     struct device_attribute *attr,
+                                     const char *buf, size_t count)
+{
+    return mnet_config_store(d, buf, count, mnet_update_collector_trunc);
+}
+static DEVICE_ATTR_RW(collector_trunc);
+
+/* The port list is RTNL protected on its own, it is not part of the config */
+static ssize_t lower_show(struct device *d, struct device_attribute *attr,
+                          char *buf)
+{
+    ssize_t len;
+
+    if (!rtnl_trylock())
+        return restart_syscall();
+    len = mnet_lower_print(mnet_dev_priv(d), buf);
+    rtnl_unlock();
+
+    return len;
+}
+
+static ssize_t lower_store(struct device *d, struct device_attribute *attr,
+                           const char *buf, size_t count)
+{
+    int ret;
+
+    if (!rtnl_trylock())
+        return restart_syscall();
+    ret = mnet_set_lower(mnet_dev_priv(d), buf);
+    rtnl_unlock();
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(lower);
+
+static struct attribute *mnet_config_attrs[] = {
+    &dev_attr_mode.attr,
+    &dev_attr_lower.attr,
+    &dev_attr_flow_offload.attr,
+    &dev_attr_direct_xmit.attr,
+    &dev_attr_rx_tstamp.attr,
+    &dev_attr_top_talkers.attr,
+    &dev_attr_sketch.attr,
+    &dev_attr_sketch_epoch.attr,
+    &dev_attr_profile.attr,
+    &dev_attr_snaplen.attr,
+    &dev_attr_copybreak.attr,
+    &dev_attr_sample_rate.attr,
+    &dev_attr_vlan_filter.attr,
+    &dev_attr_collector.attr,
+    &dev_attr_collector_trunc.attr,
+    NULL,
+};
+
+static const struct attribute_group mnet_config_group = {
+    .name  = "mnet",
+    .attrs = mnet_config_attrs,
+};
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_config_init(struct mnet_priv *priv, enum mnet_mode mode,
+                     bool flow_offload, u32 snaplen, u32 sample_rate)
+{
+    struct mnet_config *cfg;
+
+    if (snaplen && snaplen < MNET_SNAPLEN_MIN)
+        return -EINVAL;
+
+    cfg = kzalloc(sizeof(*cfg), GFP_KERNEL);
+    if (!cfg)
+        return -ENOMEM;
+
+    cfg->mode = mode;
+    cfg->flow_offload = flow_offload;
+    cfg->snaplen = snaplen;
+    cfg->copybreak = MNET_COPYBREAK_DEF;
+    cfg->sample_rate = max(sample_rate, 1U);
+    cfg->sketch_epoch = 60;
+    bitmap_fill(cfg->vlan_mirror, VLAN_N_VID);
+    RCU_INIT_POINTER(priv->cfg, cfg);
+    mnet_stage_keys_update(cfg);
+
+    /* Registered together with mnet0 */
+    priv->dev->sysfs_groups[0] = &mnet_config_group;
+    return 0;
+}
+
+/* Called once mnet0 is unregistered and no packet can see the config */
+void mnet_config_fini(struct mnet_priv *priv)
+{
+    int i;
+
+    mnet_stage_keys_forced = false;
+    for (i = 0; i < ARRAY_SIZE(mnet_stage_keys); i++)
+        static_branch_disable(mnet_stage_keys[i].key);
+
+    kfree(rcu_dereference_protected(priv->cfg, true));
+    RCU_INIT_POINTER(priv->cfg, NULL);
+}
@@ -0,0 +1,523 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/if_arp.h>
+#include <linux/inet.h>
+#include <linux/interrupt.h>
+#include <linux/ip.h>
+#include <linux/percpu.h>
+#include <linux/rtnetlink.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/udp.h>
+#include <net/arp.h>
+#include <net/ip.h>
+#include <net/netevent.h>
+#include <net/route.h>
+
+#include "mnet.h"
+
+/*
+ * Encapsulated mirror.
+ *
+ * With a collector configured, every mirrored frame is also sent as
+ * Ethernet/IPv4/UDP/struct mnet_encap_hdr + frame out of the device the
+ * route to the collector goes through. The outer headers are built once
+ * into a template, from the route and the next hop's neighbour entry, and
+ * the hot path only copies it and fills in lengths, the IP checksum and a
+ * per-CPU sequence number.
+ *
+ * The template is rebuilt under RTNL when the collector changes, when the
+ * route it was built from is invalidated (checked per packet with
+ * dst_check(), as tunnels do), when the next hop's MAC changes and when the
+ * egress device goes away. Until a template exists frames are dropped.
+ *
+ * Frames are staged per CPU and handed to the egress device in bursts of
+ * up to MNET_ENCAP_BATCH, the remainder once the current RX softirq round
+ * is over, so its qdisc can dequeue them in bulk with xmit_more.
+ */
+
+#define MNET_ENCAP_HLEN     (ETH_HLEN + sizeof(struct iphdr) + \
+                             sizeof(struct udphdr) + \
+                             sizeof(struct mnet_encap_hdr))
+#define MNET_ENCAP_BATCH    32
+
+struct mnet_encap_tmpl {
+    struct net_device *dev;     // egress device, held
+    struct dst_entry *dst;      // route the template was built from, held
+    __be32 nexthop;             // for neighbour updates
+    unsigned int mtu;
+    u8 hdr[MNET_ENCAP_HLEN];
+    struct rcu_head rcu;
+};
+
+struct mnet_encap_pcpu {
+    struct sk_buff_head q;      // staged frames, each holds skb->dev
+    struct tasklet_struct flush;
+    struct mnet_priv *priv;
+    u32 seq;
+};
+
+struct mnet_encap {
+    struct mnet_priv *priv;
+    struct mnet_encap_tmpl __rcu *tmpl;
+    struct mnet_encap_pcpu __percpu *pcpu;
+    struct work_struct work;    // rebuild the template under RTNL
+    unsigned long retry;        // jiffies, next rebuild without a template
+    struct notifier_block netevent_nb;
+};
+
+/* -------------------- Template -------------------- */
+static void mnet_encap_tmpl_free(struct rcu_head *head)
+{
+    struct mnet_encap_tmpl *t = container_of(head, struct mnet_encap_tmpl,
+                                             rcu);
+
+    dst_release(t->dst);
+    dev_put(t->dev);
+    kfree(t);
+}
+
+static struct mnet_encap_tmpl *mnet_encap_build(struct mnet_priv *priv,
+                                                const struct mnet_config *cfg)
+{
+    struct net *net = dev_net(priv->dev);
+    struct mnet_encap_hdr *eh;
+    struct mnet_encap_tmpl *t;
+    struct net_device *dev;
+    struct flowi4 fl4 = {};
+    struct neighbour *n;
+    struct ethhdr *eth;
+    struct udphdr *uh;
+    struct iphdr *iph;
+    struct rtable *rt;
+    int ret;
+
+    if (cfg->collector_dev[0]) {
+        dev = __dev_get_by_name(net, cfg->collector_dev);
+        if (!dev)
+            return ERR_PTR(-ENODEV);
+        fl4.flowi4_oif = dev->ifindex;
+    }
+
+    fl4.daddr = cfg->collector_addr;
+    fl4.flowi4_proto = IPPROTO_UDP;
+    fl4.fl4_sport = cfg->collector_port;
+    fl4.fl4_dport = cfg->collector_port;
+    rt = ip_route_output_key(net, &fl4);
+    if (IS_ERR(rt))
+        return ERR_CAST(rt);
+
+    dev = rt->dst.dev;
+    if (dev == priv->dev || !(dev->flags & IFF_UP) ||
+        dev->reg_state != NETREG_REGISTERED ||
+        (dev->type != ARPHRD_ETHER && dev->type != ARPHRD_LOOPBACK)) {
+        ret = -ENETUNREACH;
+        goto err_rt;
+    }
+
+    n = dst_neigh_lookup(&rt->dst, &fl4.daddr);
+    if (!n) {
+        ret = -ENOMEM;
+        goto err_rt;
+    }
+    /* Kick resolution, the NEIGH_UPDATE event brings us back here */
+    if (!(READ_ONCE(n->nud_state) & NUD_VALID)) {
+        neigh_event_send(n, NULL);
+        ret = -EAGAIN;
+        goto err_neigh;
+    }
+
+    t = kzalloc(sizeof(*t), GFP_KERNEL);
+    if (!t) {
+        ret = -ENOMEM;
+        goto err_neigh;
+    }
+
+    eth = (struct ethhdr *)t->hdr;
+    neigh_ha_snapshot(eth->h_dest, n, dev);
+    ether_addr_copy(eth->h_source, dev->dev_addr);
+    eth->h_proto = htons(ETH_P_IP);
+
+    iph = (struct iphdr *)(eth + 1);
+    iph->version = 4;
+    iph->ihl = sizeof(*iph) >> 2;
+    iph->frag_off = htons(IP_DF);
+    iph->ttl = ip4_dst_hoplimit(&rt->dst);
+    iph->protocol = IPPROTO_UDP;
+    iph->saddr = fl4.saddr;
+    iph->daddr = fl4.daddr;
+
+    /* No UDP checksum, allowed over IPv4 and nothing to fix up per frame */
+    uh = (struct udphdr *)(iph + 1);
+    uh->source = cfg->collector_port;
+    uh->dest = cfg->collector_port;
+
+    eh = (struct mnet_encap_hdr *)(uh + 1);
+    eh->version = MNET_ENCAP_VERSION;
+
+    t->nexthop = rt_nexthop(rt, fl4.daddr);
+    t->mtu = dst_mtu(&rt->dst);
+    t->dst = &rt->dst;
+    t->dev = dev;
+    dev_hold(dev);
+    neigh_release(n);
+    return t;
+
+err_neigh:
+    neigh_release(n);
+err_rt:
+    ip_rt_put(rt);
+    return ERR_PTR(ret);
+}
+
+/* Build the template for the current config and publish it. Under RTNL */
+void mnet_encap_rebuild(struct mnet_priv *priv)
+{
+    const struct mnet_config *cfg = rtnl_dereference(priv->cfg);
+    struct mnet_encap *e = priv->encap;
+    struct mnet_encap_tmpl *t = NULL, *old;
+
+    ASSERT_RTNL();
+
+    if (cfg->collector_port) {
+        t = mnet_encap_build(priv, cfg);
+        if (IS_ERR(t)) {
+            if (PTR_ERR(t) != -EAGAIN)
+                net_info_ratelimited("%s: collector %pI4 unreachable (%ld)\n",
+                                     DRV_NAME, &cfg->collector_addr,
+                                     PTR_ERR(t));
+            t = NULL;
+        }
+    }
+
+    old = rtnl_dereference(e->tmpl);
+    rcu_assign_pointer(e->tmpl, t);
+    if (old)
+        call_rcu(&old->rcu, mnet_encap_tmpl_free);
+}
+
+static void mnet_encap_work(struct work_struct *work)
+{
+    struct mnet_encap *e = container_of(work, struct mnet_encap, work);
+
+    rtnl_lock();
+    mnet_encap_rebuild(e->priv);
+    rtnl_unlock();
+}
+
+/* Without a template, retry at most once a second from the hot path */
+static void mnet_encap_retry(struct mnet_encap *e)
+{
+    unsigned long retry = READ_ONCE(e->retry);
+
+    if (time_before(jiffies, retry))
+        return;
+    if (cmpxchg(&e->retry, retry, jiffies + HZ) == retry)
+        schedule_work(&e->work);
+}
+
+/* -------------------- Fast path -------------------- */
+static void mnet_encap_flush(struct mnet_priv *priv, struct mnet_encap_pcpu *pc)
+{
+    struct net_device *dev;
+    struct sk_buff *skb;
+
+    while ((skb = __skb_dequeue(&pc->q))) {
+        dev = skb->dev;
+        if (net_xmit_eval(dev_queue_xmit(skb)))
+            mnet_stats_inc(priv, MNET_STAT_ENCAP_DROPPED);
+        dev_put(dev);
+    }
+}
+
+static void mnet_encap_flush_tasklet(struct tasklet_struct *t)
+{
+    struct mnet_encap_pcpu *pc = from_tasklet(pc, t, flush);
+
+    mnet_encap_flush(pc->priv, pc);
+}
+
+/* Called from the rx_handler for each frame that passed the mirror filters */
+void mnet_encap_rx(struct mnet_priv *priv, const struct mnet_config *cfg,
+                   struct sk_buff *skb)
+{
+    struct mnet_encap *e = priv->encap;
+    const struct mnet_encap_tmpl *t;
+    struct mnet_encap_pcpu *pc;
+    struct mnet_encap_hdr *eh;
+    unsigned int len, orig_len;
+    struct sk_buff *nskb;
+    struct udphdr *uh;
+    struct iphdr *iph;
+    u8 flags = 0;
+
+    t = rcu_dereference(e->tmpl);
+    if (unlikely(!t)) {
+        mnet_encap_retry(e);
+        goto drop;
+    }
+    /* Keep using the old route until the new template is published */
+    if (unlikely(t->dst->obsolete && !dst_check(t->dst, 0)))
+        schedule_work(&e->work);
+
+    nskb = skb_clone(skb, GFP_ATOMIC);
+    if (!nskb)
+        goto drop;
+
+    /* Back to the Ethernet header, with the VLAN tag in-band */
+    __skb_push(nskb, -skb_mac_offset(nskb));
+    if (skb_vlan_tag_present(nskb)) {
+        nskb = __vlan_hwaccel_push_inside(nskb);
+        if (!nskb)
+            goto drop;
+    }
+
+    orig_len = nskb->len;
+    if (cfg->collector_trunc && orig_len > cfg->collector_trunc) {
+        if (pskb_trim(nskb, cfg->collector_trunc))
+            goto free;
+        flags |= MNET_ENCAP_F_TRUNC;
+    }
+
+    len = nskb->len + MNET_ENCAP_HLEN - ETH_HLEN;
+    if (len > t->mtu ||
+        skb_cow_head(nskb, MNET_ENCAP_HLEN + LL_RESERVED_SPACE(t->dev)))
+        goto free;
+
+    /* The head is private now; a truncated GRO frame is a single one */
+    skb_gso_reset(nskb);
+
+    skb_scrub_packet(nskb, true);
+    memcpy(__skb_push(nskb, MNET_ENCAP_HLEN), t->hdr, MNET_ENCAP_HLEN);
+    skb_reset_mac_header(nskb);
+    skb_set_network_header(nskb, ETH_HLEN);
+    skb_set_transport_header(nskb, ETH_HLEN + sizeof(*iph));
+
+    iph = ip_hdr(nskb);
+    iph->tot_len = htons(len);
+    ip_send_check(iph);
+
+    uh = udp_hdr(nskb);
+    uh->len = htons(len - sizeof(*iph));
+
+    pc = this_cpu_ptr(e->pcpu);
+    eh = (struct mnet_encap_hdr *)(uh + 1);
+    eh->flags = flags;
+    eh->cpu = htons(smp_processor_id());
+    eh->seq = htonl(pc->seq++);
+    eh->ifindex = htonl(skb->dev->ifindex);
+    eh->orig_len = htonl(orig_len);
+
+    nskb->dev = t->dev;
+    nskb->protocol = htons(ETH_P_IP);
+    nskb->ip_summed = CHECKSUM_NONE;
+    dev_hold(t->dev);
+
+    mnet_stats_pkt(priv, MNET_STAT_ENCAP_PACKETS, nskb->len);
+    __skb_queue_tail(&pc->q, nskb);
+    if (skb_queue_len(&pc->q) >= MNET_ENCAP_BATCH)
+        mnet_encap_flush(priv, pc);
+    else
+        tasklet_schedule(&pc->flush);
+    return;
+
+free:
+    kfree_skb(nskb);
+drop:
+    mnet_stats_inc(priv, MNET_STAT_ENCAP_DROPPED);
+}
+
+/* -------------------- Events -------------------- */
+static int mnet_encap_netevent(struct notifier_block *nb, unsigned long event,
+                               void *ptr)
+{
+    struct mnet_encap *e = container_of(nb, struct mnet_encap, netevent_nb);
+    const struct mnet_encap_tmpl *t;
+    struct neighbour *n = ptr;
+    bool rebuild = false;
+
+    if (event != NETEVENT_NEIGH_UPDATE && event != NETEVENT_REDIRECT)
+        return NOTIFY_DONE;
+
+    rcu_read_lock();
+    t = rcu_dereference(e->tmpl);
+    if (!t) {
+        /* A pending next hop may have resolved */
+        rebuild = rcu_dereference(e->priv->cfg)->collector_port;
+    } else if (event == NETEVENT_REDIRECT) {
+        rebuild = true;
+    } else {
+        rebuild = n->tbl == &arp_tbl && n->dev == t->dev &&
+                  *(__be32 *)n->primary_key == t->nexthop;
+    }
+    rcu_read_unlock();
+
+    if (rebuild)
+        schedule_work(&e->work);
+    return NOTIFY_DONE;
+}
+
+/* From the netdevice notifier, under RTNL */
+void mnet_encap_netdev_event(struct mnet_priv *priv, struct net_device *dev,
+                             unsigned long event)
+{
+    const struct mnet_config *cfg = rtnl_dereference(priv->cfg);
+    struct mnet_encap *e = priv->encap;
+    struct mnet_encap_tmpl *t;
+
+    if (!cfg->collector_port || dev == priv->dev)
+        return;
+
+    t = rtnl_dereference(e->tmpl);
+    switch (event) {
+    case NETDEV_UNREGISTER:
+        if (!t || t->dev != dev)
+            break;
+        /* Routes through @dev may not be flushed yet, rebuild later */
+        rcu_assign_pointer(e->tmpl, NULL);
+        call_rcu(&t->rcu, mnet_encap_tmpl_free);
+        schedule_work(&e->work);
+        break;
+    case NETDEV_DOWN:
+    case NETDEV_CHANGEADDR:
+        if (t && t->dev == dev)
+            mnet_encap_rebuild(priv);
+        break;
+    case NETDEV_UP:
+    case NETDEV_REGISTER:
+    case NETDEV_CHANGENAME:
+        if (!t)
+            mnet_encap_rebuild(priv);
+        break;
+    }
+}
+
+/* -------------------- Config -------------------- */
+/* "off", or "ADDR:PORT[@DEV]" */
+int mnet_encap_parse(struct mnet_config *cfg, const char *buf)
+{
+    char str[INET_ADDRSTRLEN + sizeof(":65535@") + IFNAMSIZ];
+    char *s, *port, *dev;
+    __be32 addr;
+    u16 val;
+
+    if (strscpy(str, buf, sizeof(str)) < 0)
+        return -EINVAL;
+    s = strim(str);
+
+    if (!*s || !strcmp(s, "off")) {
+        cfg->collector_addr = 0;
+        cfg->collector_port = 0;
+        cfg->collector_dev[0] = '\0';
+        return 0;
+    }
+
+    dev = strchr(s, '@');
+    if (dev) {
+        *dev++ = '\0';
+        if (!dev_valid_name(dev))
+            return -EINVAL;
+    }
+
+    port = strrchr(s, ':');
+    if (!port)
+        return -EINVAL;
+    *port++ = '\0';
+    if (kstrtou16(port, 10, &val) || !val)
+        return -EINVAL;
+
+    if (!in4_pton(s, -1, (u8 *)&addr, -1, NULL) || ipv4_is_zeronet(addr) ||
+        ipv4_is_multicast(addr))
+        return -EINVAL;
+
+    cfg->collector_addr = addr;
+    cfg->collector_port = htons(val);
+    strscpy(cfg->collector_dev, dev ? dev : "", IFNAMSIZ);
+    return 0;
+}
+
+ssize_t mnet_encap_print(const struct mnet_config *cfg, char *buf)
+{
+    if (!cfg->collector_port)
+        return sysfs_emit(buf, "off\n");
+
+    return sysfs_emit(buf, "%pI4:%u%s%s\n", &cfg->collector_addr,
+                      ntohs(cfg->collector_port),
+                      cfg->collector_dev[0] ? "@" : "", cfg->collector_dev);
+}
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_encap_init(struct mnet_priv *priv)
+{
+    struct mnet_encap_pcpu *pc;
+    struct mnet_encap *e;
+    int cpu, ret;
+
+    e = kzalloc(sizeof(*e), GFP_KERNEL);
+    if (!e)
+        return -ENOMEM;
+
+    e->pcpu = alloc_percpu(struct mnet_encap_pcpu);
+    if (!e->pcpu) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+
+    for_each_possible_cpu(cpu) {
+        pc = per_cpu_ptr(e->pcpu, cpu);
+        __skb_queue_head_init(&pc->q);
+        tasklet_setup(&pc->flush, mnet_encap_flush_tasklet);
+        pc->priv = priv;
+    }
+
+    e->priv = priv;
+    INIT_WORK(&e->work, mnet_encap_work);
+    e->netevent_nb.notifier_call = mnet_encap_netevent;
+    ret = register_netevent_notifier(&e->netevent_nb);
+    if (ret)
+        goto err_pcpu;
+
+    priv->encap = e;
+    return 0;
+
+err_pcpu:
+    free_percpu(e->pcpu);
+err_free:
+    kfree(e);
+    return ret;
+}
+
+/* After the rx_handler is gone from every port */
+void mnet_encap_fini(struct mnet_priv *priv)
+{
+    struct mnet_encap *e = priv->encap;
+    struct mnet_encap_tmpl *t;
+    struct mnet_encap_pcpu *pc;
+    struct sk_buff *skb;
+    int cpu;
+
+    unregister_netevent_notifier(&e->netevent_nb);
+    cancel_work_sync(&e->work);
+
+    rtnl_lock();
+    t = rtnl_dereference(e->tmpl);
+    RCU_INIT_POINTER(e->tmpl, NULL);
+    if (t)
+        call_rcu(&t->rcu, mnet_encap_tmpl_free);
+    rtnl_unlock();
+
+    for_each_possible_cpu(cpu) {
+        pc = per_cpu_ptr(e->pcpu, cpu);
+        tasklet_kill(&pc->flush);
+        while ((skb = __skb_dequeue(&pc->q))) {
+            dev_put(skb->dev);
+            kfree_skb(skb);
+        }
+    }
+
+    /* mnet_encap_tmpl_free() is module code */
+    rcu_barrier();
+    free_percpu(e->pcpu);
+    kfree(e);
+    priv->encap = NULL;
+}
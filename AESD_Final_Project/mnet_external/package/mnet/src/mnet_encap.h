@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _MNET_ENCAP_H
+#define _MNET_ENCAP_H
+
+#include <linux/types.h>
+
+/*
+ * Encapsulated mirror, shared with collectors.
+ *
+ * Each mirrored frame is sent in its own UDP datagram to the configured
+ * collector, as this header followed by the original Ethernet frame (VLAN
+ * tag included), possibly truncated. Sequence numbers are kept per sending
+ * CPU, so a collector detects loss per (source, cpu) pair.
+ */
+
+#define MNET_ENCAP_VERSION      1
+
+#define MNET_ENCAP_F_TRUNC      0x01    // frame cut, see orig_len
+
+struct mnet_encap_hdr {
+    __u8 version;
+    __u8 flags;
+    __be16 cpu;
+    __be32 seq;
+    __be32 ifindex;             // lower device the frame came in on
+    __be32 orig_len;            // frame length before truncation
+};
+
+#endif /* _MNET_ENCAP_H */
@@ -0,0 +1,221 @@
+#include <linux/kernel.h>
+#include <linux/cpumask.h>
+#include <linux/ethtool.h>
+#include <linux/net_tstamp.h>
+#include <linux/rtnetlink.h>
+#include <linux/string.h>
+
+#include "mnet.h"
+
+/*
+ * ethtool -S lists the totals, then the first MNET_PCPU_STATS counters of
+ * each possible CPU, then the fq queue length of each TX queue.
+ *
+ * Channels are mnet0's TX queues (one per priority band), the TX ring is
+ * the per-CPU staging queue of the fq scheduler and TX coalescing controls
+ * how many packets a CPU stages before kicking the TX NAPI.
+ *
+ * Timestamping: mnet0 always does software RX/TX stamps. With a single
+ * lower device its hardware capabilities and PHC are reported as well,
+ * since hardware stamps of lower skbs reach mnet0 untouched.
+ */
+
+#define MNET_PCPU_STATS     (MNET_STAT_TX_DROPPED + 1)
+
+static int mnet_stats_count(void)
+{
+    return MNET_STAT_NUM + MNET_PCPU_STATS * num_possible_cpus() +
+           MNET_NUM_BANDS;
+}
+
+/* -------------------- ethtool -------------------- */
+static void mnet_get_drvinfo(struct net_device *dev,
+                             struct ethtool_drvinfo *info)
+{
+    strscpy(info->driver, DRV_NAME, sizeof(info->driver));
+    strscpy(info->version, DRV_VERSION, sizeof(info->version));
+}
+
+static int mnet_get_sset_count(struct net_device *dev, int sset)
+{
+    switch (sset) {
+    case ETH_SS_STATS:
+        return mnet_stats_count();
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+static void mnet_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+    int cpu, i;
+
+    if (sset != ETH_SS_STATS)
+        return;
+
+    memcpy(data, mnet_stat_names, sizeof(mnet_stat_names));
+    data += sizeof(mnet_stat_names);
+
+    for_each_possible_cpu(cpu) {
+        for (i = 0; i < MNET_PCPU_STATS; i++)
+            ethtool_sprintf(&data, "cpu%d_%s", cpu, mnet_stat_names[i]);
+    }
+    for (i = 0; i < MNET_NUM_BANDS; i++)
+        ethtool_sprintf(&data, "txq%d_qlen", i);
+}
+
+static void mnet_get_ethtool_stats(struct net_device *dev,
+                                   struct ethtool_stats *stats, u64 *data)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    u64 cnt[MNET_STAT_NUM];
+    int cpu, i;
+
+    mnet_stats_fold(priv, data);
+    data += MNET_STAT_NUM;
+
+    for_each_possible_cpu(cpu) {
+        mnet_stats_read_cpu(priv, cpu, cnt);
+        memcpy(data, cnt, MNET_PCPU_STATS * sizeof(u64));
+        data += MNET_PCPU_STATS;
+    }
+    for (i = 0; i < MNET_NUM_BANDS; i++)
+        *data++ = mnet_fq_band_qlen(priv, i);
+}
+
+static void mnet_get_channels(struct net_device *dev,
+                              struct ethtool_channels *ch)
+{
+    ch->max_tx = MNET_NUM_BANDS;
+    ch->tx_count = dev->real_num_tx_queues;
+}
+
+static int mnet_set_channels(struct net_device *dev,
+                             struct ethtool_channels *ch)
+{
+    if (!ch->tx_count)
+        return -EINVAL;
+
+    return netif_set_real_num_tx_queues(dev, ch->tx_count);
+}
+
+static void mnet_get_ringparam(struct net_device *dev,
+                               struct ethtool_ringparam *ring,
+                               struct kernel_ethtool_ringparam *kring,
+                               struct netlink_ext_ack *extack)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+
+    if (!priv->fq)
+        return;
+
+    ring->tx_max_pending = MNET_FQ_STAGE_MAX;
+    ring->tx_pending = mnet_fq_stage_limit(priv);
+}
+
+static int mnet_set_ringparam(struct net_device *dev,
+                              struct ethtool_ringparam *ring,
+                              struct kernel_ethtool_ringparam *kring,
+                              struct netlink_ext_ack *extack)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+
+    if (!priv->fq) {
+        NL_SET_ERR_MSG(extack, "TX ring needs the fq scheduler (fq=1)");
+        return -EOPNOTSUPP;
+    }
+
+    return mnet_fq_set_stage_limit(priv, ring->tx_pending);
+}
+
+static int mnet_get_coalesce(struct net_device *dev,
+                             struct ethtool_coalesce *ec,
+                             struct kernel_ethtool_coalesce *kec,
+                             struct netlink_ext_ack *extack)
+{
+    mnet_fq_get_coalesce(netdev_priv(dev), &ec->tx_coalesce_usecs,
+                         &ec->tx_max_coalesced_frames);
+    return 0;
+}
+
+static int mnet_set_coalesce(struct net_device *dev,
+                             struct ethtool_coalesce *ec,
+                             struct kernel_ethtool_coalesce *kec,
+                             struct netlink_ext_ack *extack)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+
+    if (!priv->fq) {
+        NL_SET_ERR_MSG(extack, "TX coalescing needs the fq scheduler (fq=1)");
+        return -EOPNOTSUPP;
+    }
+
+    return mnet_fq_set_coalesce(priv, ec->tx_coalesce_usecs,
+                                ec->tx_max_coalesced_frames);
+}
+
+/* Does @lower's driver call skb_tx_timestamp() itself? Called under RTNL */
+bool mnet_lower_tx_swts(struct net_device *lower)
+{
+    struct ethtool_ts_info info;
+
+    if (__ethtool_get_ts_info(lower, &info))
+        return false;
+    return info.so_timestamping & SOF_TIMESTAMPING_TX_SOFTWARE;
+}
+
+/*
+ * Not always called under RTNL: SOF_TIMESTAMPING_BIND_PHC gets here from
+ * setsockopt(). The port is looked up under RCU and its device held
+ * across the call into the lower driver, as vlan and macvlan do.
+ */
+static int mnet_get_ts_info(struct net_device *dev,
+                            struct ethtool_ts_info *info)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    struct net_device *lower = NULL;
+    struct mnet_port *port;
+    int ret = -ENODEV;
+
+    rcu_read_lock();
+    if (READ_ONCE(priv->num_ports) == 1) {
+        port = list_first_or_null_rcu(&priv->ports, struct mnet_port, list);
+        if (port) {
+            lower = port->dev;
+            dev_hold(lower);
+        }
+    }
+    rcu_read_unlock();
+
+    if (lower) {
+        ret = __ethtool_get_ts_info(lower, info);
+        dev_put(lower);
+    }
+    if (ret) {
+        memset(info, 0, sizeof(*info));
+        info->cmd = ETHTOOL_GET_TS_INFO;
+        info->phc_index = -1;
+    }
+
+    info->so_timestamping |= SOF_TIMESTAMPING_TX_SOFTWARE |
+                             SOF_TIMESTAMPING_RX_SOFTWARE |
+                             SOF_TIMESTAMPING_SOFTWARE;
+    return 0;
+}
+
+const struct ethtool_ops mnet_ethtool_ops = {
+    .supported_coalesce_params = ETHTOOL_COALESCE_TX_USECS |
+                                 ETHTOOL_COALESCE_TX_MAX_FRAMES,
+    .get_drvinfo       = mnet_get_drvinfo,
+    .get_link          = ethtool_op_get_link,
+    .get_sset_count    = mnet_get_sset_count,
+    .get_strings       = mnet_get_strings,
+    .get_ethtool_stats = mnet_get_ethtool_stats,
+    .get_channels      = mnet_get_channels,
+    .set_channels      = mnet_set_channels,
+    .get_ringparam     = mnet_get_ringparam,
+    .set_ringparam     = mnet_set_ringparam,
+    .get_coalesce      = mnet_get_coalesce,
+    .set_coalesce      = mnet_set_coalesce,
+    .get_ts_info       = mnet_get_ts_info,
+};
@@ -0,0 +1,242 @@
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <asm/unaligned.h>
+
+#include "mnet.h"
+
+/*
+ * Learning forwarding database keyed by MAC + VLAN.
+ *
+ * Lookups and refreshes of existing entries run under RCU only; inserts,
+ * deletes and the ageing sweep take fdb_lock. The table is bounded by
+ * MNET_FDB_MAX so a MAC flood cannot grow it without limit.
+ */
+
+static struct kmem_cache *mnet_fdb_cache;
+static unsigned int mnet_fdb_cache_users;  // mnet_init() and the KUnit suite
+
+static inline u32 mnet_fdb_hash(const struct mnet_priv *priv,
+                                const unsigned char *addr, u16 vid)
+{
+    u32 key = get_unaligned((u32 *)(addr + 2));
+
+    return jhash_2words(key, vid, priv->fdb_salt) &
+           (MNET_FDB_HASH_SIZE - 1);
+}
+
+struct mnet_fdb_entry *mnet_fdb_find_rcu(struct mnet_priv *priv,
+                                         const unsigned char *addr, u16 vid)
+{
+    struct hlist_head *head = &priv->fdb_hash[mnet_fdb_hash(priv, addr, vid)];
+    struct mnet_fdb_entry *f;
+
+    hlist_for_each_entry_rcu(f, head, hlist) {
+        if (f->vid == vid && ether_addr_equal(f->addr, addr))
+            return f;
+    }
+    return NULL;
+}
+
+static struct mnet_fdb_entry *mnet_fdb_find(struct hlist_head *head,
+                                            const unsigned char *addr, u16 vid)
+{
+    struct mnet_fdb_entry *f;
+
+    hlist_for_each_entry(f, head, hlist) {
+        if (f->vid == vid && ether_addr_equal(f->addr, addr))
+            return f;
+    }
+    return NULL;
+}
+
+static void mnet_fdb_rcu_free(struct rcu_head *head)
+{
+    struct mnet_fdb_entry *f = container_of(head, struct mnet_fdb_entry, rcu);
+
+    kmem_cache_free(mnet_fdb_cache, f);
+}
+
+static void mnet_fdb_delete(struct mnet_priv *priv, struct mnet_fdb_entry *f)
+{
+    lockdep_assert_held(&priv->fdb_lock);
+
+    hlist_del_rcu(&f->hlist);
+    atomic_dec(&priv->fdb_count);
+    call_rcu(&f->rcu, mnet_fdb_rcu_free);
+}
+
+void mnet_fdb_learn(struct mnet_priv *priv, struct mnet_port *port,
+                    const unsigned char *addr, u16 vid)
+{
+    struct hlist_head *head;
+    struct mnet_fdb_entry *f;
+    unsigned long now = jiffies;
+
+    if (!is_valid_ether_addr(addr))
+        return;
+
+    head = &priv->fdb_hash[mnet_fdb_hash(priv, addr, vid)];
+
+    f = mnet_fdb_find_rcu(priv, addr, vid);
+    if (likely(f)) {
+        /* Only dirty the cache line when something actually changed */
+        if (READ_ONCE(f->updated) != now)
+            WRITE_ONCE(f->updated, now);
+        if (unlikely(READ_ONCE(f->port) != port))
+            WRITE_ONCE(f->port, port);
+        return;
+    }
+
+    if (atomic_read(&priv->fdb_count) >= MNET_FDB_MAX)
+        return;
+
+    spin_lock(&priv->fdb_lock);
+    f = mnet_fdb_find(head, addr, vid);
+    if (!f) {
+        f = kmem_cache_alloc(mnet_fdb_cache, GFP_ATOMIC);
+        if (f) {
+            ether_addr_copy(f->addr, addr);
+            f->vid = vid;
+            f->port = port;
+            f->updated = now;
+            hlist_add_head_rcu(&f->hlist, head);
+            atomic_inc(&priv->fdb_count);
+        }
+    }
+    spin_unlock(&priv->fdb_lock);
+}
+
+void mnet_fdb_delete_by_port(struct mnet_priv *priv, struct mnet_port *port)
+{
+    struct mnet_fdb_entry *f;
+    struct hlist_node *tmp;
+    int i;
+
+    spin_lock_bh(&priv->fdb_lock);
+    for (i = 0; i < MNET_FDB_HASH_SIZE; i++) {
+        hlist_for_each_entry_safe(f, tmp, &priv->fdb_hash[i], hlist) {
+            if (f->port == port)
+                mnet_fdb_delete(priv, f);
+        }
+    }
+    spin_unlock_bh(&priv->fdb_lock);
+}
+
+void mnet_fdb_flush(struct mnet_priv *priv)
+{
+    struct mnet_fdb_entry *f;
+    struct hlist_node *tmp;
+    int i;
+
+    spin_lock_bh(&priv->fdb_lock);
+    for (i = 0; i < MNET_FDB_HASH_SIZE; i++) {
+        hlist_for_each_entry_safe(f, tmp, &priv->fdb_hash[i], hlist)
+            mnet_fdb_delete(priv, f);
+    }
+    spin_unlock_bh(&priv->fdb_lock);
+}
+
+/* -------------------- Ageing -------------------- */
+static void mnet_fdb_gc(struct work_struct *work)
+{
+    struct mnet_priv *priv = container_of(work, struct mnet_priv,
+                                          fdb_gc_work.work);
+    unsigned long delay = priv->ageing_time;
+    unsigned long now = jiffies;
+    struct mnet_fdb_entry *f;
+    struct hlist_node *tmp;
+    int i;
+
+    spin_lock_bh(&priv->fdb_lock);
+    for (i = 0; i < MNET_FDB_HASH_SIZE; i++) {
+        hlist_for_each_entry_safe(f, tmp, &priv->fdb_hash[i], hlist) {
+            unsigned long expire = READ_ONCE(f->updated) + priv->ageing_time;
+
+            if (time_after_eq(now, expire))
+                mnet_fdb_delete(priv, f);
+            else
+                delay = min(delay, expire - now);
+        }
+    }
+    spin_unlock_bh(&priv->fdb_lock);
+
+    /* Don't rearm more often than every 10ms */
+    queue_delayed_work(system_long_wq, &priv->fdb_gc_work,
+                       max_t(unsigned long, delay, msecs_to_jiffies(10)));
+}
+
+/* -------------------- debugfs -------------------- */
+int mnet_fdb_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    struct mnet_fdb_entry *f;
+    int i;
+
+    seq_puts(m, "mac               vid  port             age_ms\n");
+    rcu_read_lock();
+    for (i = 0; i < MNET_FDB_HASH_SIZE; i++) {
+        hlist_for_each_entry_rcu(f, &priv->fdb_hash[i], hlist) {
+            struct mnet_port *port = READ_ONCE(f->port);
+
+            seq_printf(m, "%pM %4u %-16s %u\n", f->addr, f->vid,
+                       port->dev->name,
+                       jiffies_to_msecs(jiffies - READ_ONCE(f->updated)));
+        }
+    }
+    rcu_read_unlock();
+    return 0;
+}
+
+/* -------------------- Init / Exit -------------------- */
+void mnet_fdb_init(struct mnet_priv *priv)
+{
+    int i;
+
+    spin_lock_init(&priv->fdb_lock);
+    atomic_set(&priv->fdb_count, 0);
+    priv->fdb_salt = get_random_u32();
+    for (i = 0; i < MNET_FDB_HASH_SIZE; i++)
+        INIT_HLIST_HEAD(&priv->fdb_hash[i]);
+
+    INIT_DELAYED_WORK(&priv->fdb_gc_work, mnet_fdb_gc);
+    queue_delayed_work(system_long_wq, &priv->fdb_gc_work,
+                       priv->ageing_time);
+}
+
+void mnet_fdb_fini(struct mnet_priv *priv)
+{
+    cancel_delayed_work_sync(&priv->fdb_gc_work);
+    mnet_fdb_flush(priv);
+}
+
+/*
+ * The KUnit suite takes its own reference: built in, it runs after a
+ * mnet_init() that may have failed for want of a lower device.
+ */
+int mnet_fdb_cache_init(void)
+{
+    if (mnet_fdb_cache_users++)
+        return 0;
+
+    mnet_fdb_cache = kmem_cache_create("mnet_fdb_cache",
+                                       sizeof(struct mnet_fdb_entry), 0,
+                                       SLAB_HWCACHE_ALIGN, NULL);
+    if (!mnet_fdb_cache) {
+        mnet_fdb_cache_users = 0;
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void mnet_fdb_cache_fini(void)
+{
+    if (--mnet_fdb_cache_users)
+        return;
+
+    /* Wait for the last mnet_fdb_rcu_free() before destroying the cache */
+    rcu_barrier();
+    kmem_cache_destroy(mnet_fdb_cache);
+}
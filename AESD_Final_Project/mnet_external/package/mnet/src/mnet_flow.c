@@ -0,0 +1,373 @@
+#include <linux/kernel.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <net/ip.h>
+#include <net/tcp.h>
+
+#include "mnet.h"
+
+/*
+ * L3 flow-offload cache.
+ *
+ * Routed IPv4 TCP/UDP traffic that leaves through mnet0 is learned in
+ * mnet_start_xmit() together with the port it went out of and the exact
+ * Ethernet header the stack built for it. Later packets of the same 5-tuple
+ * arriving on a lower port are rewritten (TTL, L2 header) and sent straight
+ * to that port from the rx_handler, skipping both passes through the stack.
+ *
+ * Entries are dropped after flow_timeout of inactivity and, regardless of
+ * activity, after MNET_FLOW_LIFETIME so route or neighbour changes are picked
+ * up by the next packet that goes through the slow path.
+ */
+
+#define MNET_FLOW_LIFETIME  (10 * HZ)
+
+static struct kmem_cache *mnet_flow_cache;
+
+static inline u32 mnet_flow_hash(const struct mnet_priv *priv,
+                                 const struct mnet_flow_key *key)
+{
+    return jhash2((const u32 *)key, sizeof(*key) / sizeof(u32),
+                  priv->flow_salt) & (MNET_FLOW_HASH_SIZE - 1);
+}
+
+/*
+ * Pull the 5-tuple out of an IPv4 TCP/UDP packet. Options, fragments and
+ * other protocols are left to the stack.
+ */
+static bool mnet_flow_dissect(struct sk_buff *skb, struct mnet_flow_key *key,
+                              u8 *tcp_flags)
+{
+    unsigned int nhoff = skb_network_offset(skb);
+    unsigned int thoff = nhoff + sizeof(struct iphdr);
+    const struct iphdr *iph;
+    const __be16 *ports;
+
+    if (!pskb_may_pull(skb, thoff))
+        return false;
+
+    iph = (const struct iphdr *)(skb->data + nhoff);
+    if (iph->version != 4 || iph->ihl != 5 || ip_is_fragment(iph))
+        return false;
+
+    switch (iph->protocol) {
+    case IPPROTO_TCP:
+        if (!pskb_may_pull(skb, thoff + sizeof(struct tcphdr)))
+            return false;
+        *tcp_flags = tcp_flag_byte((struct tcphdr *)(skb->data + thoff));
+        break;
+    case IPPROTO_UDP:
+        if (!pskb_may_pull(skb, thoff + sizeof(struct udphdr)))
+            return false;
+        *tcp_flags = 0;
+        break;
+    default:
+        return false;
+    }
+
+    /* pskb_may_pull() may have moved the header */
+    iph = (const struct iphdr *)(skb->data + nhoff);
+    ports = (const __be16 *)(skb->data + thoff);
+
+    memset(key, 0, sizeof(*key));
+    key->saddr = iph->saddr;
+    key->daddr = iph->daddr;
+    key->sport = ports[0];
+    key->dport = ports[1];
+    key->proto = iph->protocol;
+    return true;
+}
+
+/*
+ * Same 5-tuple as mnet_flow_dissect(), for any IPv4 packet and without
+ * touching the skb, which may be shared. Ports are zero for protocols
+ * other than TCP/UDP and for non-first fragments.
+ */
+bool mnet_flow_key_peek(const struct sk_buff *skb, struct mnet_flow_key *key)
+{
+    unsigned int nhoff = skb_network_offset(skb);
+    const struct iphdr *iph;
+    const __be16 *ports;
+    struct iphdr _iph;
+    __be16 _ports[2];
+
+    if (skb->protocol != htons(ETH_P_IP))
+        return false;
+
+    iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+    if (!iph || iph->version != 4 || iph->ihl < 5)
+        return false;
+
+    memset(key, 0, sizeof(*key));
+    key->saddr = iph->saddr;
+    key->daddr = iph->daddr;
+    key->proto = iph->protocol;
+
+    if ((iph->protocol == IPPROTO_TCP || iph->protocol == IPPROTO_UDP) &&
+        !(iph->frag_off & htons(IP_OFFSET))) {
+        ports = skb_header_pointer(skb, nhoff + iph->ihl * 4,
+                                   sizeof(_ports), _ports);
+        if (ports) {
+            key->sport = ports[0];
+            key->dport = ports[1];
+        }
+    }
+    return true;
+}
+
+static struct mnet_flow *mnet_flow_find_rcu(struct mnet_priv *priv,
+                                            const struct mnet_flow_key *key)
+{
+    struct hlist_head *head = &priv->flow_hash[mnet_flow_hash(priv, key)];
+    struct mnet_flow *fl;
+
+    hlist_for_each_entry_rcu(fl, head, hlist) {
+        if (!memcmp(&fl->key, key, sizeof(*key)))
+            return fl;
+    }
+    return NULL;
+}
+
+static void mnet_flow_rcu_free(struct rcu_head *head)
+{
+    kmem_cache_free(mnet_flow_cache,
+                    container_of(head, struct mnet_flow, rcu));
+}
+
+static void mnet_flow_delete(struct mnet_priv *priv, struct mnet_flow *fl)
+{
+    lockdep_assert_held(&priv->flow_lock);
+
+    hlist_del_init_rcu(&fl->hlist);
+    atomic_dec(&priv->flow_count);
+    call_rcu(&fl->rcu, mnet_flow_rcu_free);
+}
+
+/* Remove a flow found under RCU, unless someone else already did */
+static void mnet_flow_teardown(struct mnet_priv *priv, struct mnet_flow *fl)
+{
+    spin_lock(&priv->flow_lock);
+    if (!hlist_unhashed(&fl->hlist))
+        mnet_flow_delete(priv, fl);
+    spin_unlock(&priv->flow_lock);
+}
+
+/* -------------------- Slow path: learn from TX -------------------- */
+void mnet_flow_learn(struct mnet_priv *priv, struct sk_buff *skb,
+                     struct mnet_port *port)
+{
+    struct mnet_flow_key key;
+    struct hlist_head *head;
+    struct mnet_flow *fl;
+    u8 tcp_flags;
+
+    /* Only forwarded traffic: local output has skb_iif == 0 */
+    if (!skb->skb_iif || skb->sk || skb_vlan_tag_present(skb) ||
+        eth_hdr(skb)->h_proto != htons(ETH_P_IP))
+        return;
+
+    if (!mnet_flow_dissect(skb, &key, &tcp_flags))
+        return;
+
+    /* Like nf_flowtable, only offload established TCP connections */
+    if (tcp_flags & (TCPHDR_SYN | TCPHDR_FIN | TCPHDR_RST))
+        return;
+
+    if (mnet_flow_find_rcu(priv, &key))
+        return;
+
+    if (atomic_read(&priv->flow_count) >= MNET_FLOW_MAX)
+        return;
+
+    fl = kmem_cache_alloc(mnet_flow_cache, GFP_ATOMIC);
+    if (!fl)
+        return;
+
+    fl->key = key;
+    fl->port = port;
+    fl->created = jiffies;
+    fl->used = fl->created;
+    fl->mtu = min(port->dev->mtu, priv->dev->mtu);
+    memcpy(fl->l2hdr, eth_hdr(skb), ETH_HLEN);
+
+    head = &priv->flow_hash[mnet_flow_hash(priv, &key)];
+    spin_lock(&priv->flow_lock);
+    if (mnet_flow_find_rcu(priv, &key)) {
+        spin_unlock(&priv->flow_lock);
+        kmem_cache_free(mnet_flow_cache, fl);
+        return;
+    }
+    hlist_add_head_rcu(&fl->hlist, head);
+    atomic_inc(&priv->flow_count);
+    spin_unlock(&priv->flow_lock);
+}
+
+/* -------------------- Fast path: called from the rx_handler -------------------- */
+/*
+ * Returns true if the skb was consumed. *pskb may be replaced by an unshared
+ * copy even when the packet is handed back to the stack.
+ */
+bool mnet_flow_rx(struct mnet_priv *priv, struct sk_buff **pskb)
+{
+    struct mnet_flow_key key;
+    struct sk_buff *skb;
+    struct mnet_flow *fl;
+    struct mnet_port *port;
+    unsigned long now;
+    u8 tcp_flags;
+
+    if (skb_vlan_tag_present(*pskb))
+        return false;
+
+    skb = skb_share_check(*pskb, GFP_ATOMIC);
+    if (!skb)
+        return true;
+    *pskb = skb;
+
+    if (!mnet_flow_dissect(skb, &key, &tcp_flags))
+        return false;
+
+    fl = mnet_flow_find_rcu(priv, &key);
+    if (!fl) {
+        mnet_stats_inc(priv, MNET_STAT_FLOW_MISS);
+        return false;
+    }
+
+    now = jiffies;
+    if (unlikely(tcp_flags & (TCPHDR_FIN | TCPHDR_RST)) ||
+        unlikely(time_after(now, fl->created + MNET_FLOW_LIFETIME))) {
+        mnet_flow_teardown(priv, fl);
+        return false;
+    }
+
+    port = fl->port;
+    if (unlikely(!netif_running(port->dev)))
+        return false;
+
+    if (skb_is_gso(skb) ? !skb_gso_validate_network_len(skb, fl->mtu)
+                        : skb->len > fl->mtu)
+        return false;
+
+    if (ip_hdr(skb)->ttl <= 1)
+        return false;
+
+    /* We rewrite the IP header and the MAC header in front of it */
+    if (skb_cow_head(skb, ETH_HLEN))
+        return false;
+
+    if (READ_ONCE(fl->used) != now)
+        WRITE_ONCE(fl->used, now);
+
+    ip_decrease_ttl(ip_hdr(skb));
+
+    skb_push(skb, ETH_HLEN);
+    skb_reset_mac_header(skb);
+    memcpy(skb->data, fl->l2hdr, ETH_HLEN);
+    skb_forward_csum(skb);
+
+    mnet_stats_inc(priv, MNET_STAT_FLOW_HIT);
+    skb->dev = port->dev;
+    dev_queue_xmit(skb);
+    return true;
+}
+
+/* -------------------- Maintenance -------------------- */
+void mnet_flow_delete_by_port(struct mnet_priv *priv, struct mnet_port *port)
+{
+    struct mnet_flow *fl;
+    struct hlist_node *tmp;
+    int i;
+
+    spin_lock_bh(&priv->flow_lock);
+    for (i = 0; i < MNET_FLOW_HASH_SIZE; i++) {
+        hlist_for_each_entry_safe(fl, tmp, &priv->flow_hash[i], hlist) {
+            if (!port || fl->port == port)
+                mnet_flow_delete(priv, fl);
+        }
+    }
+    spin_unlock_bh(&priv->flow_lock);
+}
+
+static void mnet_flow_gc(struct work_struct *work)
+{
+    struct mnet_priv *priv = container_of(work, struct mnet_priv,
+                                          flow_gc_work.work);
+    unsigned long now = jiffies;
+    struct mnet_flow *fl;
+    struct hlist_node *tmp;
+    int i;
+
+    spin_lock_bh(&priv->flow_lock);
+    for (i = 0; i < MNET_FLOW_HASH_SIZE; i++) {
+        hlist_for_each_entry_safe(fl, tmp, &priv->flow_hash[i], hlist) {
+            if (time_after_eq(now, READ_ONCE(fl->used) + priv->flow_timeout) ||
+                time_after_eq(now, fl->created + MNET_FLOW_LIFETIME))
+                mnet_flow_delete(priv, fl);
+        }
+    }
+    spin_unlock_bh(&priv->flow_lock);
+
+    queue_delayed_work(system_long_wq, &priv->flow_gc_work, HZ);
+}
+
+int mnet_flow_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    struct mnet_flow *fl;
+    int i;
+
+    seq_puts(m, "proto src                   dst                   port             next_hop          idle_ms\n");
+    rcu_read_lock();
+    for (i = 0; i < MNET_FLOW_HASH_SIZE; i++) {
+        hlist_for_each_entry_rcu(fl, &priv->flow_hash[i], hlist) {
+            seq_printf(m, "%-5s %pI4:%-6u %pI4:%-6u %-16s %pM %u\n",
+                       fl->key.proto == IPPROTO_TCP ? "tcp" : "udp",
+                       &fl->key.saddr, ntohs(fl->key.sport),
+                       &fl->key.daddr, ntohs(fl->key.dport),
+                       fl->port->dev->name, fl->l2hdr,
+                       jiffies_to_msecs(jiffies - READ_ONCE(fl->used)));
+        }
+    }
+    rcu_read_unlock();
+    return 0;
+}
+
+/* -------------------- Init / Exit -------------------- */
+void mnet_flow_init(struct mnet_priv *priv)
+{
+    int i;
+
+    spin_lock_init(&priv->flow_lock);
+    atomic_set(&priv->flow_count, 0);
+    priv->flow_salt = get_random_u32();
+    for (i = 0; i < MNET_FLOW_HASH_SIZE; i++)
+        INIT_HLIST_HEAD(&priv->flow_hash[i]);
+
+    INIT_DELAYED_WORK(&priv->flow_gc_work, mnet_flow_gc);
+    queue_delayed_work(system_long_wq, &priv->flow_gc_work, HZ);
+}
+
+void mnet_flow_fini(struct mnet_priv *priv)
+{
+    cancel_delayed_work_sync(&priv->flow_gc_work);
+    mnet_flow_delete_by_port(priv, NULL);
+}
+
+int __init mnet_flow_cache_init(void)
+{
+    mnet_flow_cache = kmem_cache_create("mnet_flow_cache",
+                                        sizeof(struct mnet_flow), 0,
+                                        SLAB_HWCACHE_ALIGN, NULL);
+    return mnet_flow_cache ? 0 : -ENOMEM;
+}
+
+void mnet_flow_cache_fini(void)
+{
+    rcu_barrier();
+    kmem_cache_destroy(mnet_flow_cache);
+}
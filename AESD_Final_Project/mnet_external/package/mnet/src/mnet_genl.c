@@ -0,0 +1,388 @@
+#include <linux/kernel.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <net/genetlink.h>
+
+#include "mnet.h"
+#include "mnet_genl.h"
+
+/*
+ * Generic netlink export of the counters and events.
+ *
+ * A GET_STATS request is answered with one binary message holding the
+ * totals, each CPU's counters and the TX queue state, so a collector can
+ * poll at a high rate without parsing debugfs text. Lower device state
+ * changes and counter rates crossing a threshold set with SET_THRESHOLD are
+ * multicast to the "events" group.
+ */
+
+#define MNET_EVENT_PERIOD   HZ      // thresholds and rates are per second
+
+static struct mnet_priv *mnet_genl_priv;
+static struct genl_family mnet_genl_family;
+
+enum mnet_genl_mcgrp {
+    MNET_MCGRP_EVENTS,
+};
+
+static const struct genl_multicast_group mnet_genl_mcgrps[] = {
+    [MNET_MCGRP_EVENTS] = { .name = MNET_GENL_MCGRP_EVENTS },
+};
+
+static const struct nla_policy mnet_genl_policy[MNET_ATTR_MAX + 1] = {
+    [MNET_ATTR_STAT_ID]   = { .type = NLA_U32 },
+    [MNET_ATTR_THRESHOLD] = { .type = NLA_U64 },
+};
+
+/* -------------------- GET_STATS -------------------- */
+static size_t mnet_genl_stats_size(void)
+{
+    size_t counters = nla_total_size(sizeof(u64) * MNET_STAT_NUM);
+    size_t cpu = nla_total_size(nla_total_size(sizeof(u32)) + counters);
+    size_t queue = nla_total_size(nla_total_size(sizeof(u32)) * 2 +
+                                  nla_total_size_64bit(sizeof(u64)) * 2);
+    size_t hist = nla_total_size(nla_total_size(sizeof("xmit_batch")) +
+                                 nla_total_size(sizeof(u64) *
+                                                MNET_XMIT_HIST_BUCKETS));
+
+    return nla_total_size(sizeof(u32)) * 2 +          // IFINDEX, STAT_COUNT
+           nla_total_size_64bit(sizeof(u64)) +         // TIMESTAMP
+           counters + cpu * num_possible_cpus() + queue * MNET_NUM_BANDS +
+           hist;
+}
+
+static int mnet_genl_fill_queues(struct sk_buff *msg, struct mnet_priv *priv,
+                                 const u64 *total)
+{
+    struct nlattr *nest;
+    int i;
+
+    for (i = 0; i < MNET_NUM_BANDS; i++) {
+        nest = nla_nest_start(msg, MNET_ATTR_QUEUE);
+        if (!nest)
+            return -EMSGSIZE;
+        if (nla_put_u32(msg, MNET_ATTR_QUEUE_ID, i) ||
+            nla_put_u64_64bit(msg, MNET_ATTR_QUEUE_PACKETS,
+                              total[MNET_STAT_TX_BAND0_PACKETS + 2 * i],
+                              MNET_ATTR_PAD) ||
+            nla_put_u64_64bit(msg, MNET_ATTR_QUEUE_BYTES,
+                              total[MNET_STAT_TX_BAND0_BYTES + 2 * i],
+                              MNET_ATTR_PAD) ||
+            nla_put_u32(msg, MNET_ATTR_QUEUE_QLEN,
+                        mnet_fq_band_qlen(priv, i))) {
+            nla_nest_cancel(msg, nest);
+            return -EMSGSIZE;
+        }
+        nla_nest_end(msg, nest);
+    }
+    return 0;
+}
+
+static int mnet_genl_fill_hist(struct sk_buff *msg, struct mnet_priv *priv)
+{
+    u64 hist[MNET_XMIT_HIST_BUCKETS];
+    struct nlattr *nest;
+
+    mnet_xmit_hist_read(priv, hist);
+
+    nest = nla_nest_start(msg, MNET_ATTR_HIST);
+    if (!nest)
+        return -EMSGSIZE;
+    if (nla_put_string(msg, MNET_ATTR_HIST_NAME, "xmit_batch") ||
+        nla_put(msg, MNET_ATTR_HIST_BUCKETS, sizeof(hist), hist)) {
+        nla_nest_cancel(msg, nest);
+        return -EMSGSIZE;
+    }
+    nla_nest_end(msg, nest);
+    return 0;
+}
+
+static int mnet_genl_fill_stats(struct sk_buff *msg, struct mnet_priv *priv)
+{
+    u64 total[MNET_STAT_NUM] = { 0 };
+    u64 cnt[MNET_STAT_NUM];
+    struct nlattr *nest, *attr;
+    int cpu, i;
+
+    if (nla_put_u32(msg, MNET_ATTR_IFINDEX, priv->dev->ifindex) ||
+        nla_put_u64_64bit(msg, MNET_ATTR_TIMESTAMP, ktime_get_ns(),
+                          MNET_ATTR_PAD) ||
+        nla_put_u32(msg, MNET_ATTR_STAT_COUNT, MNET_STAT_NUM))
+        return -EMSGSIZE;
+
+    /* Reserved now, filled once all CPUs are summed */
+    attr = nla_reserve(msg, MNET_ATTR_TOTAL, sizeof(total));
+    if (!attr)
+        return -EMSGSIZE;
+
+    for_each_possible_cpu(cpu) {
+        mnet_stats_read_cpu(priv, cpu, cnt);
+        for (i = 0; i < MNET_STAT_NUM; i++)
+            total[i] += cnt[i];
+
+        nest = nla_nest_start(msg, MNET_ATTR_CPU);
+        if (!nest)
+            return -EMSGSIZE;
+        if (nla_put_u32(msg, MNET_ATTR_CPU_ID, cpu) ||
+            nla_put(msg, MNET_ATTR_CPU_COUNTERS, sizeof(cnt), cnt))
+            return -EMSGSIZE;
+        nla_nest_end(msg, nest);
+    }
+    memcpy(nla_data(attr), total, sizeof(total));
+
+    if (mnet_genl_fill_queues(msg, priv, total))
+        return -EMSGSIZE;
+    return mnet_genl_fill_hist(msg, priv);
+}
+
+static int mnet_genl_get_stats(struct sk_buff *skb, struct genl_info *info)
+{
+    struct sk_buff *msg;
+    void *hdr;
+    int ret;
+
+    msg = genlmsg_new(mnet_genl_stats_size(), GFP_KERNEL);
+    if (!msg)
+        return -ENOMEM;
+
+    hdr = genlmsg_put_reply(msg, info, &mnet_genl_family, 0,
+                            MNET_CMD_GET_STATS);
+    if (!hdr) {
+        ret = -EMSGSIZE;
+        goto err;
+    }
+
+    ret = mnet_genl_fill_stats(msg, mnet_genl_priv);
+    if (ret)
+        goto err;
+
+    genlmsg_end(msg, hdr);
+    return genlmsg_reply(msg, info);
+
+err:
+    nlmsg_free(msg);
+    return ret;
+}
+
+/* -------------------- GET_NAMES -------------------- */
+static int mnet_genl_get_names(struct sk_buff *skb, struct genl_info *info)
+{
+    struct nlattr *nest;
+    struct sk_buff *msg;
+    void *hdr;
+    int i;
+
+    msg = genlmsg_new(MNET_STAT_NUM * nla_total_size(ETH_GSTRING_LEN) +
+                      nla_total_size(0), GFP_KERNEL);
+    if (!msg)
+        return -ENOMEM;
+
+    hdr = genlmsg_put_reply(msg, info, &mnet_genl_family, 0,
+                            MNET_CMD_GET_NAMES);
+    if (!hdr)
+        goto err;
+
+    nest = nla_nest_start(msg, MNET_ATTR_NAMES);
+    if (!nest)
+        goto err;
+    for (i = 0; i < MNET_STAT_NUM; i++) {
+        if (nla_put_string(msg, MNET_ATTR_STAT_NAME, mnet_stat_names[i]))
+            goto err;
+    }
+    nla_nest_end(msg, nest);
+
+    genlmsg_end(msg, hdr);
+    return genlmsg_reply(msg, info);
+
+err:
+    nlmsg_free(msg);
+    return -EMSGSIZE;
+}
+
+/* -------------------- Threshold events -------------------- */
+static bool mnet_genl_thresholds_set(struct mnet_priv *priv)
+{
+    int i;
+
+    for (i = 0; i < MNET_STAT_NUM; i++) {
+        if (READ_ONCE(priv->event_threshold[i]))
+            return true;
+    }
+    return false;
+}
+
+static void mnet_genl_notify_threshold(struct mnet_priv *priv, u32 id,
+                                       u64 threshold, u64 rate)
+{
+    struct sk_buff *msg;
+    void *hdr;
+
+    msg = genlmsg_new(nla_total_size(sizeof(u32)) * 2 +
+                      nla_total_size_64bit(sizeof(u64)) * 2, GFP_KERNEL);
+    if (!msg)
+        return;
+
+    hdr = genlmsg_put(msg, 0, 0, &mnet_genl_family, 0,
+                      MNET_CMD_EVENT_THRESHOLD);
+    if (!hdr ||
+        nla_put_u32(msg, MNET_ATTR_IFINDEX, priv->dev->ifindex) ||
+        nla_put_u32(msg, MNET_ATTR_STAT_ID, id) ||
+        nla_put_u64_64bit(msg, MNET_ATTR_THRESHOLD, threshold,
+                          MNET_ATTR_PAD) ||
+        nla_put_u64_64bit(msg, MNET_ATTR_RATE, rate, MNET_ATTR_PAD)) {
+        nlmsg_free(msg);
+        return;
+    }
+
+    genlmsg_end(msg, hdr);
+    genlmsg_multicast(&mnet_genl_family, msg, 0, MNET_MCGRP_EVENTS,
+                      GFP_KERNEL);
+}
+
+/*
+ * Once per MNET_EVENT_PERIOD compare each counter's rate with its
+ * threshold and report crossings in both directions.
+ */
+static void mnet_genl_event_work(struct work_struct *work)
+{
+    struct mnet_priv *priv = container_of(work, struct mnet_priv,
+                                          event_work.work);
+    u64 cnt[MNET_STAT_NUM];
+    u64 threshold, rate;
+    bool over;
+    int i;
+
+    mnet_stats_fold(priv, cnt);
+
+    for (i = 0; i < MNET_STAT_NUM; i++) {
+        rate = cnt[i] - priv->event_last[i];
+        priv->event_last[i] = cnt[i];
+
+        threshold = READ_ONCE(priv->event_threshold[i]);
+        over = threshold && rate >= threshold;
+        if (over == test_bit(i, priv->event_over))
+            continue;
+
+        __assign_bit(i, priv->event_over, over);
+        mnet_genl_notify_threshold(priv, i, threshold, rate);
+    }
+
+    if (mnet_genl_thresholds_set(priv))
+        queue_delayed_work(system_long_wq, &priv->event_work,
+                           MNET_EVENT_PERIOD);
+}
+
+static int mnet_genl_set_threshold(struct sk_buff *skb, struct genl_info *info)
+{
+    struct mnet_priv *priv = mnet_genl_priv;
+    u32 id;
+
+    if (GENL_REQ_ATTR_CHECK(info, MNET_ATTR_STAT_ID) ||
+        GENL_REQ_ATTR_CHECK(info, MNET_ATTR_THRESHOLD))
+        return -EINVAL;
+
+    id = nla_get_u32(info->attrs[MNET_ATTR_STAT_ID]);
+    if (id >= MNET_STAT_NUM) {
+        NL_SET_ERR_MSG_ATTR(info->extack, info->attrs[MNET_ATTR_STAT_ID],
+                            "unknown counter");
+        return -EINVAL;
+    }
+
+    WRITE_ONCE(priv->event_threshold[id],
+               nla_get_u64(info->attrs[MNET_ATTR_THRESHOLD]));
+
+    /* Start from the current values so the first rate is meaningful */
+    if (!delayed_work_pending(&priv->event_work)) {
+        mnet_stats_fold(priv, priv->event_last);
+        queue_delayed_work(system_long_wq, &priv->event_work,
+                           MNET_EVENT_PERIOD);
+    }
+    return 0;
+}
+
+/* -------------------- Lower device events -------------------- */
+/* Called under RTNL from port add/del and the netdevice notifier */
+void mnet_genl_notify_lower(struct mnet_priv *priv, struct net_device *lower,
+                            enum mnet_lower_state state)
+{
+    struct sk_buff *msg;
+    void *hdr;
+
+    /* Ports are attached before the family exists and after it is gone */
+    if (!mnet_genl_priv ||
+        !genl_has_listeners(&mnet_genl_family, dev_net(priv->dev),
+                            MNET_MCGRP_EVENTS))
+        return;
+
+    msg = genlmsg_new(nla_total_size(sizeof(u32)) * 2 +
+                      nla_total_size(IFNAMSIZ) + nla_total_size(sizeof(u8)),
+                      GFP_KERNEL);
+    if (!msg)
+        return;
+
+    hdr = genlmsg_put(msg, 0, 0, &mnet_genl_family, 0, MNET_CMD_EVENT_LOWER);
+    if (!hdr ||
+        nla_put_u32(msg, MNET_ATTR_IFINDEX, priv->dev->ifindex) ||
+        nla_put_u32(msg, MNET_ATTR_LOWER_IFINDEX, lower->ifindex) ||
+        nla_put_string(msg, MNET_ATTR_LOWER_NAME, lower->name) ||
+        nla_put_u8(msg, MNET_ATTR_LOWER_STATE, state)) {
+        nlmsg_free(msg);
+        return;
+    }
+
+    genlmsg_end(msg, hdr);
+    genlmsg_multicast(&mnet_genl_family, msg, 0, MNET_MCGRP_EVENTS,
+                      GFP_KERNEL);
+}
+
+/* -------------------- Family -------------------- */
+static const struct genl_small_ops mnet_genl_ops[] = {
+    {
+        .cmd  = MNET_CMD_GET_STATS,
+        .doit = mnet_genl_get_stats,
+    },
+    {
+        .cmd  = MNET_CMD_GET_NAMES,
+        .doit = mnet_genl_get_names,
+    },
+    {
+        .cmd   = MNET_CMD_SET_THRESHOLD,
+        .doit  = mnet_genl_set_threshold,
+        .flags = GENL_ADMIN_PERM,
+    },
+};
+
+static struct genl_family mnet_genl_family __ro_after_init = {
+    .name          = MNET_GENL_NAME,
+    .version       = MNET_GENL_VERSION,
+    .maxattr       = MNET_ATTR_MAX,
+    .policy        = mnet_genl_policy,
+    .module        = THIS_MODULE,
+    .small_ops     = mnet_genl_ops,
+    .n_small_ops   = ARRAY_SIZE(mnet_genl_ops),
+    .resv_start_op = MNET_CMD_SET_THRESHOLD + 1,
+    .mcgrps        = mnet_genl_mcgrps,
+    .n_mcgrps      = ARRAY_SIZE(mnet_genl_mcgrps),
+};
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_genl_init(struct mnet_priv *priv)
+{
+    int ret;
+
+    INIT_DELAYED_WORK(&priv->event_work, mnet_genl_event_work);
+    mnet_genl_priv = priv;
+    ret = genl_register_family(&mnet_genl_family);
+    if (ret)
+        mnet_genl_priv = NULL;
+    return ret;
+}
+
+/* Doits use mnet_genl_priv, unregistering waits for the running ones */
+void mnet_genl_fini(struct mnet_priv *priv)
+{
+    genl_unregister_family(&mnet_genl_family);
+    mnet_genl_priv = NULL;
+    cancel_delayed_work_sync(&priv->event_work);
+}
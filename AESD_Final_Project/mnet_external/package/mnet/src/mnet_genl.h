@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _MNET_GENL_H
+#define _MNET_GENL_H
+
+/*
+ * Generic netlink interface of the mnet driver, shared with userspace.
+ *
+ * MNET_CMD_GET_STATS returns every counter in one message: the totals and
+ * each CPU's counters as flat u64 arrays indexed like the names returned by
+ * MNET_CMD_GET_NAMES, plus one nest per TX queue and one per histogram.
+ * Events are sent to the MNET_GENL_MCGRP_EVENTS multicast group.
+ *
+ * Histograms:
+ *   "xmit_batch"  frames per batch handed to a lower driver; bucket i
+ *                 counts batches of 2^(i-1)+1 to 2^i frames (1, 2, 3-4,
+ *                 ... 33-64)
+ */
+
+#define MNET_GENL_NAME          "mnet"
+#define MNET_GENL_VERSION       1
+#define MNET_GENL_MCGRP_EVENTS  "events"
+
+enum mnet_genl_cmd {
+    MNET_CMD_UNSPEC,
+    MNET_CMD_GET_STATS,         // reply: TOTAL, CPU, QUEUE and HIST nests
+    MNET_CMD_GET_NAMES,         // reply: NAMES nest of STAT_NAME strings
+    MNET_CMD_SET_THRESHOLD,     // STAT_ID + THRESHOLD, 0 clears
+    MNET_CMD_EVENT_THRESHOLD,   // STAT_ID, THRESHOLD, RATE
+    MNET_CMD_EVENT_LOWER,       // LOWER_* attributes
+    __MNET_CMD_MAX,
+};
+#define MNET_CMD_MAX (__MNET_CMD_MAX - 1)
+
+enum mnet_genl_attr {
+    MNET_ATTR_UNSPEC,
+    MNET_ATTR_PAD,
+    MNET_ATTR_IFINDEX,          // u32, mnet device
+    MNET_ATTR_TIMESTAMP,        // u64, ktime_get_ns() of the snapshot
+    MNET_ATTR_STAT_COUNT,       // u32, entries in each counter array
+    MNET_ATTR_TOTAL,            // binary, u64[STAT_COUNT] summed over CPUs
+    MNET_ATTR_CPU,              // nest, one per possible CPU
+    MNET_ATTR_CPU_ID,           // u32
+    MNET_ATTR_CPU_COUNTERS,     // binary, u64[STAT_COUNT]
+    MNET_ATTR_QUEUE,            // nest, one per TX queue
+    MNET_ATTR_QUEUE_ID,         // u32
+    MNET_ATTR_QUEUE_PACKETS,    // u64
+    MNET_ATTR_QUEUE_BYTES,      // u64
+    MNET_ATTR_QUEUE_QLEN,       // u32, packets held by the fq scheduler
+    MNET_ATTR_HIST,             // nest, HIST_NAME + HIST_BUCKETS
+    MNET_ATTR_HIST_NAME,        // string
+    MNET_ATTR_HIST_BUCKETS,     // binary, u64[]
+    MNET_ATTR_NAMES,            // nest of STAT_NAME
+    MNET_ATTR_STAT_NAME,        // string
+    MNET_ATTR_STAT_ID,          // u32
+    MNET_ATTR_THRESHOLD,        // u64, per second
+    MNET_ATTR_RATE,             // u64, per second
+    MNET_ATTR_LOWER_IFINDEX,    // u32
+    MNET_ATTR_LOWER_NAME,       // string
+    MNET_ATTR_LOWER_STATE,      // u8, enum mnet_lower_state
+    __MNET_ATTR_MAX,
+};
+#define MNET_ATTR_MAX (__MNET_ATTR_MAX - 1)
+
+enum mnet_lower_state {
+    MNET_LOWER_ATTACHED,
+    MNET_LOWER_DETACHED,
+    MNET_LOWER_UP,              // running with carrier
+    MNET_LOWER_DOWN,
+};
+
+#endif /* _MNET_GENL_H */
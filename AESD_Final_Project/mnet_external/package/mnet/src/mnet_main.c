@@ -0,0 +1,1268 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ctype.h>
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/skbuff.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/spinlock.h>
+#include <linux/rtnetlink.h>
+
+#include "mnet.h"
+
+static char *lower = "eth0";
+module_param(lower, charp, 0444);
+MODULE_PARM_DESC(lower, "Comma separated lower devices: NAME, mac=ADDR or bus=BUS-INFO (default eth0)");
+
+static char *mode = "mirror";
+module_param(mode, charp, 0444);
+MODULE_PARM_DESC(mode, "mirror: clone lower RX to mnet0, bridge: learning bridge");
+
+static unsigned int ageing_time = 300;
+module_param(ageing_time, uint, 0444);
+MODULE_PARM_DESC(ageing_time, "FDB entry ageing time in seconds (default 300)");
+
+static bool flow_offload;
+module_param(flow_offload, bool, 0444);
+MODULE_PARM_DESC(flow_offload, "Forward cached routed IPv4 flows from the rx_handler");
+
+static unsigned int flow_timeout = 30;
+module_param(flow_timeout, uint, 0444);
+MODULE_PARM_DESC(flow_timeout, "Idle timeout of offloaded flows in seconds (default 30)");
+
+static bool fq;
+module_param(fq, bool, 0444);
+MODULE_PARM_DESC(fq, "Use the built-in fair queueing TX scheduler instead of a qdisc");
+
+static unsigned int snaplen;
+module_param(snaplen, uint, 0444);
+MODULE_PARM_DESC(snaplen, "Initial mirror snap length in bytes, 0 for whole frames");
+
+static unsigned int sample_rate = 1;
+module_param(sample_rate, uint, 0444);
+MODULE_PARM_DESC(sample_rate, "Initial mirror sampling, one frame in N per CPU (default 1)");
+
+static unsigned int fq_limit = 10240;
+module_param(fq_limit, uint, 0444);
+MODULE_PARM_DESC(fq_limit, "fq scheduler queue limit in packets (default 10240)");
+
+static unsigned int fq_target_us = 5000;
+module_param(fq_target_us, uint, 0444);
+MODULE_PARM_DESC(fq_target_us, "fq scheduler CoDel target sojourn time in us (default 5000)");
+
+static unsigned int fq_interval_us = 100000;
+module_param(fq_interval_us, uint, 0444);
+MODULE_PARM_DESC(fq_interval_us, "fq scheduler CoDel interval in us (default 100000)");
+
+static char *prio_mode = "strict";
+module_param(prio_mode, charp, 0444);
+MODULE_PARM_DESC(prio_mode, "fq scheduler band service: strict or weighted (default strict)");
+
+static unsigned int prio_weight[MNET_NUM_BANDS] = { 8, 4, 2, 1 };
+module_param_array(prio_weight, uint, NULL, 0444);
+MODULE_PARM_DESC(prio_weight, "Per band weights for prio_mode=weighted (default 8,4,2,1)");
+
+static struct net_device *mnet_dev;
+static struct dentry *mnet_debug_dir;
+
+const char mnet_stat_names[MNET_STAT_NUM][ETH_GSTRING_LEN] = {
+    [MNET_STAT_RX_PACKETS]    = "rx_packets",
+    [MNET_STAT_RX_BYTES]      = "rx_bytes",
+    [MNET_STAT_TX_PACKETS]    = "tx_packets",
+    [MNET_STAT_TX_BYTES]      = "tx_bytes",
+    [MNET_STAT_RX_DROPPED]    = "rx_dropped",
+    [MNET_STAT_TX_DROPPED]    = "tx_dropped",
+    [MNET_STAT_VLAN_FILTERED] = "vlan_filtered",
+    [MNET_STAT_SAMPLE_SKIPPED] = "sample_skipped",
+    [MNET_STAT_ENCAP_PACKETS] = "encap_packets",
+    [MNET_STAT_ENCAP_BYTES]   = "encap_bytes",
+    [MNET_STAT_ENCAP_DROPPED] = "encap_dropped",
+    [MNET_STAT_FWD_PACKETS]   = "fwd_packets",
+    [MNET_STAT_FLOOD_PACKETS] = "flood_packets",
+    [MNET_STAT_DIRECT_PACKETS]  = "direct_packets",
+    [MNET_STAT_DIRECT_FALLBACK] = "direct_fallback",
+    [MNET_STAT_RX_COPY]         = "rx_copy",
+    [MNET_STAT_RX_CLONE]        = "rx_clone",
+    [MNET_STAT_FDB_HIT]       = "fdb_hit",
+    [MNET_STAT_FDB_MISS]      = "fdb_miss",
+    [MNET_STAT_FLOW_HIT]      = "flow_hit",
+    [MNET_STAT_FLOW_MISS]     = "flow_miss",
+    [MNET_STAT_FQ_DROP_CODEL]     = "fq_drop_codel",
+    [MNET_STAT_FQ_DROP_OVERLIMIT] = "fq_drop_overlimit",
+    [MNET_STAT_TX_BAND0_PACKETS]  = "tx_band0_packets",
+    [MNET_STAT_TX_BAND0_BYTES]    = "tx_band0_bytes",
+    [MNET_STAT_TX_BAND1_PACKETS]  = "tx_band1_packets",
+    [MNET_STAT_TX_BAND1_BYTES]    = "tx_band1_bytes",
+    [MNET_STAT_TX_BAND2_PACKETS]  = "tx_band2_packets",
+    [MNET_STAT_TX_BAND2_BYTES]    = "tx_band2_bytes",
+    [MNET_STAT_TX_BAND3_PACKETS]  = "tx_band3_packets",
+    [MNET_STAT_TX_BAND3_BYTES]    = "tx_band3_bytes",
+};
+
+/* -------------------- Stats -------------------- */
+void mnet_stats_read_cpu(struct mnet_priv *priv, int cpu, u64 *out)
+{
+    const struct mnet_pcpu_stats *s = per_cpu_ptr(priv->pcpu_stats, cpu);
+    unsigned int start;
+    int i;
+
+    do {
+        start = u64_stats_fetch_begin(&s->syncp);
+        for (i = 0; i < MNET_STAT_NUM; i++)
+            out[i] = u64_stats_read(&s->cnt[i]);
+    } while (u64_stats_fetch_retry(&s->syncp, start));
+}
+
+void mnet_stats_fold(struct mnet_priv *priv, u64 *out)
+{
+    u64 tmp[MNET_STAT_NUM];
+    int cpu, i;
+
+    memset(out, 0, sizeof(u64) * MNET_STAT_NUM);
+
+    for_each_possible_cpu(cpu) {
+        mnet_stats_read_cpu(priv, cpu, tmp);
+        for (i = 0; i < MNET_STAT_NUM; i++)
+            out[i] += tmp[i];
+    }
+}
+
+u64 mnet_stats_read(struct mnet_priv *priv, enum mnet_stat idx)
+{
+    u64 cnt[MNET_STAT_NUM];
+
+    mnet_stats_fold(priv, cnt);
+    return cnt[idx];
+}
+
+static void mnet_get_stats64(struct net_device *dev,
+                             struct rtnl_link_stats64 *stats)
+{
+    u64 cnt[MNET_STAT_NUM];
+
+    mnet_stats_fold(netdev_priv(dev), cnt);
+
+    stats->rx_packets = cnt[MNET_STAT_RX_PACKETS];
+    stats->rx_bytes   = cnt[MNET_STAT_RX_BYTES];
+    stats->tx_packets = cnt[MNET_STAT_TX_PACKETS];
+    stats->tx_bytes   = cnt[MNET_STAT_TX_BYTES];
+    stats->rx_dropped = cnt[MNET_STAT_RX_DROPPED];
+    stats->tx_dropped = cnt[MNET_STAT_TX_DROPPED];
+}
+
+/* -------------------- Forwarding helpers -------------------- */
+/* How mnet_xmit_port() hands a frame to the lower device */
+enum mnet_xmit_how {
+    MNET_XMIT_QUEUED,           // dev_queue_xmit(), from the RX handler
+    MNET_XMIT_BATCHED,          // TX path, dev_queue_xmit() as well
+    MNET_XMIT_DIRECT,           // TX path, batched (direct_xmit)
+};
+
+/*
+ * Handoff to a lower device. Batched frames may be held until the caller's
+ * mnet_xmit_flush(). Software TX timestamps requested by the socket are
+ * taken here unless the lower driver takes them itself, which would report
+ * the same packet twice.
+ */
+static inline void mnet_xmit_port(struct mnet_port *port, struct sk_buff *skb,
+                                  enum mnet_xmit_how how)
+{
+    if (!port->tx_swts)
+        skb_tx_timestamp(skb);
+    skb->dev = port->dev;
+    if (how == MNET_XMIT_QUEUED)
+        dev_queue_xmit(skb);
+    else
+        mnet_xmit_batched(netdev_priv(port->mnet), skb,
+                          how == MNET_XMIT_DIRECT);
+}
+
+/*
+ * Send @skb out of every running port except @exclude. The last port gets
+ * the original, the others a clone. Consumes @skb; returns false if no port
+ * took it.
+ */
+static bool mnet_flood(struct mnet_priv *priv, struct sk_buff *skb,
+                       const struct mnet_port *exclude,
+                       enum mnet_xmit_how how)
+{
+    struct mnet_port *port, *prev = NULL;
+    struct sk_buff *nskb;
+
+    list_for_each_entry_rcu(port, &priv->ports, list) {
+        if (port == exclude || !netif_running(port->dev))
+            continue;
+        if (prev) {
+            nskb = skb_clone(skb, GFP_ATOMIC);
+            if (nskb)
+                mnet_xmit_port(prev, nskb, how);
+        }
+        prev = port;
+    }
+
+    if (!prev) {
+        kfree_skb(skb);
+        return false;
+    }
+
+    mnet_stats_inc(priv, MNET_STAT_FLOOD_PACKETS);
+    mnet_xmit_port(prev, skb, how);
+    return true;
+}
+
+/* -------------------- RX Handler -------------------- */
+/*
+ * The lower driver already ran eth_type_trans() and the core already moved
+ * any VLAN tag into skb->vlan_tci, so the clone (or copy-break copy) only
+ * needs retargeting: protocol, headers, checksum state and tag metadata
+ * carry over unchanged.
+ */
+static void mnet_mirror_rx(struct mnet_priv *priv,
+                           const struct mnet_config *cfg,
+                           struct sk_buff *skb, u16 vid)
+{
+    struct mnet_pcpu_stats *s = this_cpu_ptr(priv->pcpu_stats);
+    struct net_device *dev = priv->dev;
+    struct sk_buff *clone;
+    enum mnet_stat why;
+
+    why = mnet_mirror_filter(cfg, s, vid);
+    if (why != MNET_STAT_NUM) {
+        __mnet_stats_add(s, why, 1);
+        return;
+    }
+
+    if (static_branch_unlikely(&mnet_key_collector) && cfg->collector_port)
+        mnet_encap_rx(priv, cfg, skb);
+
+    clone = mnet_rx_dup(priv, cfg, skb, cfg->snaplen);
+    if (!clone) {
+        mnet_stats_inc(priv, MNET_STAT_RX_DROPPED);
+        return;
+    }
+
+    clone->dev = dev;
+    if (clone->pkt_type == PACKET_HOST || clone->pkt_type == PACKET_OTHERHOST)
+        clone->pkt_type = ether_addr_equal(eth_hdr(clone)->h_dest,
+                                           dev->dev_addr) ?
+                          PACKET_HOST : PACKET_OTHERHOST;
+
+    mnet_stats_pkt(priv, MNET_STAT_RX_PACKETS, clone->len);
+    netif_rx(clone);
+}
+
+/* Hand a copy of a broadcast/multicast frame to the mnet0 stack */
+static void mnet_bridge_local_copy(struct mnet_priv *priv,
+                                   const struct mnet_config *cfg,
+                                   struct sk_buff *skb)
+{
+    struct sk_buff *clone;
+
+    clone = mnet_rx_dup(priv, cfg, skb, 0);
+    if (!clone) {
+        mnet_stats_inc(priv, MNET_STAT_RX_DROPPED);
+        return;
+    }
+
+    clone->dev = priv->dev;
+    mnet_stats_pkt(priv, MNET_STAT_RX_PACKETS, clone->len);
+    netif_rx(clone);
+}
+
+/* Re-inject a frame from @port, whose data points past the MAC header */
+static void mnet_bridge_flood_rx(struct mnet_priv *priv, struct sk_buff *skb,
+                                 struct mnet_port *port)
+{
+    struct sk_buff *clone;
+
+    clone = skb_clone(skb, GFP_ATOMIC);
+    if (!clone)
+        return;
+
+    skb_push(clone, ETH_HLEN);
+    skb_forward_csum(clone);
+    mnet_flood(priv, clone, port, MNET_XMIT_QUEUED);
+}
+
+static rx_handler_result_t mnet_bridge_rx(struct mnet_priv *priv,
+                                          const struct mnet_config *cfg,
+                                          struct mnet_port *port,
+                                          struct sk_buff **pskb, u16 vid)
+{
+    struct sk_buff *skb;
+    const unsigned char *dest;
+    struct mnet_fdb_entry *f;
+    struct mnet_port *dst;
+
+    /* We may forward or retarget the skb itself */
+    skb = skb_share_check(*pskb, GFP_ATOMIC);
+    if (!skb)
+        return RX_HANDLER_CONSUMED;
+    *pskb = skb;
+    dest = eth_hdr(skb)->h_dest;
+
+    if (is_multicast_ether_addr(dest)) {
+        if (priv->num_ports > 1)
+            mnet_bridge_flood_rx(priv, skb, port);
+        mnet_bridge_local_copy(priv, cfg, skb);
+        return RX_HANDLER_PASS;
+    }
+
+    /* Addressed to mnet0 itself: move the skb over, no copy */
+    if (ether_addr_equal(dest, priv->dev->dev_addr)) {
+        skb->dev = priv->dev;
+        skb->pkt_type = PACKET_HOST;
+        mnet_stats_pkt(priv, MNET_STAT_RX_PACKETS, skb->len);
+        return RX_HANDLER_ANOTHER;
+    }
+
+    f = mnet_fdb_find_rcu(priv, dest, vid);
+    if (!f) {
+        mnet_stats_inc(priv, MNET_STAT_FDB_MISS);
+        if (priv->num_ports > 1)
+            mnet_bridge_flood_rx(priv, skb, port);
+        return RX_HANDLER_PASS;
+    }
+
+    mnet_stats_inc(priv, MNET_STAT_FDB_HIT);
+    dst = READ_ONCE(f->port);
+    if (dst == port || !netif_running(dst->dev))
+        return RX_HANDLER_PASS;
+
+    skb_push(skb, ETH_HLEN);
+    skb_forward_csum(skb);
+    mnet_stats_inc(priv, MNET_STAT_FWD_PACKETS);
+    mnet_xmit_port(dst, skb, MNET_XMIT_QUEUED);
+    return RX_HANDLER_CONSUMED;
+}
+
+rx_handler_result_t mnet_rx_handler(struct sk_buff **pskb)
+{
+    const struct mnet_config *cfg;
+    struct mnet_flow_key key;
+    struct sk_buff *skb = *pskb;
+    struct mnet_port *port;
+    struct mnet_priv *priv;
+    u16 vid;
+
+    if (unlikely(skb->pkt_type == PACKET_LOOPBACK))
+        return RX_HANDLER_PASS;
+
+    port = rcu_dereference(skb->dev->rx_handler_data);
+    if (unlikely(!(port->mnet->flags & IFF_UP)))
+        return RX_HANDLER_PASS;
+
+    priv = netdev_priv(port->mnet);
+    cfg = rcu_dereference(priv->cfg);
+
+    if (mnet_stage(profile, cfg))
+        mnet_profile_rx(priv, skb);
+
+    /*
+     * The core stamps before us only while some socket wants timestamps;
+     * otherwise mirrored clones would get stamped late by netif_rx().
+     * Hardware stamps live in the shared skb_shinfo and carry over.
+     */
+    if (mnet_stage(rx_tstamp, cfg) && !skb->tstamp)
+        __net_timestamp(skb);
+
+    if ((mnet_stage(top_talkers, cfg) || mnet_stage(sketch, cfg)) &&
+        mnet_flow_key_peek(skb, &key)) {
+        if (cfg->top_talkers)
+            mnet_top_update(priv, &key, skb->len);
+        if (cfg->sketch)
+            mnet_sketch_update(priv, cfg, key.saddr, skb->len);
+    }
+
+    if (mnet_stage(flow_offload, cfg) && skb->protocol == htons(ETH_P_IP)) {
+        if (mnet_flow_rx(priv, pskb))
+            return RX_HANDLER_CONSUMED;
+        skb = *pskb;
+    }
+
+    vid = mnet_skb_vid(skb);
+
+    mnet_fdb_learn(priv, port, eth_hdr(skb)->h_source, vid);
+
+    if (cfg->mode == MNET_MODE_BRIDGE)
+        return mnet_bridge_rx(priv, cfg, port, pskb, vid);
+
+    mnet_mirror_rx(priv, cfg, skb, vid);
+    return RX_HANDLER_PASS;
+}
+
+/* -------------------- TX Handler -------------------- */
+/*
+ * Runs under rcu_read_lock_bh() or from the fq NAPI poll. Frames may be
+ * held until the caller's mnet_xmit_flush().
+ */
+void mnet_forward_tx(struct mnet_priv *priv, struct sk_buff *skb)
+{
+    const struct mnet_config *cfg = rcu_dereference_bh(priv->cfg);
+    enum mnet_xmit_how how = cfg->direct_xmit ? MNET_XMIT_DIRECT :
+                                                MNET_XMIT_BATCHED;
+    const unsigned char *dest = eth_hdr(skb)->h_dest;
+    unsigned int len = skb->len;
+    struct mnet_fdb_entry *f;
+    struct mnet_port *port;
+
+    mnet_prio_tx(priv, skb);
+
+    /* Known unicast destination: send it to that one port only */
+    if (likely(!is_multicast_ether_addr(dest))) {
+        f = mnet_fdb_find_rcu(priv, dest, mnet_skb_vid(skb));
+        if (f) {
+            mnet_stats_inc(priv, MNET_STAT_FDB_HIT);
+            port = READ_ONCE(f->port);
+            if (unlikely(!netif_running(port->dev)))
+                goto drop;
+            if (mnet_stage(flow_offload, cfg))
+                mnet_flow_learn(priv, skb, port);
+            mnet_stats_pkt(priv, MNET_STAT_TX_PACKETS, len);
+            mnet_xmit_port(port, skb, how);
+            return;
+        }
+        mnet_stats_inc(priv, MNET_STAT_FDB_MISS);
+    }
+
+    if (mnet_flood(priv, skb, NULL, how))
+        mnet_stats_pkt(priv, MNET_STAT_TX_PACKETS, len);
+    else
+        mnet_stats_inc(priv, MNET_STAT_TX_DROPPED);
+    return;
+
+drop:
+    mnet_stats_inc(priv, MNET_STAT_TX_DROPPED);
+    dev_kfree_skb_any(skb);
+}
+
+static netdev_tx_t mnet_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    /* Read first, a handoff to the lower driver rewrites it */
+    bool more = netdev_xmit_more();
+
+    if (mnet_stage(profile, rcu_dereference_bh(priv->cfg)))
+        mnet_profile_tx(priv, skb);
+
+    if (priv->fq) {
+        mnet_fq_xmit(priv, skb);
+        return NETDEV_TX_OK;
+    }
+
+    mnet_forward_tx(priv, skb);
+    if (!more)
+        mnet_xmit_flush(priv);
+    return NETDEV_TX_OK;
+}
+
+/* -------------------- MTU -------------------- */
+/*
+ * mnet0 follows its lower devices: the MTU range is the intersection of
+ * theirs and the MTU is the smallest lower MTU, so nothing mnet0 sends is
+ * too big for a port and every frame a port receives fits mnet0. Raising
+ * mnet0's MTU raises the lower devices that are below it.
+ */
+static void mnet_mtu_sync(struct mnet_priv *priv)
+{
+    struct net_device *dev = priv->dev;
+    unsigned int min_mtu = ETH_MIN_MTU;
+    unsigned int max_mtu = ETH_MAX_MTU;
+    unsigned int mtu = ETH_MAX_MTU;
+    struct mnet_port *port;
+    int ret;
+
+    ASSERT_RTNL();
+
+    /* Lower MTU changes made by mnet_change_mtu() itself */
+    if (priv->mtu_sync || !priv->num_ports)
+        return;
+
+    list_for_each_entry(port, &priv->ports, list) {
+        min_mtu = max(min_mtu, port->dev->min_mtu);
+        if (port->dev->max_mtu)
+            max_mtu = min(max_mtu, port->dev->max_mtu);
+        mtu = min(mtu, port->dev->mtu);
+    }
+    max_mtu = max(max_mtu, min_mtu);
+
+    dev->min_mtu = min_mtu;
+    dev->max_mtu = max_mtu;
+    mtu = clamp(mtu, min_mtu, max_mtu);
+    if (dev->mtu == mtu)
+        return;
+
+    ret = dev_set_mtu(dev, mtu);
+    if (ret)
+        netdev_warn(dev, "failed to follow lower MTU %u (%d)\n", mtu, ret);
+}
+
+/* Lower ports are raised to @new_mtu; if one refuses, the others go back */
+static int mnet_change_mtu(struct net_device *dev, int new_mtu)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    struct mnet_port *port;
+    int ret = 0;
+
+    priv->mtu_sync = true;
+    list_for_each_entry(port, &priv->ports, list) {
+        port->old_mtu = port->dev->mtu;
+        if (port->dev->mtu >= new_mtu)
+            continue;
+        ret = dev_set_mtu(port->dev, new_mtu);
+        if (ret) {
+            netdev_err(dev, "%s refused MTU %d (%d)\n",
+                       port->dev->name, new_mtu, ret);
+            break;
+        }
+    }
+    if (ret) {
+        list_for_each_entry_continue_reverse(port, &priv->ports, list) {
+            if (port->dev->mtu != port->old_mtu &&
+                dev_set_mtu(port->dev, port->old_mtu))
+                netdev_warn(dev, "%s kept MTU %d\n", port->dev->name,
+                            new_mtu);
+        }
+    }
+    priv->mtu_sync = false;
+    if (ret)
+        return ret;
+
+    WRITE_ONCE(dev->mtu, new_mtu);
+    mnet_fq_set_mtu(priv);
+    /* Cached flows carry the old path MTU */
+    mnet_flow_delete_by_port(priv, NULL);
+    return 0;
+}
+
+/* -------------------- Lower ports -------------------- */
+static inline bool mnet_is_port(const struct net_device *dev)
+{
+    return rcu_access_pointer(dev->rx_handler) == mnet_rx_handler;
+}
+
+/* Only a burnt-in address identifies hardware; VLANs and macvlans copy it */
+static const u8 *mnet_lower_perm_addr(const struct net_device *dev)
+{
+    return dev->addr_assign_type == NET_ADDR_PERM &&
+           !is_zero_ether_addr(dev->perm_addr) ? dev->perm_addr : NULL;
+}
+
+static const char *mnet_lower_bus(const struct net_device *dev)
+{
+    return dev->dev.parent ? dev_name(dev->dev.parent) : NULL;
+}
+
+/* Remember what the slot's device looks like so a replug matches it */
+static void mnet_slot_learn(struct mnet_lower_slot *slot,
+                            const struct net_device *dev)
+{
+    const u8 *addr = mnet_lower_perm_addr(dev);
+    const char *bus = mnet_lower_bus(dev);
+
+    if (addr && strncmp(slot->spec, "mac=", 4))
+        ether_addr_copy(slot->addr, addr);
+    if (bus && strncmp(slot->spec, "bus=", 4))
+        strscpy(slot->bus, bus, sizeof(slot->bus));
+}
+
+static bool mnet_slot_match(const struct mnet_lower_slot *slot,
+                            const struct net_device *dev)
+{
+    const u8 *addr = mnet_lower_perm_addr(dev);
+    const char *bus = mnet_lower_bus(dev);
+
+    if (slot->name[0] && !strcmp(slot->name, dev->name))
+        return true;
+    if (addr && !is_zero_ether_addr(slot->addr) &&
+        ether_addr_equal(addr, slot->addr))
+        return true;
+    return bus && slot->bus[0] && !strcmp(bus, slot->bus);
+}
+
+static struct mnet_lower_slot *mnet_slot_alloc(const char *spec)
+{
+    struct mnet_lower_slot *slot;
+
+    if (strlen(spec) >= MNET_LOWER_SPEC_LEN)
+        return ERR_PTR(-EINVAL);
+
+    slot = kzalloc(sizeof(*slot), GFP_KERNEL);
+    if (!slot)
+        return ERR_PTR(-ENOMEM);
+    strscpy(slot->spec, spec, sizeof(slot->spec));
+
+    if (!strncmp(spec, "mac=", 4)) {
+        if (!mac_pton(spec + 4, slot->addr) || spec[4 + 17])
+            goto err;
+    } else if (!strncmp(spec, "bus=", 4)) {
+        if (!spec[4] || strscpy(slot->bus, spec + 4, sizeof(slot->bus)) < 0)
+            goto err;
+    } else {
+        if (!dev_valid_name(spec))
+            goto err;
+        strscpy(slot->name, spec, sizeof(slot->name));
+    }
+    return slot;
+err:
+    kfree(slot);
+    return ERR_PTR(-EINVAL);
+}
+
+/* A device of init_net that @slot could take, NULL if there is none */
+static struct net_device *mnet_slot_lookup(struct mnet_priv *priv,
+                                           const struct mnet_lower_slot *slot)
+{
+    struct net_device *dev;
+
+    ASSERT_RTNL();
+
+    /* By name first, MAC and bus-info are only fallbacks */
+    if (slot->name[0]) {
+        dev = __dev_get_by_name(&init_net, slot->name);
+        if (dev)
+            return dev;
+    }
+    for_each_netdev(&init_net, dev) {
+        if (dev != priv->dev && !mnet_is_port(dev) &&
+            mnet_slot_match(slot, dev))
+            return dev;
+    }
+    return NULL;
+}
+
+static int mnet_port_add(struct mnet_priv *priv, struct mnet_lower_slot *slot,
+                         struct net_device *lower_dev)
+{
+    struct mnet_port *port;
+    bool bridge;
+    int ret;
+
+    ASSERT_RTNL();
+
+    if (lower_dev == priv->dev)
+        return -ELOOP;
+
+    port = kzalloc(sizeof(*port), GFP_KERNEL);
+    if (!port)
+        return -ENOMEM;
+
+    port->dev = lower_dev;
+    port->mnet = priv->dev;
+    port->slot = slot;
+    port->tx_swts = mnet_lower_tx_swts(lower_dev);
+
+    ret = netdev_rx_handler_register(lower_dev, mnet_rx_handler, port);
+    if (ret) {
+        pr_err("%s: failed to attach RX handler to %s (%d)\n",
+               DRV_NAME, lower_dev->name, ret);
+        kfree(port);
+        return ret;
+    }
+
+    bridge = rtnl_dereference(priv->cfg)->mode == MNET_MODE_BRIDGE;
+
+    /* A bridge port has to see frames for every address behind it */
+    if (bridge) {
+        ret = dev_set_promiscuity(lower_dev, 1);
+        if (ret) {
+            netdev_rx_handler_unregister(lower_dev);
+            kfree(port);
+            return ret;
+        }
+    }
+
+    /* VLANs configured on mnet0 must pass the lower RX filter too */
+    ret = mnet_vlan_port_add(priv, port);
+    if (ret) {
+        if (bridge)
+            dev_set_promiscuity(lower_dev, -1);
+        netdev_rx_handler_unregister(lower_dev);
+        kfree(port);
+        return ret;
+    }
+
+    dev_hold(lower_dev);
+    list_add_tail_rcu(&port->list, &priv->ports);
+    WRITE_ONCE(priv->num_ports, priv->num_ports + 1);
+    slot->port = port;
+    mnet_slot_learn(slot, lower_dev);
+    mnet_mtu_sync(priv);
+
+    mnet_genl_notify_lower(priv, lower_dev, MNET_LOWER_ATTACHED);
+    pr_info("%s: attached %s\n", priv->dev->name, lower_dev->name);
+    return 0;
+}
+
+static void mnet_port_del(struct mnet_priv *priv, struct mnet_port *port)
+{
+    ASSERT_RTNL();
+
+    list_del_rcu(&port->list);
+    WRITE_ONCE(priv->num_ports, priv->num_ports - 1);
+    port->slot->port = NULL;
+
+    netdev_rx_handler_unregister(port->dev);
+    mnet_vlan_port_del(priv, port);
+    if (rtnl_dereference(priv->cfg)->mode == MNET_MODE_BRIDGE)
+        dev_set_promiscuity(port->dev, -1);
+
+    mnet_fdb_delete_by_port(priv, port);
+    mnet_flow_delete_by_port(priv, port);
+    mnet_mtu_sync(priv);
+    mnet_genl_notify_lower(priv, port->dev, MNET_LOWER_DETACHED);
+
+    /* TX may still hold the port through the list or an FDB entry */
+    synchronize_net();
+    dev_put(port->dev);
+    kfree(port);
+}
+
+static void mnet_slot_free(struct mnet_priv *priv, struct mnet_lower_slot *slot)
+{
+    if (slot->port)
+        mnet_port_del(priv, slot->port);
+    list_del(&slot->list);
+    kfree(slot);
+}
+
+static void mnet_del_ports(struct mnet_priv *priv)
+{
+    struct mnet_lower_slot *slot, *tmp;
+
+    list_for_each_entry_safe(slot, tmp, &priv->lower_slots, list)
+        mnet_slot_free(priv, slot);
+}
+
+/* The lower device of @port is being unregistered, keep its slot waiting */
+static void mnet_lower_gone(struct mnet_priv *priv, struct mnet_port *port)
+{
+    struct mnet_lower_slot *slot = port->slot;
+
+    pr_info("%s: %s unregistered, waiting for it to return\n",
+            priv->dev->name, port->dev->name);
+    mnet_port_del(priv, port);
+    slot->detached = jiffies;
+}
+
+/* @dev was registered or renamed: attach it to the first slot it fits */
+static void mnet_lower_appeared(struct mnet_priv *priv, struct net_device *dev)
+{
+    struct mnet_lower_slot *slot;
+
+    ASSERT_RTNL();
+
+    if (dev == priv->dev || !net_eq(dev_net(dev), &init_net))
+        return;
+
+    list_for_each_entry(slot, &priv->lower_slots, list) {
+        if (slot->port || !mnet_slot_match(slot, dev))
+            continue;
+        if (mnet_port_add(priv, slot, dev))
+            return;
+        if (slot->detached)
+            pr_info("%s: %s reattached after %u ms\n", priv->dev->name,
+                    dev->name, jiffies_to_msecs(jiffies - slot->detached));
+        return;
+    }
+}
+
+/* Slot for the entry @spec among @a and @b, by its text or current device */
+static struct mnet_lower_slot *mnet_slot_find(struct list_head *a,
+                                              struct list_head *b,
+                                              const char *spec)
+{
+    struct list_head *lists[] = { a, b };
+    struct mnet_lower_slot *slot;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(lists); i++) {
+        list_for_each_entry(slot, lists[i], list) {
+            if (!strcmp(slot->spec, spec) ||
+                (slot->port && !strcmp(slot->port->dev->name, spec)))
+                return slot;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Make the slot list match @names: slots that stay are left untouched so
+ * their traffic is not interrupted, new ones are attached, the rest are
+ * detached. Every new entry must match a device now; hot-plug only brings
+ * back devices that went away after being attached.
+ */
+int mnet_set_lower(struct mnet_priv *priv, const char *names)
+{
+    struct mnet_lower_slot *slot, *tmp;
+    struct net_device *dev;
+    char *buf, *cur, *name;
+    LIST_HEAD(slots);
+    int ret = 0;
+
+    ASSERT_RTNL();
+
+    buf = kstrdup(names, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    cur = buf;
+    while ((name = strsep(&cur, ",")) != NULL) {
+        name = strim(name);
+        if (!*name)
+            continue;
+
+        slot = mnet_slot_find(&slots, &priv->lower_slots, name);
+        if (slot) {
+            list_move_tail(&slot->list, &slots);
+            continue;
+        }
+
+        slot = mnet_slot_alloc(name);
+        if (IS_ERR(slot)) {
+            ret = PTR_ERR(slot);
+            goto out;
+        }
+
+        dev = mnet_slot_lookup(priv, slot);
+        if (!dev) {
+            pr_err("%s: %s not found\n", DRV_NAME, name);
+            kfree(slot);
+            ret = -ENODEV;
+            goto out;
+        }
+
+        ret = mnet_port_add(priv, slot, dev);
+        if (ret) {
+            kfree(slot);
+            goto out;
+        }
+        list_add_tail(&slot->list, &slots);
+    }
+
+    if (list_empty(&slots)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    list_for_each_entry_safe(slot, tmp, &priv->lower_slots, list)
+        mnet_slot_free(priv, slot);
+
+    if (!priv->num_ports)
+        ret = -ENODEV;
+out:
+    /* On error the slots attached so far are kept, as are the old ones */
+    list_splice_tail(&slots, &priv->lower_slots);
+    kfree(buf);
+    return ret;
+}
+
+/* 'lower' in sysfs: attached devices by name, waiting slots as (entry) */
+ssize_t mnet_lower_print(struct mnet_priv *priv, char *buf)
+{
+    struct mnet_lower_slot *slot;
+    ssize_t len = 0;
+
+    ASSERT_RTNL();
+
+    list_for_each_entry(slot, &priv->lower_slots, list) {
+        if (slot->port)
+            len += sysfs_emit_at(buf, len, "%s%s", len ? "," : "",
+                                 slot->port->dev->name);
+        else
+            len += sysfs_emit_at(buf, len, "%s(%s)", len ? "," : "",
+                                 slot->spec);
+    }
+
+    len += sysfs_emit_at(buf, len, "\n");
+    return len;
+}
+
+/* -------------------- Open / Stop -------------------- */
+static int mnet_open(struct net_device *dev)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    napi_enable(&priv->napi);
+    netif_start_queue(dev);
+    pr_info("%s: device opened\n", dev->name);
+    return 0;
+}
+
+static int mnet_stop(struct net_device *dev)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    napi_disable(&priv->napi);
+    netif_stop_queue(dev);
+    mnet_fq_purge(priv);
+    pr_info("%s: device stopped\n", dev->name);
+    return 0;
+}
+
+/* -------------------- Timestamping -------------------- */
+/* Hardware timestamping config goes to the lower device, as for VLANs */
+static int mnet_eth_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    const struct net_device_ops *ops;
+    struct net_device *lower;
+    struct ifreq ifrr;
+    int ret;
+
+    if (cmd != SIOCSHWTSTAMP && cmd != SIOCGHWTSTAMP)
+        return -EOPNOTSUPP;
+
+    /* Which PHC would a second port use? */
+    if (priv->num_ports != 1)
+        return -EOPNOTSUPP;
+
+    lower = list_first_entry(&priv->ports, struct mnet_port, list)->dev;
+    ops = lower->netdev_ops;
+    if (!ops->ndo_eth_ioctl || !netif_device_present(lower))
+        return -EOPNOTSUPP;
+
+    strscpy(ifrr.ifr_name, lower->name, IFNAMSIZ);
+    ifrr.ifr_ifru = ifr->ifr_ifru;
+    ret = ops->ndo_eth_ioctl(lower, &ifrr, cmd);
+    if (!ret)
+        ifr->ifr_ifru = ifrr.ifr_ifru;
+    return ret;
+}
+
+/* -------------------- Netdevice notifier -------------------- */
+static int mnet_netdev_event(struct notifier_block *nb, unsigned long event,
+                             void *ptr)
+{
+    struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+    struct mnet_port *port;
+    struct mnet_priv *priv;
+
+    /* The collector's egress device need not be a port */
+    mnet_encap_netdev_event(netdev_priv(mnet_dev), dev, event);
+
+    if (!mnet_is_port(dev)) {
+        /* A lower device coming back, possibly under another name */
+        if (event == NETDEV_REGISTER || event == NETDEV_CHANGENAME)
+            mnet_lower_appeared(netdev_priv(mnet_dev), dev);
+        return NOTIFY_DONE;
+    }
+
+    port = rtnl_dereference(dev->rx_handler_data);
+    priv = netdev_priv(port->mnet);
+
+    switch (event) {
+    case NETDEV_UNREGISTER:
+        mnet_lower_gone(priv, port);
+        break;
+    case NETDEV_CHANGEMTU:
+        mnet_mtu_sync(priv);
+        break;
+    case NETDEV_UP:
+    case NETDEV_DOWN:
+    case NETDEV_CHANGE:
+        mnet_genl_notify_lower(priv, dev,
+                               netif_running(dev) && netif_carrier_ok(dev) ?
+                               MNET_LOWER_UP : MNET_LOWER_DOWN);
+        break;
+    }
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block mnet_notifier = {
+    .notifier_call = mnet_netdev_event,
+};
+
+/* -------------------- Setup -------------------- */
+static const struct net_device_ops mnet_netdev_ops = {
+    .ndo_open             = mnet_open,
+    .ndo_stop             = mnet_stop,
+    .ndo_start_xmit       = mnet_start_xmit,
+    .ndo_change_mtu       = mnet_change_mtu,
+    .ndo_eth_ioctl        = mnet_eth_ioctl,
+    .ndo_select_queue     = mnet_select_queue,
+    .ndo_vlan_rx_add_vid  = mnet_vlan_rx_add_vid,
+    .ndo_vlan_rx_kill_vid = mnet_vlan_rx_kill_vid,
+    .ndo_get_stats64      = mnet_get_stats64,
+};
+
+static void mnet_setup(struct net_device *dev)
+{
+    ether_setup(dev);
+    dev->netdev_ops = &mnet_netdev_ops;
+    dev->ethtool_ops = &mnet_ethtool_ops;
+    eth_hw_addr_random(dev);
+    dev->flags |= IFF_NOARP;
+    /* TX state is per-CPU or RCU, no need for the netdev TX lock */
+    dev->features |= NETIF_F_LLTX;
+    mnet_vlan_setup(dev);
+}
+
+/* -------------------- debugfs -------------------- */
+static int mnet_debugfs_rx_get(void *data, u64 *val)
+{
+    *val = mnet_stats_read(data, MNET_STAT_RX_PACKETS);
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(mnet_rx_packets_fops, mnet_debugfs_rx_get, NULL,
+                         "%llu\n");
+
+static int mnet_debugfs_tx_get(void *data, u64 *val)
+{
+    *val = mnet_stats_read(data, MNET_STAT_TX_PACKETS);
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(mnet_tx_packets_fops, mnet_debugfs_tx_get, NULL,
+                         "%llu\n");
+
+static int mnet_stats_show(struct seq_file *m, void *v)
+{
+    u64 cnt[MNET_STAT_NUM];
+    int i;
+
+    mnet_stats_fold(m->private, cnt);
+    for (i = 0; i < MNET_STAT_NUM; i++)
+        seq_printf(m, "%-16s %llu\n", mnet_stat_names[i], cnt[i]);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mnet_stats);
+
+DEFINE_SHOW_ATTRIBUTE(mnet_fdb);
+DEFINE_SHOW_ATTRIBUTE(mnet_flow);
+DEFINE_SHOW_ATTRIBUTE(mnet_fq);
+DEFINE_SHOW_ATTRIBUTE(mnet_xmit);
+DEFINE_SHOW_ATTRIBUTE(mnet_rxcopy);
+DEFINE_SHOW_ATTRIBUTE(mnet_profile);
+
+static void mnet_debugfs_init(struct mnet_priv *priv)
+{
+    mnet_debug_dir = debugfs_create_dir("mnet", NULL);
+    if (IS_ERR_OR_NULL(mnet_debug_dir))
+        return;
+
+    debugfs_create_file_unsafe("tx_packets", 0444, mnet_debug_dir, priv,
+                               &mnet_tx_packets_fops);
+    debugfs_create_file_unsafe("rx_packets", 0444, mnet_debug_dir, priv,
+                               &mnet_rx_packets_fops);
+    debugfs_create_file("stats", 0444, mnet_debug_dir, priv,
+                        &mnet_stats_fops);
+    debugfs_create_file("fdb", 0444, mnet_debug_dir, priv, &mnet_fdb_fops);
+    debugfs_create_atomic_t("fdb_size", 0444, mnet_debug_dir,
+                            &priv->fdb_count);
+    debugfs_create_file("flows", 0444, mnet_debug_dir, priv, &mnet_flow_fops);
+    debugfs_create_atomic_t("flow_count", 0444, mnet_debug_dir,
+                            &priv->flow_count);
+    debugfs_create_file("fq", 0444, mnet_debug_dir, priv, &mnet_fq_fops);
+    debugfs_create_file("xmit_batch", 0444, mnet_debug_dir, priv,
+                        &mnet_xmit_fops);
+    debugfs_create_file("rx_copy", 0444, mnet_debug_dir, priv,
+                        &mnet_rxcopy_fops);
+    debugfs_create_file("profile", 0444, mnet_debug_dir, priv,
+                        &mnet_profile_fops);
+    debugfs_create_file("prio_map", 0644, mnet_debug_dir, priv,
+                        &mnet_prio_fops);
+    debugfs_create_file("vlan_filter", 0644, mnet_debug_dir, priv,
+                        &mnet_vlan_filter_fops);
+    debugfs_create_file("top_talkers", 0644, mnet_debug_dir, priv,
+                        &mnet_top_fops);
+    debugfs_create_file("sketch", 0644, mnet_debug_dir, priv,
+                        &mnet_sketch_fops);
+    mnet_bench_init(priv, mnet_debug_dir);
+}
+
+/* -------------------- Init / Exit -------------------- */
+static int __init mnet_init(void)
+{
+    int ret, mode_val;
+    struct mnet_priv *priv;
+
+    ret = mnet_fdb_cache_init();
+    if (ret)
+        return ret;
+
+    ret = mnet_flow_cache_init();
+    if (ret)
+        goto err_cache;
+
+    /* One TX queue per priority band */
+    mnet_dev = alloc_netdev_mqs(sizeof(struct mnet_priv), "mnet%d",
+                                NET_NAME_UNKNOWN, mnet_setup,
+                                MNET_NUM_BANDS, 1);
+    if (!mnet_dev) {
+        ret = -ENOMEM;
+        goto err_flow_cache;
+    }
+
+    priv = netdev_priv(mnet_dev);
+    priv->dev = mnet_dev;
+    spin_lock_init(&priv->lock);
+    INIT_LIST_HEAD(&priv->ports);
+    INIT_LIST_HEAD(&priv->lower_slots);
+    /* TX NAPI, only scheduled by the fq scheduler */
+    netif_napi_add(mnet_dev, &priv->napi, mnet_fq_poll);
+
+    mode_val = mnet_mode_parse(mode);
+    if (mode_val < 0) {
+        pr_err("%s: unknown mode '%s'\n", DRV_NAME, mode);
+        ret = -EINVAL;
+        goto err_free;
+    }
+
+    if (!sysfs_streq(prio_mode, "strict") &&
+        !sysfs_streq(prio_mode, "weighted")) {
+        pr_err("%s: unknown prio_mode '%s'\n", DRV_NAME, prio_mode);
+        ret = -EINVAL;
+        goto err_free;
+    }
+    mnet_prio_init(priv, sysfs_streq(prio_mode, "strict"), prio_weight);
+
+    ret = mnet_config_init(priv, mode_val, flow_offload, snaplen, sample_rate);
+    if (ret)
+        goto err_free;
+
+    priv->pcpu_stats = netdev_alloc_pcpu_stats(struct mnet_pcpu_stats);
+    if (!priv->pcpu_stats) {
+        ret = -ENOMEM;
+        goto err_config;
+    }
+
+    ret = mnet_top_init(priv);
+    if (ret)
+        goto err_stats;
+
+    ret = mnet_sketch_init(priv);
+    if (ret)
+        goto err_top;
+
+    ret = mnet_encap_init(priv);
+    if (ret)
+        goto err_sketch;
+
+    ret = mnet_xmit_init(priv);
+    if (ret)
+        goto err_encap;
+
+    ret = mnet_rxcopy_init(priv);
+    if (ret)
+        goto err_xmit;
+
+    ret = mnet_profile_init(priv);
+    if (ret)
+        goto err_rxcopy;
+
+    priv->ageing_time = msecs_to_jiffies(ageing_time * MSEC_PER_SEC);
+    mnet_fdb_init(priv);
+
+    priv->flow_timeout = msecs_to_jiffies(flow_timeout * MSEC_PER_SEC);
+    mnet_flow_init(priv);
+
+    if (fq) {
+        ret = mnet_fq_init(priv, fq_limit, fq_target_us, fq_interval_us);
+        if (ret)
+            goto err_fdb;
+    }
+
+    ret = register_netdev(mnet_dev);
+    if (ret) {
+        pr_err("%s: register_netdev failed (%d)\n", DRV_NAME, ret);
+        goto err_fdb;
+    }
+
+    ret = register_netdevice_notifier(&mnet_notifier);
+    if (ret)
+        goto err_unregister;
+
+    rtnl_lock();
+    ret = mnet_set_lower(priv, lower);
+    if (ret)
+        mnet_del_ports(priv);
+    rtnl_unlock();
+
+    if (ret) {
+        pr_err("%s: failed to attach lower devices '%s' (%d)\n",
+               DRV_NAME, lower, ret);
+        goto err_notifier;
+    }
+
+    mnet_debugfs_init(priv);
+
+    ret = mnet_genl_init(priv);
+    if (ret)
+        pr_warn("%s: generic netlink unavailable (%d)\n", DRV_NAME, ret);
+
+    pr_info("%s: registered successfully, %s %s <-> %s\n",
+            DRV_NAME, mode_val == MNET_MODE_BRIDGE ? "bridging" : "mirroring",
+            lower, mnet_dev->name);
+    return 0;
+
+err_notifier:
+    unregister_netdevice_notifier(&mnet_notifier);
+err_unregister:
+    unregister_netdev(mnet_dev);
+err_fdb:
+    mnet_fq_fini(priv);
+    mnet_flow_fini(priv);
+    mnet_fdb_fini(priv);
+    mnet_profile_fini(priv);
+err_rxcopy:
+    mnet_rxcopy_fini(priv);
+err_xmit:
+    mnet_xmit_fini(priv);
+err_encap:
+    mnet_encap_fini(priv);
+err_sketch:
+    mnet_sketch_fini(priv);
+err_top:
+    mnet_top_fini(priv);
+err_stats:
+    free_percpu(priv->pcpu_stats);
+err_config:
+    mnet_config_fini(priv);
+err_free:
+    free_netdev(mnet_dev);
+err_flow_cache:
+    mnet_flow_cache_fini();
+err_cache:
+    mnet_fdb_cache_fini();
+    return ret;
+}
+
+static void __exit mnet_exit(void)
+{
+    struct mnet_priv *priv = netdev_priv(mnet_dev);
+
+    mnet_genl_fini(priv);
+    debugfs_remove_recursive(mnet_debug_dir);
+    mnet_bench_fini(priv);
+
+    rtnl_lock();
+    mnet_del_ports(priv);
+    rtnl_unlock();
+
+    unregister_netdevice_notifier(&mnet_notifier);
+    unregister_netdev(mnet_dev);
+    mnet_fq_fini(priv);
+    mnet_flow_fini(priv);
+    mnet_fdb_fini(priv);
+    mnet_profile_fini(priv);
+    mnet_rxcopy_fini(priv);
+    mnet_xmit_fini(priv);
+    mnet_encap_fini(priv);
+    mnet_sketch_fini(priv);
+    mnet_top_fini(priv);
+    free_percpu(priv->pcpu_stats);
+    mnet_config_fini(priv);
+    free_netdev(mnet_dev);
+    mnet_flow_cache_fini();
+    mnet_fdb_cache_fini();
+    pr_info("%s: module unloaded\n", DRV_NAME);
+}
+
+module_init(mnet_init);
+module_exit(mnet_exit);
+
+MODULE_AUTHOR("Karthik Revoor");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("AESD Final Project - MNET Ethernet Bridge Driver (Real RX via eth0)");
+MODULE_VERSION(DRV_VERSION);
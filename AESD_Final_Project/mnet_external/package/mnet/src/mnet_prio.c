@@ -0,0 +1,199 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/pkt_sched.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <net/dsfield.h>
+
+#include "mnet.h"
+
+/*
+ * Priority classification for mnet0 TX.
+ *
+ * mnet0 has MNET_NUM_BANDS TX queues, band 0 being the most urgent.
+ * mnet_select_queue() picks the band from the 802.1p PCP of tagged frames,
+ * from the DSCP of IP packets, or from skb->priority otherwise. The fq
+ * scheduler serves the bands in strict or weighted order, and the band is
+ * carried down to the lower device as skb->priority so its qdisc
+ * (pfifo_fast priomap, mqprio) keeps the same ordering.
+ */
+
+/* skb->priority (TC_PRIO_*) to band, for frames without PCP or DSCP */
+static const u8 mnet_prio2band[TC_PRIO_MAX + 1] = {
+    2, 3, 3, 3, 2, 3, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2
+};
+
+/* band to skb->priority handed to the lower device */
+static const u32 mnet_band2prio[MNET_NUM_BANDS] = {
+    TC_PRIO_CONTROL, TC_PRIO_INTERACTIVE, TC_PRIO_BESTEFFORT, TC_PRIO_BULK
+};
+
+/* 802.1p: 7,6 network control; 5,4 voice/video; 3,0 best effort; 2,1 bulk */
+static const u8 mnet_default_pcp_map[8] = { 2, 3, 3, 2, 1, 1, 0, 0 };
+
+static inline u8 mnet_pcp_band(struct mnet_priv *priv, u16 tci)
+{
+    return READ_ONCE(priv->pcp_map[(tci & VLAN_PRIO_MASK) >> VLAN_PRIO_SHIFT]);
+}
+
+u8 mnet_prio_classify(struct mnet_priv *priv, struct sk_buff *skb)
+{
+    unsigned int nhoff = skb_network_offset(skb);
+    u16 tci;
+    u8 dscp;
+
+    if (skb_vlan_tag_present(skb))
+        return mnet_pcp_band(priv, skb_vlan_tag_get(skb));
+    if (eth_type_vlan(skb->protocol) && !__vlan_get_tag(skb, &tci))
+        return mnet_pcp_band(priv, tci);
+
+    switch (skb->protocol) {
+    case htons(ETH_P_IP): {
+        struct iphdr _iph;
+        const struct iphdr *iph;
+
+        iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+        if (!iph)
+            break;
+        dscp = ipv4_get_dsfield(iph) >> 2;
+        return READ_ONCE(priv->dscp_map[dscp]);
+    }
+    case htons(ETH_P_IPV6): {
+        struct ipv6hdr _ip6h;
+        const struct ipv6hdr *ip6h;
+
+        ip6h = skb_header_pointer(skb, nhoff, sizeof(_ip6h), &_ip6h);
+        if (!ip6h)
+            break;
+        dscp = ipv6_get_dsfield(ip6h) >> 2;
+        return READ_ONCE(priv->dscp_map[dscp]);
+    }
+    }
+
+    return mnet_prio2band[skb->priority & TC_PRIO_MAX];
+}
+
+/* With fewer channels than bands the least urgent bands share a queue */
+u16 mnet_select_queue(struct net_device *dev, struct sk_buff *skb,
+                      struct net_device *sb_dev)
+{
+    u16 band = mnet_prio_classify(netdev_priv(dev), skb);
+
+    return min_t(u16, band, dev->real_num_tx_queues - 1);
+}
+
+/* Called right before the skb is handed to a lower device */
+void mnet_prio_tx(struct mnet_priv *priv, struct sk_buff *skb)
+{
+    u16 band = skb_get_queue_mapping(skb) % MNET_NUM_BANDS;
+
+    skb->priority = mnet_band2prio[band];
+    mnet_stats_pkt(priv, MNET_STAT_TX_BAND0_PACKETS + 2 * band, skb->len);
+}
+
+/* -------------------- debugfs -------------------- */
+int mnet_prio_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    int i;
+
+    seq_printf(m, "mode %s\n", priv->prio_strict ? "strict" : "weighted");
+    seq_puts(m, "weight");
+    for (i = 0; i < MNET_NUM_BANDS; i++)
+        seq_printf(m, " %u", priv->prio_weight[i]);
+    seq_puts(m, "\npcp   ");
+    for (i = 0; i < ARRAY_SIZE(priv->pcp_map); i++)
+        seq_printf(m, " %u", priv->pcp_map[i]);
+    for (i = 0; i < ARRAY_SIZE(priv->dscp_map); i++) {
+        if (i % 8 == 0)
+            seq_printf(m, "\ndscp%02d", i);
+        seq_printf(m, " %u", priv->dscp_map[i]);
+    }
+    seq_putc(m, '\n');
+    return 0;
+}
+
+/*
+ * Accepts one command per write:
+ *   pcp <0-7> <band>      dscp <0-63> <band>
+ *   weight <band> <1-64>  mode strict|weighted
+ */
+int mnet_prio_parse(struct mnet_priv *priv, const char *cmd)
+{
+    unsigned int idx, val;
+    char word[16];
+
+    if (sscanf(cmd, "pcp %u %u", &idx, &val) == 2) {
+        if (idx >= ARRAY_SIZE(priv->pcp_map) || val >= MNET_NUM_BANDS)
+            return -EINVAL;
+        WRITE_ONCE(priv->pcp_map[idx], val);
+    } else if (sscanf(cmd, "dscp %u %u", &idx, &val) == 2) {
+        if (idx >= ARRAY_SIZE(priv->dscp_map) || val >= MNET_NUM_BANDS)
+            return -EINVAL;
+        WRITE_ONCE(priv->dscp_map[idx], val);
+    } else if (sscanf(cmd, "weight %u %u", &idx, &val) == 2) {
+        if (idx >= MNET_NUM_BANDS || !val || val > 64)
+            return -EINVAL;
+        WRITE_ONCE(priv->prio_weight[idx], val);
+    } else if (sscanf(cmd, "mode %15s", word) == 1) {
+        if (sysfs_streq(word, "strict"))
+            WRITE_ONCE(priv->prio_strict, true);
+        else if (sysfs_streq(word, "weighted"))
+            WRITE_ONCE(priv->prio_strict, false);
+        else
+            return -EINVAL;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int mnet_prio_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_prio_show, inode->i_private);
+}
+
+static ssize_t mnet_prio_write(struct file *file, const char __user *ubuf,
+                               size_t count, loff_t *ppos)
+{
+    struct mnet_priv *priv = ((struct seq_file *)file->private_data)->private;
+    char buf[64];
+    int ret;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    ret = mnet_prio_parse(priv, buf);
+    return ret ? ret : count;
+}
+
+const struct file_operations mnet_prio_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_prio_open,
+    .read    = seq_read,
+    .write   = mnet_prio_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/* -------------------- Init -------------------- */
+void mnet_prio_init(struct mnet_priv *priv, bool strict, const u32 *weight)
+{
+    int i;
+
+    memcpy(priv->pcp_map, mnet_default_pcp_map, sizeof(priv->pcp_map));
+
+    /* DSCP class selector bits behave like the PCP of the same value */
+    for (i = 0; i < ARRAY_SIZE(priv->dscp_map); i++)
+        priv->dscp_map[i] = mnet_default_pcp_map[i >> 3];
+
+    priv->prio_strict = strict;
+    for (i = 0; i < MNET_NUM_BANDS; i++)
+        priv->prio_weight[i] = clamp_t(u32, weight[i], 1, 64);
+}
@@ -0,0 +1,268 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/u64_stats_sync.h>
+
+#include "mnet.h"
+
+/*
+ * Traffic profile.
+ *
+ * With sysfs profile=1 every frame received on a lower port and every
+ * frame sent on mnet0 is counted by size and by protocol, so CPU time per
+ * packet can be read against the traffic mix that caused it. Sizes are
+ * wire sizes, VLAN tag and FCS included, in the RFC 2819 buckets up to a
+ * tagged 1522 and one bucket for jumbo frames; byte counters leave out
+ * the FCS like rx_bytes and tx_bytes do. Protocols are IPv4 and IPv6
+ * split by TCP, UDP, ICMP and anything else (IPv6 extension headers
+ * included), ARP, and everything else.
+ *
+ * The bucket comes from fls() and the L4 class from a 256-entry table
+ * indexed by the protocol byte, so an update is one switch on the
+ * ethertype, one header byte and three counters in this CPU's block.
+ * debugfs profile merges the CPUs into one table.
+ */
+
+enum mnet_profile_dir {
+    MNET_PROFILE_RX,            // lower ports, in the rx_handler
+    MNET_PROFILE_TX,            // mnet0 ndo_start_xmit
+    MNET_PROFILE_DIRS,
+};
+
+#define MNET_PROFILE_SIZES  7
+
+/* IPv4 and IPv6 rows are each followed by their MNET_L4_* rows */
+enum mnet_profile_proto {
+    MNET_PROFILE_IPV4,
+    MNET_PROFILE_IPV4_TCP,
+    MNET_PROFILE_IPV4_UDP,
+    MNET_PROFILE_IPV4_ICMP,
+    MNET_PROFILE_IPV6,
+    MNET_PROFILE_IPV6_TCP,
+    MNET_PROFILE_IPV6_UDP,
+    MNET_PROFILE_IPV6_ICMP,
+    MNET_PROFILE_ARP,
+    MNET_PROFILE_OTHER,
+    MNET_PROFILE_PROTOS,
+};
+
+enum {
+    MNET_L4_OTHER,
+    MNET_L4_TCP,
+    MNET_L4_UDP,
+    MNET_L4_ICMP,
+};
+
+struct mnet_profile {
+    u64_stats_t size[MNET_PROFILE_DIRS][MNET_PROFILE_SIZES];
+    u64_stats_t packets[MNET_PROFILE_DIRS][MNET_PROFILE_PROTOS];
+    u64_stats_t bytes[MNET_PROFILE_DIRS][MNET_PROFILE_PROTOS];
+    struct u64_stats_sync syncp;
+};
+
+/* The same counters as plain numbers, read from one CPU or summed */
+struct mnet_profile_snap {
+    u64 size[MNET_PROFILE_DIRS][MNET_PROFILE_SIZES];
+    u64 packets[MNET_PROFILE_DIRS][MNET_PROFILE_PROTOS];
+    u64 bytes[MNET_PROFILE_DIRS][MNET_PROFILE_PROTOS];
+};
+
+static const u8 mnet_l4_class[256] = {
+    [IPPROTO_TCP]    = MNET_L4_TCP,
+    [IPPROTO_UDP]    = MNET_L4_UDP,
+    [IPPROTO_ICMP]   = MNET_L4_ICMP,
+    [IPPROTO_ICMPV6] = MNET_L4_ICMP,
+};
+
+static const char *const mnet_profile_size_names[MNET_PROFILE_SIZES] = {
+    "64", "65-127", "128-255", "256-511", "512-1023", "1024-1522", "jumbo",
+};
+
+static const char *const mnet_profile_proto_names[MNET_PROFILE_PROTOS] = {
+    [MNET_PROFILE_IPV4]      = "ipv4/other",
+    [MNET_PROFILE_IPV4_TCP]  = "ipv4/tcp",
+    [MNET_PROFILE_IPV4_UDP]  = "ipv4/udp",
+    [MNET_PROFILE_IPV4_ICMP] = "ipv4/icmp",
+    [MNET_PROFILE_IPV6]      = "ipv6/other",
+    [MNET_PROFILE_IPV6_TCP]  = "ipv6/tcp",
+    [MNET_PROFILE_IPV6_UDP]  = "ipv6/udp",
+    [MNET_PROFILE_IPV6_ICMP] = "ipv6/icmp",
+    [MNET_PROFILE_ARP]       = "arp",
+    [MNET_PROFILE_OTHER]     = "other",
+};
+
+/* -------------------- Fast path -------------------- */
+/*
+ * @len without FCS. 0: up to 64 bytes on the wire, runts included, then
+ * one bucket per power of two up to 1023, 5 for 1024-1522 and 6 above.
+ */
+static inline unsigned int mnet_profile_size(unsigned int len)
+{
+    unsigned int wire = len + ETH_FCS_LEN;
+
+    return min_t(unsigned int, fls(wire >> 6) - (wire == 64), 5) +
+           (wire > VLAN_ETH_FRAME_LEN + ETH_FCS_LEN);
+}
+
+/* @nhoff: offset of the network header from skb->data */
+static inline unsigned int mnet_profile_proto(const struct sk_buff *skb,
+                                              __be16 proto, int nhoff)
+{
+    unsigned int row;
+    const u8 *p;
+    u8 buf;
+
+    switch (proto) {
+    case htons(ETH_P_IP):
+        row = MNET_PROFILE_IPV4;
+        nhoff += offsetof(struct iphdr, protocol);
+        break;
+    case htons(ETH_P_IPV6):
+        row = MNET_PROFILE_IPV6;
+        nhoff += offsetof(struct ipv6hdr, nexthdr);
+        break;
+    case htons(ETH_P_ARP):
+        return MNET_PROFILE_ARP;
+    default:
+        return MNET_PROFILE_OTHER;
+    }
+
+    p = skb_header_pointer(skb, nhoff, sizeof(buf), &buf);
+    return p ? row + mnet_l4_class[*p] : row;
+}
+
+static void mnet_profile_add(struct mnet_priv *priv, unsigned int dir,
+                             unsigned int size, unsigned int proto,
+                             unsigned int len)
+{
+    struct mnet_profile *p = this_cpu_ptr(priv->profile);
+
+    u64_stats_update_begin(&p->syncp);
+    u64_stats_inc(&p->size[dir][size]);
+    u64_stats_inc(&p->packets[dir][proto]);
+    u64_stats_add(&p->bytes[dir][proto], len);
+    u64_stats_update_end(&p->syncp);
+}
+
+/* rx_handler: skb->data is at the network header, the tag out of band */
+void mnet_profile_rx(struct mnet_priv *priv, const struct sk_buff *skb)
+{
+    unsigned int len = skb->len + ETH_HLEN +
+                       skb_vlan_tag_present(skb) * VLAN_HLEN;
+
+    mnet_profile_add(priv, MNET_PROFILE_RX, mnet_profile_size(len),
+                     mnet_profile_proto(skb, skb->protocol, 0), len);
+}
+
+/*
+ * ndo_start_xmit: skb->data is at the MAC header. skb->protocol is not
+ * used, packet sockets set it to whatever they were bound to.
+ */
+void mnet_profile_tx(struct mnet_priv *priv, const struct sk_buff *skb)
+{
+    unsigned int len = skb->len + skb_vlan_tag_present(skb) * VLAN_HLEN;
+
+    mnet_profile_add(priv, MNET_PROFILE_TX, mnet_profile_size(len),
+                     mnet_profile_proto(skb, eth_hdr(skb)->h_proto,
+                                        ETH_HLEN), len);
+}
+
+/* -------------------- debugfs -------------------- */
+static void mnet_profile_read(struct mnet_priv *priv,
+                              struct mnet_profile_snap *sum)
+{
+    const struct mnet_profile *p;
+    struct mnet_profile_snap v;
+    unsigned int start;
+    int cpu, d, i;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        p = per_cpu_ptr(priv->profile, cpu);
+        do {
+            start = u64_stats_fetch_begin(&p->syncp);
+            for (d = 0; d < MNET_PROFILE_DIRS; d++) {
+                for (i = 0; i < MNET_PROFILE_SIZES; i++)
+                    v.size[d][i] = u64_stats_read(&p->size[d][i]);
+                for (i = 0; i < MNET_PROFILE_PROTOS; i++) {
+                    v.packets[d][i] = u64_stats_read(&p->packets[d][i]);
+                    v.bytes[d][i] = u64_stats_read(&p->bytes[d][i]);
+                }
+            }
+        } while (u64_stats_fetch_retry(&p->syncp, start));
+
+        for (d = 0; d < MNET_PROFILE_DIRS; d++) {
+            for (i = 0; i < MNET_PROFILE_SIZES; i++)
+                sum->size[d][i] += v.size[d][i];
+            for (i = 0; i < MNET_PROFILE_PROTOS; i++) {
+                sum->packets[d][i] += v.packets[d][i];
+                sum->bytes[d][i] += v.bytes[d][i];
+            }
+        }
+    }
+}
+
+int mnet_profile_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    struct mnet_profile_snap *sum;
+    bool on;
+    int i;
+
+    /* Too big for the stack with the per-CPU copy next to it */
+    sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    mnet_profile_read(priv, sum);
+
+    rcu_read_lock();
+    on = rcu_dereference(priv->cfg)->profile;
+    rcu_read_unlock();
+    if (!on)
+        seq_puts(m, "# not counting, sysfs profile is 0\n");
+
+    seq_printf(m, "%-12s %14s %14s\n", "size", "rx_packets", "tx_packets");
+    for (i = 0; i < MNET_PROFILE_SIZES; i++)
+        seq_printf(m, "%-12s %14llu %14llu\n", mnet_profile_size_names[i],
+                   sum->size[MNET_PROFILE_RX][i],
+                   sum->size[MNET_PROFILE_TX][i]);
+
+    seq_printf(m, "\n%-12s %14s %14s %14s %14s\n", "protocol",
+               "rx_packets", "rx_bytes", "tx_packets", "tx_bytes");
+    for (i = 0; i < MNET_PROFILE_PROTOS; i++)
+        seq_printf(m, "%-12s %14llu %14llu %14llu %14llu\n",
+                   mnet_profile_proto_names[i],
+                   sum->packets[MNET_PROFILE_RX][i],
+                   sum->bytes[MNET_PROFILE_RX][i],
+                   sum->packets[MNET_PROFILE_TX][i],
+                   sum->bytes[MNET_PROFILE_TX][i]);
+
+    kfree(sum);
+    return 0;
+}
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_profile_init(struct mnet_priv *priv)
+{
+    int cpu;
+
+    priv->profile = alloc_percpu(struct mnet_profile);
+    if (!priv->profile)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu)
+        u64_stats_init(&per_cpu_ptr(priv->profile, cpu)->syncp);
+    return 0;
+}
+
+void mnet_profile_fini(struct mnet_priv *priv)
+{
+    free_percpu(priv->profile);
+}
@@ -0,0 +1,237 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/skbuff.h>
+#include <net/page_pool.h>
+
+#include "mnet.h"
+
+/*
+ * Copy-break for frames handed up to mnet0.
+ *
+ * A clone shares the lower driver's data buffer, which for most NICs is a
+ * page or a 2 KB slot of the RX ring, so a socket sitting on 64-byte
+ * mirrored frames keeps the lower ring short of buffers. Frames of at most
+ * sysfs copybreak bytes (MAC header included, after the snaplen cut) are
+ * instead copied into a fragment of a page from this CPU's page_pool and
+ * the lower buffer goes back to its driver right away. Larger frames are
+ * cloned as before.
+ *
+ * The pools are not DMA mapped and are only allocated from on their own
+ * CPU in the rx_handler, BH disabled, which is all page_pool asks of the
+ * alloc side. Copies are marked for recycling, so when the stack frees them
+ * their pages return to the pool's ring from any CPU. debugfs rx_copy
+ * reports the copy/clone split and, with CONFIG_PAGE_POOL_STATS, how many
+ * pages were recycled.
+ */
+
+#define MNET_RXCOPY_POOL_SIZE   256     // pages per CPU
+
+/* Room for the copy, headroom and skb_shared_info in one pool fragment */
+static inline unsigned int mnet_rxcopy_truesize(unsigned int len)
+{
+    return SKB_DATA_ALIGN(NET_SKB_PAD + NET_IP_ALIGN + len) +
+           SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+}
+
+static_assert(SKB_DATA_ALIGN(NET_SKB_PAD + NET_IP_ALIGN +
+                             MNET_COPYBREAK_MAX) +
+              SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) <= PAGE_SIZE);
+
+/*
+ * Copy the first @len bytes of @skb, counted from its MAC header, into a
+ * pool fragment. The copy looks like a clone would: data past the MAC
+ * header and the same RX metadata. NULL when the pool has no page left.
+ */
+static struct sk_buff *mnet_rxcopy_skb(struct page_pool *pool,
+                                       struct sk_buff *skb,
+                                       unsigned int len)
+{
+    unsigned int mac_len = skb->data - skb_mac_header(skb);
+    unsigned int size = mnet_rxcopy_truesize(len);
+    struct skb_shared_hwtstamps *hwts;
+    struct sk_buff *nskb;
+    struct page *page;
+    unsigned int off;
+
+    page = page_pool_dev_alloc_frag(pool, &off, size);
+    if (unlikely(!page))
+        return NULL;
+
+    nskb = build_skb(page_address(page) + off, size);
+    if (unlikely(!nskb)) {
+        page_pool_put_full_page(pool, page, false);
+        return NULL;
+    }
+    skb_mark_for_recycle(nskb);
+    skb_reserve(nskb, NET_SKB_PAD + NET_IP_ALIGN);
+
+    /* The MAC header is in the linear part, where the driver put it */
+    skb_copy_bits(skb, -(int)mac_len, __skb_put(nskb, len), len);
+    skb_reset_mac_header(nskb);
+    __skb_pull(nskb, mac_len);
+    skb_reset_network_header(nskb);
+    nskb->mac_len = skb->mac_len;
+
+    nskb->protocol = skb->protocol;
+    nskb->pkt_type = skb->pkt_type;
+    nskb->priority = skb->priority;
+    nskb->mark = skb->mark;
+    nskb->tstamp = skb->tstamp;
+    nskb->queue_mapping = skb->queue_mapping;
+    skb_copy_hash(nskb, skb);
+    __vlan_hwaccel_copy_tag(nskb, skb);
+
+    hwts = skb_hwtstamps(skb);
+    if (hwts->hwtstamp)
+        *skb_hwtstamps(nskb) = *hwts;
+
+    /* As pskb_trim_rcsum() would leave a cut clone */
+    if (len == mac_len + skb->len || skb->ip_summed != CHECKSUM_COMPLETE) {
+        nskb->ip_summed = skb->ip_summed;
+        nskb->csum = skb->csum;
+        nskb->csum_level = skb->csum_level;
+    }
+    return nskb;
+}
+
+/*
+ * Duplicate @skb for delivery on mnet0, cut to @snaplen bytes if non-zero:
+ * a copy from the page pool up to cfg->copybreak bytes, a clone otherwise
+ * or when the pool is empty. NULL if both fail.
+ */
+struct sk_buff *mnet_rx_dup(struct mnet_priv *priv,
+                            const struct mnet_config *cfg,
+                            struct sk_buff *skb, u32 snaplen)
+{
+    unsigned int len = skb->len + ETH_HLEN;
+    struct sk_buff *clone;
+
+    if (snaplen && len > snaplen)
+        len = snaplen;
+
+    if (len <= cfg->copybreak) {
+        clone = mnet_rxcopy_skb(*this_cpu_ptr(priv->rx_pool), skb, len);
+        if (likely(clone)) {
+            mnet_stats_inc(priv, MNET_STAT_RX_COPY);
+            return clone;
+        }
+    }
+
+    clone = skb_clone(skb, GFP_ATOMIC);
+    if (!clone)
+        return NULL;
+
+    /* snaplen counts the MAC header, which the clone has already pulled */
+    if (len < skb->len + ETH_HLEN &&
+        pskb_trim_rcsum(clone, len - ETH_HLEN)) {
+        kfree_skb(clone);
+        return NULL;
+    }
+
+    mnet_stats_inc(priv, MNET_STAT_RX_CLONE);
+    return clone;
+}
+
+/* -------------------- debugfs -------------------- */
+static void mnet_rxcopy_show_pct(struct seq_file *m, const char *name,
+                                 u64 part, u64 whole)
+{
+    u64 permille = whole ? div64_u64(part * 1000, whole) : 0;
+
+    seq_printf(m, "%-16s %llu (%llu.%llu%%)\n", name, part,
+               div_u64(permille, 10), permille % 10);
+}
+
+int mnet_rxcopy_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    u64 copy = mnet_stats_read(priv, MNET_STAT_RX_COPY);
+    u64 clone = mnet_stats_read(priv, MNET_STAT_RX_CLONE);
+    u32 copybreak;
+
+    rcu_read_lock();
+    copybreak = rcu_dereference(priv->cfg)->copybreak;
+    rcu_read_unlock();
+
+    seq_printf(m, "%-16s %u\n", "copybreak", copybreak);
+    mnet_rxcopy_show_pct(m, "copied", copy, copy + clone);
+    mnet_rxcopy_show_pct(m, "cloned", clone, copy + clone);
+
+#ifdef CONFIG_PAGE_POOL_STATS
+    {
+        struct page_pool_stats st = { };
+        u64 alloc, recycled;
+        int cpu;
+
+        /* Adds up, so one struct collects every CPU's pool */
+        for_each_possible_cpu(cpu)
+            page_pool_get_stats(*per_cpu_ptr(priv->rx_pool, cpu), &st);
+
+        alloc = st.alloc_stats.fast + st.alloc_stats.slow +
+                st.alloc_stats.slow_high_order;
+        recycled = st.recycle_stats.cached + st.recycle_stats.ring;
+
+        seq_printf(m, "%-16s %llu\n", "pages_fast", st.alloc_stats.fast);
+        seq_printf(m, "%-16s %llu\n", "pages_slow", st.alloc_stats.slow);
+        seq_printf(m, "%-16s %llu\n", "pages_refill",
+                   st.alloc_stats.refill);
+        seq_printf(m, "%-16s %llu\n", "pages_empty", st.alloc_stats.empty);
+        mnet_rxcopy_show_pct(m, "pages_recycled", recycled, alloc);
+        seq_printf(m, "%-16s %llu\n", "pages_ring_full",
+                   st.recycle_stats.ring_full);
+        seq_printf(m, "%-16s %llu\n", "pages_released",
+                   st.recycle_stats.released_refcnt);
+    }
+#else
+    seq_puts(m, "page pool stats need CONFIG_PAGE_POOL_STATS\n");
+#endif
+    return 0;
+}
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_rxcopy_init(struct mnet_priv *priv)
+{
+    struct page_pool_params pp = {
+        .flags     = PP_FLAG_PAGE_FRAG,
+        .order     = 0,
+        .pool_size = MNET_RXCOPY_POOL_SIZE,
+    };
+    struct page_pool *pool;
+    int cpu;
+
+    priv->rx_pool = alloc_percpu(struct page_pool *);
+    if (!priv->rx_pool)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu) {
+        pp.nid = cpu_to_node(cpu);
+        pool = page_pool_create(&pp);
+        if (IS_ERR(pool)) {
+            mnet_rxcopy_fini(priv);
+            return PTR_ERR(pool);
+        }
+        *per_cpu_ptr(priv->rx_pool, cpu) = pool;
+    }
+    return 0;
+}
+
+/*
+ * Called once mnet0 is unregistered. Copies still queued on sockets keep
+ * their pool alive; page_pool_destroy() frees it when the last one is gone.
+ */
+void mnet_rxcopy_fini(struct mnet_priv *priv)
+{
+    struct page_pool *pool;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        pool = *per_cpu_ptr(priv->rx_pool, cpu);
+        if (pool)
+            page_pool_destroy(pool);
+    }
+    free_percpu(priv->rx_pool);
+}
@@ -0,0 +1,497 @@
+#include <linux/kernel.h>
+#include <linux/hrtimer.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <net/codel.h>
+#include <net/codel_impl.h>
+
+#include "mnet.h"
+
+/*
+ * Built-in fair queueing TX scheduler.
+ *
+ * mnet_start_xmit() timestamps the skb and drops it on a per-CPU staging
+ * queue, so senders on different CPUs never share a lock. The TX NAPI
+ * context is the single consumer: it splices the staging queues into
+ * per-flow queues and serves them with DRR (new flows first, like
+ * fq_codel), applying CoDel on sojourn time at dequeue. Enqueue and dequeue
+ * are O(1).
+ *
+ * Each priority band picked by mnet_select_queue() has its own set of flows.
+ * Bands are served in strict order, or by DRR with per-band weights.
+ *
+ * TX interrupt coalescing is emulated on the staging side: with
+ * coal_frames > 1 NAPI is only kicked once a CPU has staged that many
+ * packets or coal_usecs after the first one, whichever comes first.
+ */
+
+struct mnet_fq_band;
+
+struct mnet_fq_flow {
+    struct sk_buff *head;
+    struct sk_buff *tail;
+    struct list_head flowchain;
+    struct mnet_fq_band *band;
+    int deficit;
+    u32 qlen;
+    u32 backlog;
+    struct codel_vars cvars;
+};
+
+struct mnet_fq_band {
+    struct mnet_fq_flow *flows;     // MNET_FQ_FLOWS of them
+    struct list_head new_flows;
+    struct list_head old_flows;
+    u32 qlen;
+    int deficit;                    // weighted mode only
+};
+
+struct mnet_fq {
+    struct mnet_fq_band bands[MNET_NUM_BANDS];
+    struct mnet_fq_flow *flows;
+    struct sk_buff_head __percpu *stage;
+    u32 stage_limit;                // per CPU
+    u32 coal_frames;
+    u32 coal_usecs;
+    struct hrtimer coal_timer;
+    struct codel_params cparams;
+    struct codel_stats cstats;
+    struct mnet_priv *priv;
+    u32 quantum;
+    u32 limit;
+    u32 qlen;
+    u32 backlog;
+    u32 active;
+    u32 cur_band;
+};
+
+/* -------------------- Flow queues -------------------- */
+static inline void mnet_fq_flow_add(struct mnet_fq_flow *flow,
+                                    struct sk_buff *skb)
+{
+    if (!flow->head)
+        flow->head = skb;
+    else
+        flow->tail->next = skb;
+    flow->tail = skb;
+    skb->next = NULL;
+}
+
+static inline struct sk_buff *mnet_fq_flow_pop(struct mnet_fq *fq,
+                                               struct mnet_fq_flow *flow)
+{
+    struct sk_buff *skb = flow->head;
+
+    if (!skb)
+        return NULL;
+
+    flow->head = skb->next;
+    skb_mark_not_on_list(skb);
+    flow->band->qlen--;
+    flow->qlen--;
+    flow->backlog -= skb->len;
+    fq->qlen--;
+    fq->backlog -= skb->len;
+    return skb;
+}
+
+static void mnet_fq_enqueue(struct mnet_fq *fq, struct sk_buff *skb)
+{
+    struct mnet_fq_band *band;
+    struct mnet_fq_flow *flow;
+
+    if (unlikely(fq->qlen >= fq->limit)) {
+        mnet_stats_inc(fq->priv, MNET_STAT_FQ_DROP_OVERLIMIT);
+        kfree_skb(skb);
+        return;
+    }
+
+    band = &fq->bands[skb_get_queue_mapping(skb) % MNET_NUM_BANDS];
+    flow = &band->flows[skb_get_hash(skb) & (MNET_FQ_FLOWS - 1)];
+
+    /* One flow may not hog the whole queue */
+    if (unlikely(flow->qlen >= MNET_FQ_FLOW_LIMIT)) {
+        mnet_stats_inc(fq->priv, MNET_STAT_FQ_DROP_OVERLIMIT);
+        kfree_skb(skb);
+        return;
+    }
+
+    mnet_fq_flow_add(flow, skb);
+    band->qlen++;
+    flow->qlen++;
+    flow->backlog += skb->len;
+    fq->qlen++;
+    fq->backlog += skb->len;
+
+    if (list_empty(&flow->flowchain)) {
+        list_add_tail(&flow->flowchain, &band->new_flows);
+        flow->deficit = fq->quantum;
+        fq->active++;
+    }
+}
+
+/* -------------------- CoDel callbacks -------------------- */
+static u32 mnet_fq_skb_len(const struct sk_buff *skb)
+{
+    return skb->len;
+}
+
+static codel_time_t mnet_fq_skb_time(const struct sk_buff *skb)
+{
+    return MNET_SKB_CB(skb)->enqueue_time;
+}
+
+static void mnet_fq_skb_drop(struct sk_buff *skb, void *ctx)
+{
+    struct mnet_fq *fq = ctx;
+
+    mnet_stats_inc(fq->priv, MNET_STAT_FQ_DROP_CODEL);
+    kfree_skb(skb);
+}
+
+static struct sk_buff *mnet_fq_codel_pop(struct codel_vars *vars, void *ctx)
+{
+    struct mnet_fq_flow *flow = container_of(vars, struct mnet_fq_flow, cvars);
+
+    return mnet_fq_flow_pop(ctx, flow);
+}
+
+static struct sk_buff *mnet_fq_dequeue_band(struct mnet_fq *fq,
+                                            struct mnet_fq_band *band)
+{
+    struct mnet_fq_flow *flow;
+    struct list_head *head;
+    struct sk_buff *skb;
+
+begin:
+    head = &band->new_flows;
+    if (list_empty(head)) {
+        head = &band->old_flows;
+        if (list_empty(head))
+            return NULL;
+    }
+    flow = list_first_entry(head, struct mnet_fq_flow, flowchain);
+
+    if (flow->deficit <= 0) {
+        flow->deficit += fq->quantum;
+        list_move_tail(&flow->flowchain, &band->old_flows);
+        goto begin;
+    }
+
+    skb = codel_dequeue(fq, &flow->backlog, &fq->cparams, &flow->cvars,
+                        &fq->cstats, mnet_fq_skb_len, mnet_fq_skb_time,
+                        mnet_fq_skb_drop, mnet_fq_codel_pop);
+    if (!skb) {
+        /* Give a new flow that just emptied one more round as an old one */
+        if (head == &band->new_flows && !list_empty(&band->old_flows)) {
+            list_move_tail(&flow->flowchain, &band->old_flows);
+        } else {
+            list_del_init(&flow->flowchain);
+            fq->active--;
+        }
+        goto begin;
+    }
+
+    flow->deficit -= skb->len;
+    return skb;
+}
+
+static struct sk_buff *mnet_fq_dequeue(struct mnet_fq *fq)
+{
+    struct mnet_priv *priv = fq->priv;
+    struct mnet_fq_band *band;
+    struct sk_buff *skb;
+    int i;
+
+    if (READ_ONCE(priv->prio_strict)) {
+        for (i = 0; i < MNET_NUM_BANDS; i++) {
+            band = &fq->bands[i];
+            if (!band->qlen)
+                continue;
+            skb = mnet_fq_dequeue_band(fq, band);
+            if (skb)
+                return skb;
+        }
+        return NULL;
+    }
+
+    /* Weighted: DRR across bands, quantum scaled by the band weight */
+    while (fq->qlen) {
+        band = &fq->bands[fq->cur_band];
+        if (!band->qlen) {
+            band->deficit = 0;
+            fq->cur_band = (fq->cur_band + 1) % MNET_NUM_BANDS;
+            continue;
+        }
+        if (band->deficit <= 0) {
+            band->deficit += READ_ONCE(priv->prio_weight[fq->cur_band]) *
+                             fq->quantum;
+            fq->cur_band = (fq->cur_band + 1) % MNET_NUM_BANDS;
+            continue;
+        }
+        skb = mnet_fq_dequeue_band(fq, band);
+        if (skb) {
+            band->deficit -= skb->len;
+            return skb;
+        }
+    }
+    return NULL;
+}
+
+/* -------------------- Producer side -------------------- */
+void mnet_fq_xmit(struct mnet_priv *priv, struct sk_buff *skb)
+{
+    struct mnet_fq *fq = priv->fq;
+    struct sk_buff_head *stage = this_cpu_ptr(fq->stage);
+    u32 frames, usecs;
+
+    if (unlikely(skb_queue_len(stage) >= READ_ONCE(fq->stage_limit))) {
+        mnet_stats_inc(priv, MNET_STAT_FQ_DROP_OVERLIMIT);
+        dev_kfree_skb_any(skb);
+        return;
+    }
+
+    MNET_SKB_CB(skb)->enqueue_time = codel_get_time();
+    skb_queue_tail(stage, skb);
+
+    frames = READ_ONCE(fq->coal_frames);
+    usecs = READ_ONCE(fq->coal_usecs);
+    if (frames <= 1 || !usecs || skb_queue_len_lockless(stage) >= frames)
+        napi_schedule(&priv->napi);
+    else if (!hrtimer_is_queued(&fq->coal_timer))
+        hrtimer_start(&fq->coal_timer, us_to_ktime(usecs),
+                      HRTIMER_MODE_REL_SOFT);
+}
+
+static enum hrtimer_restart mnet_fq_coal_timer(struct hrtimer *timer)
+{
+    struct mnet_fq *fq = container_of(timer, struct mnet_fq, coal_timer);
+
+    napi_schedule(&fq->priv->napi);
+    return HRTIMER_NORESTART;
+}
+
+static bool mnet_fq_staged(struct mnet_fq *fq)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        if (!skb_queue_empty_lockless(per_cpu_ptr(fq->stage, cpu)))
+            return true;
+    }
+    return false;
+}
+
+/* -------------------- Consumer side (TX NAPI) -------------------- */
+int mnet_fq_poll(struct napi_struct *napi, int budget)
+{
+    struct mnet_priv *priv = container_of(napi, struct mnet_priv, napi);
+    struct mnet_fq *fq = priv->fq;
+    struct sk_buff_head batch;
+    struct sk_buff *skb;
+    int cpu, work = 0;
+
+    __skb_queue_head_init(&batch);
+    for_each_possible_cpu(cpu) {
+        struct sk_buff_head *stage = per_cpu_ptr(fq->stage, cpu);
+
+        if (skb_queue_empty_lockless(stage))
+            continue;
+        spin_lock_irq(&stage->lock);
+        skb_queue_splice_tail_init(stage, &batch);
+        spin_unlock_irq(&stage->lock);
+    }
+
+    while ((skb = __skb_dequeue(&batch)) != NULL)
+        mnet_fq_enqueue(fq, skb);
+
+    while (work < budget && (skb = mnet_fq_dequeue(fq)) != NULL) {
+        mnet_forward_tx(priv, skb);
+        work++;
+    }
+    /* One doorbell per poll in direct mode */
+    mnet_xmit_flush(priv);
+
+    if (work < budget && napi_complete_done(napi, work) &&
+        (fq->qlen || mnet_fq_staged(fq)))
+        napi_schedule(napi);
+
+    return work;
+}
+
+void mnet_fq_purge(struct mnet_priv *priv)
+{
+    struct mnet_fq *fq = priv->fq;
+    struct sk_buff *skb;
+    int cpu;
+
+    if (!fq)
+        return;
+
+    hrtimer_cancel(&fq->coal_timer);
+    for_each_possible_cpu(cpu)
+        skb_queue_purge(per_cpu_ptr(fq->stage, cpu));
+
+    while ((skb = mnet_fq_dequeue(fq)) != NULL)
+        kfree_skb(skb);
+}
+
+/* -------------------- debugfs -------------------- */
+int mnet_fq_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    struct mnet_fq *fq = priv->fq;
+    u32 staged = 0;
+    int cpu, i;
+
+    if (!fq) {
+        seq_puts(m, "disabled\n");
+        return 0;
+    }
+
+    for_each_possible_cpu(cpu)
+        staged += skb_queue_len_lockless(per_cpu_ptr(fq->stage, cpu));
+
+    seq_printf(m, "qlen          %u\n", READ_ONCE(fq->qlen));
+    seq_printf(m, "backlog       %u\n", READ_ONCE(fq->backlog));
+    seq_printf(m, "staged        %u\n", staged);
+    seq_printf(m, "active_flows  %u\n", READ_ONCE(fq->active));
+    for (i = 0; i < MNET_NUM_BANDS; i++)
+        seq_printf(m, "band%d_qlen    %u\n", i, READ_ONCE(fq->bands[i].qlen));
+    seq_printf(m, "maxpacket     %u\n", READ_ONCE(fq->cstats.maxpacket));
+    seq_printf(m, "drop_codel    %llu\n",
+               mnet_stats_read(priv, MNET_STAT_FQ_DROP_CODEL));
+    seq_printf(m, "drop_overlimit %llu\n",
+               mnet_stats_read(priv, MNET_STAT_FQ_DROP_OVERLIMIT));
+    return 0;
+}
+
+u32 mnet_fq_band_qlen(struct mnet_priv *priv, int band)
+{
+    struct mnet_fq *fq = priv->fq;
+
+    return fq ? READ_ONCE(fq->bands[band].qlen) : 0;
+}
+
+/* -------------------- ethtool -------------------- */
+u32 mnet_fq_stage_limit(struct mnet_priv *priv)
+{
+    return priv->fq ? READ_ONCE(priv->fq->stage_limit) : 0;
+}
+
+int mnet_fq_set_stage_limit(struct mnet_priv *priv, u32 limit)
+{
+    if (!priv->fq)
+        return -EOPNOTSUPP;
+    if (!limit || limit > MNET_FQ_STAGE_MAX)
+        return -EINVAL;
+
+    WRITE_ONCE(priv->fq->stage_limit, limit);
+    return 0;
+}
+
+void mnet_fq_get_coalesce(struct mnet_priv *priv, u32 *usecs, u32 *frames)
+{
+    struct mnet_fq *fq = priv->fq;
+
+    *usecs = fq ? READ_ONCE(fq->coal_usecs) : 0;
+    *frames = fq ? READ_ONCE(fq->coal_frames) : 0;
+}
+
+int mnet_fq_set_coalesce(struct mnet_priv *priv, u32 usecs, u32 frames)
+{
+    struct mnet_fq *fq = priv->fq;
+
+    if (!fq)
+        return -EOPNOTSUPP;
+    if (usecs > MNET_FQ_COAL_USECS_MAX || frames > MNET_FQ_STAGE_MAX)
+        return -EINVAL;
+
+    WRITE_ONCE(fq->coal_usecs, usecs);
+    WRITE_ONCE(fq->coal_frames, max(frames, 1U));
+    return 0;
+}
+
+/* Called under RTNL after mnet0's MTU changed */
+void mnet_fq_set_mtu(struct mnet_priv *priv)
+{
+    struct mnet_fq *fq = priv->fq;
+
+    if (!fq)
+        return;
+
+    WRITE_ONCE(fq->cparams.mtu, priv->dev->mtu + ETH_HLEN);
+    WRITE_ONCE(fq->quantum, priv->dev->mtu + ETH_HLEN);
+}
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_fq_init(struct mnet_priv *priv, u32 limit, u32 target_us,
+                 u32 interval_us)
+{
+    struct mnet_fq_band *band;
+    struct mnet_fq *fq;
+    int cpu, b, i;
+
+    fq = kzalloc(sizeof(*fq), GFP_KERNEL);
+    if (!fq)
+        return -ENOMEM;
+
+    fq->flows = kvcalloc(MNET_NUM_BANDS * MNET_FQ_FLOWS, sizeof(*fq->flows),
+                         GFP_KERNEL);
+    fq->stage = alloc_percpu(struct sk_buff_head);
+    if (!fq->flows || !fq->stage) {
+        free_percpu(fq->stage);
+        kvfree(fq->flows);
+        kfree(fq);
+        return -ENOMEM;
+    }
+
+    for (b = 0; b < MNET_NUM_BANDS; b++) {
+        band = &fq->bands[b];
+        band->flows = &fq->flows[b * MNET_FQ_FLOWS];
+        INIT_LIST_HEAD(&band->new_flows);
+        INIT_LIST_HEAD(&band->old_flows);
+        for (i = 0; i < MNET_FQ_FLOWS; i++) {
+            INIT_LIST_HEAD(&band->flows[i].flowchain);
+            band->flows[i].band = band;
+            codel_vars_init(&band->flows[i].cvars);
+        }
+    }
+    for_each_possible_cpu(cpu)
+        skb_queue_head_init(per_cpu_ptr(fq->stage, cpu));
+
+    codel_params_init(&fq->cparams);
+    codel_stats_init(&fq->cstats);
+    fq->cparams.target = ((u64)target_us * NSEC_PER_USEC) >> CODEL_SHIFT;
+    fq->cparams.interval = ((u64)interval_us * NSEC_PER_USEC) >> CODEL_SHIFT;
+    fq->cparams.mtu = priv->dev->mtu + ETH_HLEN;
+
+    fq->priv = priv;
+    fq->quantum = priv->dev->mtu + ETH_HLEN;
+    fq->limit = limit;
+    fq->stage_limit = limit;
+    fq->coal_frames = 1;
+    hrtimer_init(&fq->coal_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+    fq->coal_timer.function = mnet_fq_coal_timer;
+
+    priv->fq = fq;
+
+    /* Our own queues replace mnet0's qdisc */
+    priv->dev->priv_flags |= IFF_NO_QUEUE;
+    return 0;
+}
+
+void mnet_fq_fini(struct mnet_priv *priv)
+{
+    struct mnet_fq *fq = priv->fq;
+
+    if (!fq)
+        return;
+
+    mnet_fq_purge(priv);
+    priv->fq = NULL;
+    free_percpu(fq->stage);
+    kvfree(fq->flows);
+    kfree(fq);
+}
@@ -0,0 +1,227 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/inet.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "mnet.h"
+
+/*
+ * Traffic sketches for scan and flood detection.
+ *
+ * Per CPU, updated from the rx_handler:
+ *  - a HyperLogLog of IPv4 source addresses (MNET_HLL_REGS byte registers),
+ *    giving the number of distinct sources;
+ *  - a count-min sketch of bytes per source /MNET_CMS_PREFIX prefix
+ *    (MNET_CMS_DEPTH rows of MNET_CMS_WIDTH counters).
+ *
+ * Both are flat arrays merged with max/sum on read, about 5 KB per CPU
+ * regardless of the number of flows. Epochs are derived from jiffies: a
+ * CPU that sees a new epoch clears its own sketch before updating it, so
+ * resets need neither a timer nor cross-CPU writes, and readers skip CPUs
+ * still in an old epoch.
+ */
+
+struct mnet_sketch {
+    unsigned long epoch;
+    u8 hll[MNET_HLL_REGS] ____cacheline_aligned;
+    u64 cms[MNET_CMS_DEPTH][MNET_CMS_WIDTH] ____cacheline_aligned;
+};
+
+static inline unsigned long mnet_sketch_epoch(const struct mnet_config *cfg)
+{
+    return cfg->sketch_epoch ? jiffies / (cfg->sketch_epoch * HZ) : 0;
+}
+
+static inline u32 mnet_cms_index(const struct mnet_priv *priv, __be32 prefix,
+                                 int row)
+{
+    return jhash_1word((__force u32)prefix, priv->sketch_salt + row) %
+           MNET_CMS_WIDTH;
+}
+
+static inline __be32 mnet_cms_prefix(__be32 addr)
+{
+    return addr & htonl(~0U << (32 - MNET_CMS_PREFIX));
+}
+
+/* -------------------- Fast path -------------------- */
+void mnet_sketch_update(struct mnet_priv *priv, const struct mnet_config *cfg,
+                        __be32 saddr, unsigned int len)
+{
+    struct mnet_sketch *s = this_cpu_ptr(priv->sketch);
+    unsigned long epoch = mnet_sketch_epoch(cfg);
+    __be32 prefix = mnet_cms_prefix(saddr);
+    u32 hash, w;
+    u8 rho;
+    int row;
+
+    if (unlikely(s->epoch != epoch)) {
+        memset(s->hll, 0, sizeof(s->hll));
+        memset(s->cms, 0, sizeof(s->cms));
+        s->epoch = epoch;
+    }
+
+    /* Top bits pick the register, the rest give the rank */
+    hash = jhash_1word((__force u32)saddr, priv->sketch_salt);
+    w = hash << MNET_HLL_BITS;
+    rho = w ? 32 - __fls(w) : 32 - MNET_HLL_BITS + 1;
+    if (rho > s->hll[hash >> (32 - MNET_HLL_BITS)])
+        s->hll[hash >> (32 - MNET_HLL_BITS)] = rho;
+
+    for (row = 0; row < MNET_CMS_DEPTH; row++)
+        s->cms[row][mnet_cms_index(priv, prefix, row)] += len;
+}
+
+/* -------------------- Estimates -------------------- */
+/* log2(@v) for v >= 1, in 16.16 fixed point */
+static u32 mnet_log2_fp16(u32 v)
+{
+    u32 res = ilog2(v) << 16;
+    u64 y = (u64)v << (31 - ilog2(v));     // 1.31 fixed point, in [1, 2)
+    int i;
+
+    for (i = 15; i >= 0; i--) {
+        y = (y * y) >> 31;
+        if (y >= (2ULL << 31)) {
+            y >>= 1;
+            res |= 1U << i;
+        }
+    }
+    return res;
+}
+
+/* HyperLogLog estimate with the linear counting correction for small sets */
+static u64 mnet_hll_estimate(const u8 *reg)
+{
+    const u64 m = MNET_HLL_REGS;
+    u64 sum = 0, est;
+    u32 zeros = 0;
+    int i;
+
+    /* sum of 2^-reg, scaled by 2^32; registers never exceed 32 */
+    for (i = 0; i < MNET_HLL_REGS; i++) {
+        sum += 1ULL << (32 - reg[i]);
+        zeros += !reg[i];
+    }
+
+    /* alpha_m = 0.7213 / (1 + 1.079 / m), in 16.16 fixed point */
+    est = div64_u64((MNET_HLL_ALPHA * m * m) << 16, sum);
+
+    if (est <= 5 * m / 2 && zeros) {
+        /* m * ln(m / zeros) with ln(2) = 45426 / 65536 */
+        est = (m * (mnet_log2_fp16(m) - mnet_log2_fp16(zeros)) * 45426) >> 32;
+    }
+    return est;
+}
+
+static int mnet_sketch_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    const struct mnet_sketch *s;
+    unsigned long epoch;
+    u64 cms[MNET_CMS_DEPTH] = { 0 };
+    u64 total = 0, est = U64_MAX;
+    __be32 prefix;
+    u8 *hll;
+    int cpu, row, i, cpus = 0;
+    u32 epoch_secs;
+
+    hll = kzalloc(MNET_HLL_REGS, GFP_KERNEL);
+    if (!hll)
+        return -ENOMEM;
+
+    rcu_read_lock();
+    epoch = mnet_sketch_epoch(rcu_dereference(priv->cfg));
+    epoch_secs = rcu_dereference(priv->cfg)->sketch_epoch;
+    rcu_read_unlock();
+
+    prefix = READ_ONCE(priv->sketch_query);
+
+    for_each_possible_cpu(cpu) {
+        s = per_cpu_ptr(priv->sketch, cpu);
+        if (READ_ONCE(s->epoch) != epoch)
+            continue;
+        cpus++;
+
+        for (i = 0; i < MNET_HLL_REGS; i++)
+            hll[i] = max(hll[i], READ_ONCE(s->hll[i]));
+        for (i = 0; i < MNET_CMS_WIDTH; i++)
+            total += READ_ONCE(s->cms[0][i]);
+        for (row = 0; row < MNET_CMS_DEPTH; row++)
+            cms[row] += READ_ONCE(s->cms[row][mnet_cms_index(priv, prefix,
+                                                             row)]);
+    }
+
+    /* Each row overestimates, the smallest is the best bound */
+    for (row = 0; row < MNET_CMS_DEPTH; row++)
+        est = min(est, cms[row]);
+
+    seq_printf(m, "epoch_secs    %u\n", epoch_secs);
+    seq_printf(m, "cpus          %d\n", cpus);
+    seq_printf(m, "bytes         %llu\n", total);
+    seq_printf(m, "distinct_src  %llu\n", mnet_hll_estimate(hll));
+    seq_printf(m, "query         %pI4/%d %llu\n", &prefix, MNET_CMS_PREFIX,
+               est);
+
+    kfree(hll);
+    return 0;
+}
+
+static int mnet_sketch_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_sketch_show, inode->i_private);
+}
+
+/* Write an IPv4 address to query the volume of its prefix */
+static ssize_t mnet_sketch_write(struct file *file, const char __user *ubuf,
+                                 size_t count, loff_t *ppos)
+{
+    struct mnet_priv *priv = ((struct seq_file *)file->private_data)->private;
+    char buf[INET_ADDRSTRLEN + 1];
+    __be32 addr;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    if (!in4_pton(strim(buf), -1, (u8 *)&addr, -1, NULL))
+        return -EINVAL;
+
+    WRITE_ONCE(priv->sketch_query, mnet_cms_prefix(addr));
+    return count;
+}
+
+const struct file_operations mnet_sketch_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_sketch_open,
+    .read    = seq_read,
+    .write   = mnet_sketch_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_sketch_init(struct mnet_priv *priv)
+{
+    priv->sketch = alloc_percpu(struct mnet_sketch);
+    if (!priv->sketch)
+        return -ENOMEM;
+
+    priv->sketch_salt = get_random_u32();
+    return 0;
+}
+
+void mnet_sketch_fini(struct mnet_priv *priv)
+{
+    free_percpu(priv->sketch);
+    priv->sketch = NULL;
+}
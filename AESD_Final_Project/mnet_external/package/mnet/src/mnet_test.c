@@ -0,0 +1,978 @@
+#include <kunit/test.h>
+#include <linux/delay.h>
+#include <linux/etherdevice.h>
+#include <linux/if_vlan.h>
+#include <linux/ip.h>
+#include <linux/ktime.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/skbuff.h>
+#include <linux/udp.h>
+#include <net/ip.h>
+
+#include "mnet.h"
+
+/*
+ * KUnit suites, built into mnet.ko with CONFIG_MNET_KUNIT_TEST=y and run
+ * each time it is loaded (see Kconfig for kunit.py).
+ *
+ * "mnet" checks the inline helpers on plain structures: the mirror
+ * filter and the per-CPU counter updates. Its bench cases time the same
+ * steps as the clone, filter and stats modes of debugfs mnet/bench and
+ * log ns/packet; they only fail if a step does not do its work.
+ *
+ * "mnet_datapath" builds a private mnet device next to mnet0 with two
+ * fake lower devices. They are registered and up but have no hardware:
+ * their ndo_start_xmit() queues what it is given for the case to look
+ * at. Frames are built as a driver would hand them to the stack and go
+ * through mnet_rx_handler() and mnet_forward_tx() in the context the core
+ * calls those from; what reaches the mnet device is seen by a tap.
+ *
+ * Static keys are shared with mnet0. The fixture's config is never
+ * committed, so it leaves them alone; a case that needs
+ * mnet_key_mirror_filter turns it on and the exit hook turns it off again
+ * unless it was on already.
+ */
+
+#define MNET_TEST_MARK      0x6d6e6574  // "mnet", frames built by a case
+#define MNET_TEST_PORTS     2
+#define MNET_TEST_LEN       60          // shortest frame, FCS left out
+#define MNET_TEST_VID       100
+#define MNET_TEST_LOOPS     (1 << 14)   // frames per bench case
+
+static const u8 mnet_test_mac_a[ETH_ALEN] __aligned(2) = {
+    0x02, 0, 0, 0, 0, 0x0a };
+static const u8 mnet_test_mac_b[ETH_ALEN] __aligned(2) = {
+    0x02, 0, 0, 0, 0, 0x0b };
+
+static const u32 mnet_test_weight[MNET_NUM_BANDS] = { 8, 4, 2, 1 };
+
+/* Turn mnet_key_mirror_filter on; @was is where it is put back from */
+static void mnet_test_filter_key(bool *was)
+{
+    *was = static_key_enabled(&mnet_key_mirror_filter);
+    static_branch_enable(&mnet_key_mirror_filter);
+}
+
+static void mnet_test_filter_key_restore(bool was)
+{
+    if (!was)
+        static_branch_disable(&mnet_key_mirror_filter);
+}
+
+/* -------------------- Suite: mnet -------------------- */
+struct mnet_test_filter {
+    struct mnet_config cfg;
+    struct mnet_pcpu_stats s;
+    bool key;                   // mnet_key_mirror_filter before the case
+    bool key_set;
+};
+
+static int mnet_test_filter_init(struct kunit *test)
+{
+    struct mnet_test_filter *f;
+
+    f = kunit_kzalloc(test, sizeof(*f), GFP_KERNEL);
+    if (!f)
+        return -ENOMEM;
+
+    f->cfg.sample_rate = 1;
+    bitmap_fill(f->cfg.vlan_mirror, VLAN_N_VID);
+    u64_stats_init(&f->s.syncp);
+    test->priv = f;
+    return 0;
+}
+
+static void mnet_test_filter_exit(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+
+    if (f && f->key_set)
+        mnet_test_filter_key_restore(f->key);
+}
+
+static void mnet_test_filter_on(struct mnet_test_filter *f)
+{
+    mnet_test_filter_key(&f->key);
+    f->key_set = true;
+}
+
+/* Key off: no load of the config, everything is mirrored */
+static void mnet_test_filter_key_off(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    int i;
+
+    if (static_key_enabled(&mnet_key_mirror_filter))
+        kunit_skip(test, "mnet_key_mirror_filter is on for mnet0");
+
+    clear_bit(MNET_TEST_VID, f->cfg.vlan_mirror);
+    f->cfg.sample_rate = 4;
+    for (i = 0; i < 8; i++)
+        KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s,
+                                                 MNET_TEST_VID),
+                        MNET_STAT_NUM);
+    KUNIT_EXPECT_EQ(test, f->s.sample_seq, 0U);
+}
+
+static void mnet_test_filter_vlan(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+
+    mnet_test_filter_on(f);
+    clear_bit(MNET_TEST_VID, f->cfg.vlan_mirror);
+
+    KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s, MNET_TEST_VID),
+                    MNET_STAT_VLAN_FILTERED);
+    KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s,
+                                             MNET_TEST_VID + 1),
+                    MNET_STAT_NUM);
+    KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s, 0),
+                    MNET_STAT_NUM);
+    KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s, VLAN_N_VID - 1),
+                    MNET_STAT_NUM);
+}
+
+/* One in sample_rate, the last of each run */
+static void mnet_test_filter_sample(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    enum mnet_stat why;
+    int i, mirrored = 0;
+
+    mnet_test_filter_on(f);
+    f->cfg.sample_rate = 4;
+
+    for (i = 1; i <= 16; i++) {
+        why = mnet_mirror_filter(&f->cfg, &f->s, 0);
+        if (i % 4) {
+            KUNIT_EXPECT_EQ(test, why, MNET_STAT_SAMPLE_SKIPPED);
+        } else {
+            KUNIT_EXPECT_EQ(test, why, MNET_STAT_NUM);
+            mirrored++;
+        }
+    }
+    KUNIT_EXPECT_EQ(test, mirrored, 4);
+    KUNIT_EXPECT_EQ(test, f->s.sample_seq, 16U);
+}
+
+/* Frames the VLAN filter drops don't take a turn of the sampler */
+static void mnet_test_filter_vlan_first(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    int i;
+
+    mnet_test_filter_on(f);
+    clear_bit(MNET_TEST_VID, f->cfg.vlan_mirror);
+    f->cfg.sample_rate = 2;
+
+    for (i = 0; i < 5; i++)
+        KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s,
+                                                 MNET_TEST_VID),
+                        MNET_STAT_VLAN_FILTERED);
+    KUNIT_EXPECT_EQ(test, f->s.sample_seq, 0U);
+
+    KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s, 0),
+                    MNET_STAT_SAMPLE_SKIPPED);
+    KUNIT_EXPECT_EQ(test, mnet_mirror_filter(&f->cfg, &f->s, 0),
+                    MNET_STAT_NUM);
+}
+
+static void mnet_test_stats_add(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    int i;
+
+    __mnet_stats_add(&f->s, MNET_STAT_FDB_HIT, 3);
+    __mnet_stats_add(&f->s, MNET_STAT_FDB_HIT, 4);
+    __mnet_stats_add(&f->s, MNET_STAT_TX_BAND3_BYTES, 1ULL << 40);
+
+    for (i = 0; i < MNET_STAT_NUM; i++) {
+        u64 want = i == MNET_STAT_FDB_HIT ? 7 :
+                   i == MNET_STAT_TX_BAND3_BYTES ? 1ULL << 40 : 0;
+
+        KUNIT_EXPECT_EQ_MSG(test, u64_stats_read(&f->s.cnt[i]), want,
+                            "%s", mnet_stat_names[i]);
+    }
+}
+
+/* The byte counter follows its packet counter, the last pair included */
+static void mnet_test_stats_pkt(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    int i;
+
+    __mnet_stats_pkt(&f->s, MNET_STAT_RX_PACKETS, 60);
+    __mnet_stats_pkt(&f->s, MNET_STAT_RX_PACKETS, 1500);
+    __mnet_stats_pkt(&f->s, MNET_STAT_TX_BAND3_PACKETS, 9000);
+
+    for (i = 0; i < MNET_STAT_NUM; i++) {
+        u64 want;
+
+        switch (i) {
+        case MNET_STAT_RX_PACKETS:
+            want = 2;
+            break;
+        case MNET_STAT_RX_BYTES:
+            want = 1560;
+            break;
+        case MNET_STAT_TX_BAND3_PACKETS:
+            want = 1;
+            break;
+        case MNET_STAT_TX_BAND3_BYTES:
+            want = 9000;
+            break;
+        default:
+            want = 0;
+        }
+        KUNIT_EXPECT_EQ_MSG(test, u64_stats_read(&f->s.cnt[i]), want,
+                            "%s", mnet_stat_names[i]);
+    }
+}
+
+/* -------------------- Benchmarks -------------------- */
+static void mnet_test_bench_report(struct kunit *test, const char *what,
+                                   u64 ns)
+{
+    u64 cns = div_u64(ns * 100, MNET_TEST_LOOPS);
+
+    kunit_info(test, "%s: %llu.%02llu ns/packet over %d packets\n", what,
+               div_u64(cns, 100), cns % 100, MNET_TEST_LOOPS);
+}
+
+/* skb_clone() and free of a minimum size frame, as the mirror does */
+static void mnet_test_bench_clone(struct kunit *test)
+{
+    struct sk_buff *skb, *clone;
+    u64 start, ns;
+    int i;
+
+    skb = alloc_skb(MNET_TEST_LEN, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, skb);
+    skb_put_zero(skb, MNET_TEST_LEN);
+
+    local_bh_disable();
+    start = ktime_get_ns();
+    for (i = 0; i < MNET_TEST_LOOPS; i++) {
+        clone = skb_clone(skb, GFP_ATOMIC);
+        if (!clone)
+            break;
+        consume_skb(clone);
+    }
+    ns = ktime_get_ns() - start;
+    local_bh_enable();
+    kfree_skb(skb);
+
+    KUNIT_ASSERT_EQ(test, i, MNET_TEST_LOOPS);
+    mnet_test_bench_report(test, "clone", ns);
+}
+
+/* One VID filtered out and 1 in 4 sampled, VID = frame % 4096 */
+static void mnet_test_bench_filter(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    enum mnet_stat why;
+    u64 start, ns;
+    int i;
+
+    mnet_test_filter_on(f);
+    clear_bit(MNET_TEST_VID, f->cfg.vlan_mirror);
+    f->cfg.sample_rate = 4;
+
+    local_bh_disable();
+    start = ktime_get_ns();
+    for (i = 0; i < MNET_TEST_LOOPS; i++) {
+        why = mnet_mirror_filter(&f->cfg, &f->s, i & VLAN_VID_MASK);
+        if (why != MNET_STAT_NUM)
+            __mnet_stats_add(&f->s, why, 1);
+    }
+    ns = ktime_get_ns() - start;
+    local_bh_enable();
+
+    i = MNET_TEST_LOOPS / VLAN_N_VID;
+    KUNIT_EXPECT_EQ(test, u64_stats_read(&f->s.cnt[MNET_STAT_VLAN_FILTERED]),
+                    (u64)i);
+    KUNIT_EXPECT_EQ(test, f->s.sample_seq, (u32)(MNET_TEST_LOOPS - i));
+    mnet_test_bench_report(test, "filter", ns);
+}
+
+static void mnet_test_bench_stats(struct kunit *test)
+{
+    struct mnet_test_filter *f = test->priv;
+    u64 start, ns;
+    int i;
+
+    local_bh_disable();
+    start = ktime_get_ns();
+    for (i = 0; i < MNET_TEST_LOOPS; i++)
+        __mnet_stats_pkt(&f->s, MNET_STAT_RX_PACKETS, MNET_TEST_LEN);
+    ns = ktime_get_ns() - start;
+    local_bh_enable();
+
+    KUNIT_EXPECT_EQ(test, u64_stats_read(&f->s.cnt[MNET_STAT_RX_PACKETS]),
+                    (u64)MNET_TEST_LOOPS);
+    mnet_test_bench_report(test, "stats", ns);
+}
+
+static struct kunit_case mnet_test_cases[] = {
+    KUNIT_CASE(mnet_test_filter_key_off),
+    KUNIT_CASE(mnet_test_filter_vlan),
+    KUNIT_CASE(mnet_test_filter_sample),
+    KUNIT_CASE(mnet_test_filter_vlan_first),
+    KUNIT_CASE(mnet_test_stats_add),
+    KUNIT_CASE(mnet_test_stats_pkt),
+    KUNIT_CASE(mnet_test_bench_clone),
+    KUNIT_CASE(mnet_test_bench_filter),
+    KUNIT_CASE(mnet_test_bench_stats),
+    {}
+};
+
+static struct kunit_suite mnet_test_suite = {
+    .name = "mnet",
+    .init = mnet_test_filter_init,
+    .exit = mnet_test_filter_exit,
+    .test_cases = mnet_test_cases,
+};
+
+/* -------------------- Fake devices -------------------- */
+struct mnet_test_lower {
+    struct sk_buff_head txq;    // marked frames given to ndo_start_xmit
+};
+
+static netdev_tx_t mnet_test_lower_xmit(struct sk_buff *skb,
+                                        struct net_device *dev)
+{
+    struct mnet_test_lower *l = netdev_priv(dev);
+
+    /* Keep what a case sent, not the IPv6 autoconf of a new device */
+    if (skb->mark == MNET_TEST_MARK)
+        skb_queue_tail(&l->txq, skb);
+    else
+        dev_kfree_skb_any(skb);
+    return NETDEV_TX_OK;
+}
+
+static const struct net_device_ops mnet_test_lower_ops = {
+    .ndo_start_xmit = mnet_test_lower_xmit,
+};
+
+/* The fixture's mnet device only sends autoconf frames of its own */
+static netdev_tx_t mnet_test_mnet_xmit(struct sk_buff *skb,
+                                       struct net_device *dev)
+{
+    dev_kfree_skb_any(skb);
+    return NETDEV_TX_OK;
+}
+
+static const struct net_device_ops mnet_test_mnet_ops = {
+    .ndo_start_xmit = mnet_test_mnet_xmit,
+};
+
+/* noqueue, like veth: dev_queue_xmit() calls the driver at once */
+static void mnet_test_lower_setup(struct net_device *dev)
+{
+    ether_setup(dev);
+    dev->netdev_ops = &mnet_test_lower_ops;
+    dev->priv_flags |= IFF_NO_QUEUE;
+}
+
+static void mnet_test_mnet_setup(struct net_device *dev)
+{
+    ether_setup(dev);
+    dev->netdev_ops = &mnet_test_mnet_ops;
+    dev->priv_flags |= IFF_NO_QUEUE;
+}
+
+/* -------------------- Suite: mnet_datapath -------------------- */
+struct mnet_test {
+    struct net_device *mnet;
+    struct mnet_priv *priv;     // of mnet
+    struct mnet_config *cfg;    // priv->cfg, only read by the cases
+    bool fdb;                   // mnet_fdb_init() done
+    struct net_device *lower[MNET_TEST_PORTS];
+    struct mnet_port *port[MNET_TEST_PORTS];    // NULL until attached
+    struct packet_type tap;     // frames delivered on mnet
+    bool tap_added;
+    atomic_t delivered;
+    struct net_device *rx_dev;  // skb->dev after RX_HANDLER_ANOTHER
+    bool key;                   // mnet_key_mirror_filter before the case
+    bool key_set;
+};
+
+static int mnet_test_tap(struct sk_buff *skb, struct net_device *dev,
+                         struct packet_type *pt, struct net_device *orig_dev)
+{
+    struct mnet_test *t = container_of(pt, struct mnet_test, tap);
+
+    if (skb->mark == MNET_TEST_MARK)
+        atomic_inc(&t->delivered);
+    consume_skb(skb);
+    return NET_RX_SUCCESS;
+}
+
+/* What mnet_init() sets up, minus the config's static keys */
+static int mnet_test_priv_init(struct kunit *test, struct mnet_test *t)
+{
+    struct mnet_priv *priv = t->priv;
+    int ret;
+
+    priv->dev = t->mnet;
+    spin_lock_init(&priv->lock);
+    INIT_LIST_HEAD(&priv->ports);
+    INIT_LIST_HEAD(&priv->lower_slots);
+    mnet_prio_init(priv, true, mnet_test_weight);
+
+    /* copybreak 0: mirrored frames are clones, no page pool needed */
+    t->cfg = kunit_kzalloc(test, sizeof(*t->cfg), GFP_KERNEL);
+    if (!t->cfg)
+        return -ENOMEM;
+    t->cfg->mode = MNET_MODE_MIRROR;
+    t->cfg->sample_rate = 1;
+    bitmap_fill(t->cfg->vlan_mirror, VLAN_N_VID);
+    RCU_INIT_POINTER(priv->cfg, t->cfg);
+
+    priv->pcpu_stats = netdev_alloc_pcpu_stats(struct mnet_pcpu_stats);
+    if (!priv->pcpu_stats)
+        return -ENOMEM;
+
+    ret = mnet_xmit_init(priv);
+    if (ret)
+        return ret;
+
+    priv->ageing_time = 300 * HZ;
+    mnet_fdb_init(priv);
+    t->fdb = true;
+    return 0;
+}
+
+/* As mnet_port_add() does, without the VLAN and promiscuity setup; RTNL */
+static int mnet_test_attach(struct kunit *test, struct mnet_test *t, int i)
+{
+    struct mnet_port *port;
+    int ret;
+
+    port = kunit_kzalloc(test, sizeof(*port), GFP_KERNEL);
+    if (!port)
+        return -ENOMEM;
+    port->dev = t->lower[i];
+    port->mnet = t->mnet;
+
+    ret = netdev_rx_handler_register(port->dev, mnet_rx_handler, port);
+    if (ret)
+        return ret;
+
+    list_add_tail_rcu(&port->list, &t->priv->ports);
+    WRITE_ONCE(t->priv->num_ports, t->priv->num_ports + 1);
+    t->port[i] = port;
+    return 0;
+}
+
+static int mnet_test_open(struct kunit *test, struct mnet_test *t)
+{
+    int i, ret;
+
+    ret = dev_open(t->mnet, NULL);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < MNET_TEST_PORTS; i++) {
+        ret = dev_open(t->lower[i], NULL);
+        if (ret)
+            return ret;
+        ret = mnet_test_attach(test, t, i);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+static int mnet_test_init(struct kunit *test)
+{
+    struct mnet_test_lower *l;
+    struct mnet_test *t;
+    int i, ret;
+
+    t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+    if (!t)
+        return -ENOMEM;
+    test->priv = t;
+
+    t->mnet = alloc_netdev_mqs(sizeof(struct mnet_priv), "mnettest%d",
+                               NET_NAME_ENUM, mnet_test_mnet_setup,
+                               MNET_NUM_BANDS, 1);
+    if (!t->mnet)
+        return -ENOMEM;
+    eth_hw_addr_random(t->mnet);
+    t->priv = netdev_priv(t->mnet);
+
+    ret = mnet_test_priv_init(test, t);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < MNET_TEST_PORTS; i++) {
+        t->lower[i] = alloc_netdev(sizeof(*l), "mnettest%d", NET_NAME_ENUM,
+                                   mnet_test_lower_setup);
+        if (!t->lower[i])
+            return -ENOMEM;
+        eth_hw_addr_random(t->lower[i]);
+        l = netdev_priv(t->lower[i]);
+        skb_queue_head_init(&l->txq);
+    }
+
+    ret = register_netdev(t->mnet);
+    if (ret)
+        return ret;
+    for (i = 0; i < MNET_TEST_PORTS; i++) {
+        ret = register_netdev(t->lower[i]);
+        if (ret)
+            return ret;
+    }
+
+    rtnl_lock();
+    ret = mnet_test_open(test, t);
+    rtnl_unlock();
+    if (ret)
+        return ret;
+
+    t->tap.type = htons(ETH_P_ALL);
+    t->tap.dev = t->mnet;
+    t->tap.func = mnet_test_tap;
+    dev_add_pack(&t->tap);
+    t->tap_added = true;
+    return 0;
+}
+
+/* Also undoes a mnet_test_init() that failed half way */
+static void mnet_test_exit(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct mnet_test_lower *l;
+    int i;
+
+    if (!t)
+        return;
+
+    if (t->tap_added)
+        dev_remove_pack(&t->tap);
+
+    rtnl_lock();
+    for (i = 0; i < MNET_TEST_PORTS; i++) {
+        if (!t->port[i])
+            continue;
+        netdev_rx_handler_unregister(t->lower[i]);
+        list_del_rcu(&t->port[i]->list);
+    }
+    rtnl_unlock();
+
+    for (i = 0; i < MNET_TEST_PORTS; i++) {
+        if (!t->lower[i])
+            continue;
+        if (t->lower[i]->reg_state == NETREG_REGISTERED)
+            unregister_netdev(t->lower[i]);
+        l = netdev_priv(t->lower[i]);
+        skb_queue_purge(&l->txq);
+        free_netdev(t->lower[i]);
+    }
+
+    if (t->mnet) {
+        /* Flushes the backlog, mirrored clones point at the device */
+        if (t->mnet->reg_state == NETREG_REGISTERED)
+            unregister_netdev(t->mnet);
+        if (t->fdb)
+            mnet_fdb_fini(t->priv);
+        if (t->priv->xmit)
+            mnet_xmit_fini(t->priv);
+        free_percpu(t->priv->pcpu_stats);
+        free_netdev(t->mnet);
+    }
+
+    if (t->key_set)
+        mnet_test_filter_key_restore(t->key);
+}
+
+static int mnet_test_suite_init(struct kunit_suite *suite)
+{
+    return mnet_fdb_cache_init();
+}
+
+static void mnet_test_suite_exit(struct kunit_suite *suite)
+{
+    mnet_fdb_cache_fini();
+}
+
+/* -------------------- Helpers -------------------- */
+/* A UDP/IPv4 frame from @src to @dst, data at the MAC header */
+static struct sk_buff *mnet_test_skb(struct kunit *test, const u8 *src,
+                                     const u8 *dst)
+{
+    struct sk_buff *skb;
+    struct ethhdr *eth;
+    struct udphdr *uh;
+    struct iphdr *iph;
+
+    skb = alloc_skb(NET_IP_ALIGN + MNET_TEST_LEN, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, skb);
+    skb_reserve(skb, NET_IP_ALIGN);
+    skb->mark = MNET_TEST_MARK;
+
+    eth = skb_put_zero(skb, MNET_TEST_LEN);
+    ether_addr_copy(eth->h_dest, dst);
+    ether_addr_copy(eth->h_source, src);
+    eth->h_proto = htons(ETH_P_IP);
+
+    iph = (struct iphdr *)(eth + 1);
+    iph->version = 4;
+    iph->ihl = sizeof(*iph) >> 2;
+    iph->tot_len = htons(MNET_TEST_LEN - ETH_HLEN);
+    iph->ttl = 64;
+    iph->protocol = IPPROTO_UDP;
+    iph->saddr = htonl(0xc0000201);     // 192.0.2.1
+    iph->daddr = htonl(0xc6336401);     // 198.51.100.1
+    ip_send_check(iph);
+
+    uh = (struct udphdr *)(iph + 1);
+    uh->source = htons(9);
+    uh->dest = htons(9);
+    uh->len = htons(MNET_TEST_LEN - ETH_HLEN - sizeof(*iph));
+
+    skb_reset_mac_header(skb);
+    skb_set_network_header(skb, ETH_HLEN);
+    skb_set_transport_header(skb, ETH_HLEN + sizeof(*iph));
+    return skb;
+}
+
+/*
+ * Run the rx_handler as __netif_receive_skb_core() does. The frame would
+ * go on to the lower device's stack on PASS and to skb->dev's on ANOTHER;
+ * here it ends.
+ */
+static rx_handler_result_t mnet_test_rx_handler(struct mnet_test *t,
+                                                struct sk_buff *skb)
+{
+    rx_handler_result_t res;
+
+    local_bh_disable();
+    rcu_read_lock();
+    res = mnet_rx_handler(&skb);
+    rcu_read_unlock();
+    local_bh_enable();
+
+    if (res == RX_HANDLER_ANOTHER)
+        t->rx_dev = skb->dev;
+    if (res != RX_HANDLER_CONSUMED)
+        consume_skb(skb);
+    return res;
+}
+
+/* @skb arrives on lower device @i, tagged with @vid unless 0 */
+static rx_handler_result_t mnet_test_rx(struct mnet_test *t, int i,
+                                        struct sk_buff *skb, u16 vid)
+{
+    skb->protocol = eth_type_trans(skb, t->lower[i]);
+    skb_reset_mac_len(skb);
+    if (vid)
+        __vlan_hwaccel_put_tag(skb, htons(ETH_P_8021Q), vid);
+    return mnet_test_rx_handler(t, skb);
+}
+
+/* @skb sent on the mnet device, as mnet_start_xmit() passes it on */
+static void mnet_test_tx(struct mnet_test *t, struct sk_buff *skb)
+{
+    skb->dev = t->mnet;
+    skb->protocol = htons(ETH_P_IP);
+
+    rcu_read_lock_bh();
+    mnet_forward_tx(t->priv, skb);
+    mnet_xmit_flush(t->priv);
+    rcu_read_unlock_bh();
+}
+
+static struct sk_buff_head *mnet_test_txq(struct mnet_test *t, int i)
+{
+    return &((struct mnet_test_lower *)netdev_priv(t->lower[i]))->txq;
+}
+
+/* Frames delivered on the mnet device, waiting up to 100ms for @want */
+static int mnet_test_delivered(struct mnet_test *t, int want)
+{
+    int i;
+
+    for (i = 0; i < 100 && atomic_read(&t->delivered) < want; i++)
+        msleep(1);
+    return atomic_read(&t->delivered);
+}
+
+static u64 mnet_test_stat(struct mnet_test *t, enum mnet_stat idx)
+{
+    return mnet_stats_read(t->priv, idx);
+}
+
+/* Port the FDB has @addr on, NULL if none */
+static struct mnet_port *mnet_test_fdb_port(struct mnet_test *t,
+                                            const u8 *addr, u16 vid)
+{
+    struct mnet_port *port = NULL;
+    struct mnet_fdb_entry *f;
+
+    rcu_read_lock();
+    f = mnet_fdb_find_rcu(t->priv, addr, vid);
+    if (f)
+        port = READ_ONCE(f->port);
+    rcu_read_unlock();
+    return port;
+}
+
+static void mnet_test_learn(struct mnet_test *t, int i, const u8 *addr)
+{
+    local_bh_disable();
+    rcu_read_lock();
+    mnet_fdb_learn(t->priv, t->port[i], addr, 0);
+    rcu_read_unlock();
+    local_bh_enable();
+}
+
+static void mnet_test_close(struct net_device *dev)
+{
+    rtnl_lock();
+    dev_close(dev);
+    rtnl_unlock();
+}
+
+/* -------------------- RX cases -------------------- */
+static void mnet_test_rx_mirror(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 0, skb, 0), RX_HANDLER_PASS);
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_BYTES),
+                    (u64)(MNET_TEST_LEN - ETH_HLEN));
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_CLONE), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_delivered(t, 1), 1);
+    KUNIT_EXPECT_PTR_EQ(test, mnet_test_fdb_port(t, mnet_test_mac_a, 0),
+                        t->port[0]);
+    KUNIT_EXPECT_PTR_EQ(test, mnet_test_fdb_port(t, mnet_test_mac_b, 0),
+                        NULL);
+}
+
+/* Filtered frames are counted and still teach the FDB */
+static void mnet_test_rx_mirror_vlan(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    mnet_test_filter_key(&t->key);
+    t->key_set = true;
+    clear_bit(MNET_TEST_VID, t->cfg->vlan_mirror);
+
+    skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 0, skb, MNET_TEST_VID),
+                    RX_HANDLER_PASS);
+    skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 0, skb, MNET_TEST_VID + 1),
+                    RX_HANDLER_PASS);
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_VLAN_FILTERED), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_delivered(t, 2), 1);
+    KUNIT_EXPECT_PTR_EQ(test,
+                        mnet_test_fdb_port(t, mnet_test_mac_a, MNET_TEST_VID),
+                        t->port[0]);
+}
+
+static void mnet_test_rx_mirror_sampled(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+    int i;
+
+    mnet_test_filter_key(&t->key);
+    t->key_set = true;
+    t->cfg->sample_rate = 3;
+
+    /* The sampling sequence is per CPU */
+    migrate_disable();
+    for (i = 0; i < 6; i++) {
+        skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+        mnet_test_rx(t, 0, skb, 0);
+    }
+    migrate_enable();
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_SAMPLE_SKIPPED), 4ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 2ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_delivered(t, 2), 2);
+}
+
+/* Our own frames looped back by the lower device are left alone */
+static void mnet_test_rx_loopback(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+    skb->protocol = eth_type_trans(skb, t->lower[0]);
+    skb->pkt_type = PACKET_LOOPBACK;
+    KUNIT_EXPECT_EQ(test, mnet_test_rx_handler(t, skb), RX_HANDLER_PASS);
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 0ULL);
+    KUNIT_EXPECT_PTR_EQ(test, mnet_test_fdb_port(t, mnet_test_mac_a, 0),
+                        NULL);
+}
+
+static void mnet_test_rx_mnet_down(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    mnet_test_close(t->mnet);
+
+    skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 0, skb, 0), RX_HANDLER_PASS);
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 0ULL);
+    KUNIT_EXPECT_PTR_EQ(test, mnet_test_fdb_port(t, mnet_test_mac_a, 0),
+                        NULL);
+}
+
+/* Unknown destination floods to the other port, then B is known */
+static void mnet_test_rx_bridge_forward(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    t->cfg->mode = MNET_MODE_BRIDGE;
+
+    skb = mnet_test_skb(test, mnet_test_mac_b, mnet_test_mac_a);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 1, skb, 0), RX_HANDLER_PASS);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FDB_MISS), 1ULL);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 0)), 1U);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 0U);
+
+    skb = mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 0, skb, 0), RX_HANDLER_CONSUMED);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FDB_HIT), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FWD_PACKETS), 1ULL);
+    KUNIT_ASSERT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 1U);
+
+    /* Forwarded with its MAC header back in front */
+    skb = skb_peek(mnet_test_txq(t, 1));
+    KUNIT_EXPECT_EQ(test, skb->len, (unsigned int)MNET_TEST_LEN);
+    KUNIT_EXPECT_TRUE(test, ether_addr_equal(skb->data, mnet_test_mac_b));
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 0ULL);
+}
+
+/* Addressed to the mnet device: retargeted, not copied */
+static void mnet_test_rx_bridge_local(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    t->cfg->mode = MNET_MODE_BRIDGE;
+
+    skb = mnet_test_skb(test, mnet_test_mac_a, t->mnet->dev_addr);
+    KUNIT_EXPECT_EQ(test, mnet_test_rx(t, 0, skb, 0), RX_HANDLER_ANOTHER);
+    KUNIT_EXPECT_PTR_EQ(test, t->rx_dev, t->mnet);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_PACKETS), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_RX_CLONE), 0ULL);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 0U);
+}
+
+/* -------------------- TX cases -------------------- */
+static void mnet_test_tx_flood(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+
+    mnet_test_tx(t, mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b));
+
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 0)), 1U);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 1U);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FDB_MISS), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FLOOD_PACKETS), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_PACKETS), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_BYTES),
+                    (u64)MNET_TEST_LEN);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_BAND0_PACKETS), 1ULL);
+    /* Not direct_xmit: noqueue lower devices are not batched either */
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_DIRECT_PACKETS), 0ULL);
+}
+
+/* direct_xmit: batched, and handed to the drivers by mnet_xmit_flush() */
+static void mnet_test_tx_direct(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+
+    t->cfg->direct_xmit = true;
+    mnet_test_tx(t, mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b));
+
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 0)), 1U);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 1U);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_DIRECT_PACKETS), 2ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_DIRECT_FALLBACK), 0ULL);
+}
+
+static void mnet_test_tx_fdb_hit(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+    struct sk_buff *skb;
+
+    mnet_test_learn(t, 1, mnet_test_mac_b);
+    mnet_test_tx(t, mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b));
+
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 0)), 0U);
+    KUNIT_ASSERT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 1U);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FDB_HIT), 1ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_FLOOD_PACKETS), 0ULL);
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_PACKETS), 1ULL);
+
+    skb = skb_peek(mnet_test_txq(t, 1));
+    KUNIT_EXPECT_PTR_EQ(test, skb->dev, t->lower[1]);
+}
+
+/* A known port that is down, then no port up at all */
+static void mnet_test_tx_ports_down(struct kunit *test)
+{
+    struct mnet_test *t = test->priv;
+
+    mnet_test_learn(t, 1, mnet_test_mac_b);
+    mnet_test_close(t->lower[1]);
+    mnet_test_tx(t, mnet_test_skb(test, mnet_test_mac_a, mnet_test_mac_b));
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_DROPPED), 1ULL);
+
+    mnet_test_close(t->lower[0]);
+    mnet_test_tx(t, mnet_test_skb(test, mnet_test_mac_b, mnet_test_mac_a));
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_DROPPED), 2ULL);
+
+    KUNIT_EXPECT_EQ(test, mnet_test_stat(t, MNET_STAT_TX_PACKETS), 0ULL);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 0)), 0U);
+    KUNIT_EXPECT_EQ(test, skb_queue_len(mnet_test_txq(t, 1)), 0U);
+}
+
+static struct kunit_case mnet_datapath_test_cases[] = {
+    KUNIT_CASE(mnet_test_rx_mirror),
+    KUNIT_CASE(mnet_test_rx_mirror_vlan),
+    KUNIT_CASE(mnet_test_rx_mirror_sampled),
+    KUNIT_CASE(mnet_test_rx_loopback),
+    KUNIT_CASE(mnet_test_rx_mnet_down),
+    KUNIT_CASE(mnet_test_rx_bridge_forward),
+    KUNIT_CASE(mnet_test_rx_bridge_local),
+    KUNIT_CASE(mnet_test_tx_flood),
+    KUNIT_CASE(mnet_test_tx_direct),
+    KUNIT_CASE(mnet_test_tx_fdb_hit),
+    KUNIT_CASE(mnet_test_tx_ports_down),
+    {}
+};
+
+static struct kunit_suite mnet_datapath_test_suite = {
+    .name = "mnet_datapath",
+    .suite_init = mnet_test_suite_init,
+    .suite_exit = mnet_test_suite_exit,
+    .init = mnet_test_init,
+    .exit = mnet_test_exit,
+    .test_cases = mnet_datapath_test_cases,
+};
+
+kunit_test_suites(&mnet_test_suite, &mnet_datapath_test_suite);
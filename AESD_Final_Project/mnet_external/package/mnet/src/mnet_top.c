@@ -0,0 +1,183 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+
+#include "mnet.h"
+
+/*
+ * Top talkers.
+ *
+ * Each CPU keeps a fixed table of MNET_TOP_SETS x MNET_TOP_WAYS counters
+ * updated from the rx_handler without locks or atomics. A flow hashes to
+ * one set; on a miss the entry with the fewest bytes in that set is taken
+ * over and the newcomer inherits its count, as in Space-Saving. Any flow
+ * heavier than its set's share of the traffic is therefore kept, counts
+ * overestimate by at most the recorded error, and an update costs the same
+ * MNET_TOP_WAYS comparisons whatever the traffic.
+ *
+ * Readers merge the CPUs' tables and sort them; the counters are read
+ * without synchronisation, which is fine for a ranking.
+ */
+
+#define MNET_TOP_K  32  // entries shown in debugfs
+
+struct mnet_top_entry {
+    struct mnet_flow_key key;
+    u64 bytes;                  // 0: free slot
+    u64 packets;
+    u64 error;                  // bytes inherited on takeover
+};
+
+struct mnet_top {
+    struct mnet_top_entry slot[MNET_TOP_SETS * MNET_TOP_WAYS];
+};
+
+/* -------------------- Fast path -------------------- */
+void mnet_top_update(struct mnet_priv *priv, const struct mnet_flow_key *key,
+                     unsigned int len)
+{
+    struct mnet_top_entry *set, *e, *min;
+    u32 hash;
+    int i;
+
+    hash = jhash2((const u32 *)key, sizeof(*key) / sizeof(u32),
+                  priv->top_salt);
+    set = &this_cpu_ptr(priv->top)->slot[(hash % MNET_TOP_SETS) *
+                                          MNET_TOP_WAYS];
+
+    min = set;
+    for (i = 0; i < MNET_TOP_WAYS; i++) {
+        e = &set[i];
+        if (e->bytes && !memcmp(&e->key, key, sizeof(*key))) {
+            e->bytes += len;
+            e->packets++;
+            return;
+        }
+        if (e->bytes < min->bytes)
+            min = e;
+    }
+
+    min->key = *key;
+    min->error = min->bytes;
+    min->bytes += len;
+    min->packets++;
+}
+
+/* -------------------- debugfs -------------------- */
+static int mnet_top_cmp_key(const void *a, const void *b)
+{
+    const struct mnet_top_entry *x = a, *y = b;
+
+    return memcmp(&x->key, &y->key, sizeof(x->key));
+}
+
+static int mnet_top_cmp_bytes(const void *a, const void *b)
+{
+    const struct mnet_top_entry *x = a, *y = b;
+
+    if (x->bytes == y->bytes)
+        return 0;
+    return x->bytes < y->bytes ? 1 : -1;
+}
+
+static int mnet_top_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    struct mnet_top_entry *all, *e;
+    const struct mnet_top *t;
+    size_t n = 0, out = 0, i;
+    int cpu;
+
+    all = kvmalloc_array(num_possible_cpus(), sizeof(t->slot), GFP_KERNEL);
+    if (!all)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu) {
+        t = per_cpu_ptr(priv->top, cpu);
+        for (i = 0; i < ARRAY_SIZE(t->slot); i++) {
+            if (READ_ONCE(t->slot[i].bytes))
+                all[n++] = t->slot[i];
+        }
+    }
+
+    /* A flow seen on several CPUs has one entry per CPU */
+    sort(all, n, sizeof(*all), mnet_top_cmp_key, NULL);
+    for (i = 0; i < n; i++) {
+        if (out && !mnet_top_cmp_key(&all[out - 1], &all[i])) {
+            e = &all[out - 1];
+            e->bytes += all[i].bytes;
+            e->packets += all[i].packets;
+            e->error += all[i].error;
+            continue;
+        }
+        all[out++] = all[i];
+    }
+    sort(all, out, sizeof(*all), mnet_top_cmp_bytes, NULL);
+
+    seq_puts(m, "proto src                   dst                   bytes        packets      error\n");
+    for (i = 0; i < min_t(size_t, out, MNET_TOP_K); i++) {
+        e = &all[i];
+        seq_printf(m, "%-5u %pI4:%-6u %pI4:%-6u %-12llu %-12llu %llu\n",
+                   e->key.proto, &e->key.saddr, ntohs(e->key.sport),
+                   &e->key.daddr, ntohs(e->key.dport),
+                   e->bytes, e->packets, e->error);
+    }
+
+    kvfree(all);
+    return 0;
+}
+
+static int mnet_top_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_top_show, inode->i_private);
+}
+
+/* Any write clears the tables */
+static ssize_t mnet_top_write(struct file *file, const char __user *ubuf,
+                              size_t count, loff_t *ppos)
+{
+    struct mnet_priv *priv = ((struct seq_file *)file->private_data)->private;
+
+    mnet_top_reset(priv);
+    return count;
+}
+
+const struct file_operations mnet_top_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_top_open,
+    .read    = seq_read,
+    .write   = mnet_top_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/* -------------------- Init / Exit -------------------- */
+/* Racing updates may survive a reset, good enough for statistics */
+void mnet_top_reset(struct mnet_priv *priv)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(priv->top, cpu), 0, sizeof(struct mnet_top));
+}
+
+int mnet_top_init(struct mnet_priv *priv)
+{
+    priv->top = alloc_percpu(struct mnet_top);
+    if (!priv->top)
+        return -ENOMEM;
+
+    priv->top_salt = get_random_u32();
+    return 0;
+}
+
+void mnet_top_fini(struct mnet_priv *priv)
+{
+    free_percpu(priv->top);
+    priv->top = NULL;
+}
@@ -0,0 +1,164 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitmap.h>
+#include <linux/rtnetlink.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include "mnet.h"
+
+/*
+ * VLAN handling.
+ *
+ * Tags stay in skb->vlan_tci end to end: the core strips them before our
+ * rx_handler, mirrored clones keep the metadata, and on TX mnet0 advertises
+ * NETIF_F_HW_VLAN_CTAG_TX so the lower device (or validate_xmit_vlan() when
+ * it can't) does the insertion. VLANs configured on mnet0 are pushed to the
+ * lower devices' RX filters.
+ *
+ * The mirror filter is a 4096 bit map indexed by VID, untagged frames use
+ * VID 0. It is part of the runtime config, so writes replace the config.
+ */
+
+int mnet_vlan_rx_add_vid(struct net_device *dev, __be16 proto, u16 vid)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    struct mnet_port *port;
+    int ret;
+
+    list_for_each_entry(port, &priv->ports, list) {
+        ret = vlan_vid_add(port->dev, proto, vid);
+        if (ret)
+            goto unwind;
+    }
+    return 0;
+
+unwind:
+    list_for_each_entry_continue_reverse(port, &priv->ports, list)
+        vlan_vid_del(port->dev, proto, vid);
+    return ret;
+}
+
+int mnet_vlan_rx_kill_vid(struct net_device *dev, __be16 proto, u16 vid)
+{
+    struct mnet_priv *priv = netdev_priv(dev);
+    struct mnet_port *port;
+
+    list_for_each_entry(port, &priv->ports, list)
+        vlan_vid_del(port->dev, proto, vid);
+    return 0;
+}
+
+int mnet_vlan_port_add(struct mnet_priv *priv, struct mnet_port *port)
+{
+    return vlan_vids_add_by_dev(port->dev, priv->dev);
+}
+
+void mnet_vlan_port_del(struct mnet_priv *priv, struct mnet_port *port)
+{
+    vlan_vids_del_by_dev(port->dev, priv->dev);
+}
+
+/* -------------------- Mirror filter -------------------- */
+ssize_t mnet_vlan_filter_print(const unsigned long *map, char *buf,
+                               size_t size)
+{
+    if (bitmap_full(map, VLAN_N_VID))
+        return scnprintf(buf, size, "all\n");
+    if (bitmap_empty(map, VLAN_N_VID))
+        return scnprintf(buf, size, "none\n");
+    return scnprintf(buf, size, "%*pbl\n", VLAN_N_VID, map);
+}
+
+static int mnet_vlan_filter_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    char *buf;
+
+    buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    rcu_read_lock();
+    mnet_vlan_filter_print(rcu_dereference(priv->cfg)->vlan_mirror, buf,
+                           PAGE_SIZE);
+    rcu_read_unlock();
+
+    seq_puts(m, buf);
+    kfree(buf);
+    return 0;
+}
+
+static int mnet_vlan_filter_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, mnet_vlan_filter_show, inode->i_private);
+}
+
+/* Accepts "all", "none", "+<vid>" or "-<vid>" */
+int mnet_vlan_filter_parse(unsigned long *map, const char *cmd)
+{
+    unsigned int vid;
+
+    if (sysfs_streq(cmd, "all")) {
+        bitmap_fill(map, VLAN_N_VID);
+    } else if (sysfs_streq(cmd, "none")) {
+        bitmap_zero(map, VLAN_N_VID);
+    } else if (sscanf(cmd, "+%u", &vid) == 1 && vid < VLAN_N_VID) {
+        __set_bit(vid, map);
+    } else if (sscanf(cmd, "-%u", &vid) == 1 && vid < VLAN_N_VID) {
+        __clear_bit(vid, map);
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static ssize_t mnet_vlan_filter_write(struct file *file,
+                                      const char __user *ubuf,
+                                      size_t count, loff_t *ppos)
+{
+    struct mnet_priv *priv = ((struct seq_file *)file->private_data)->private;
+    struct mnet_config *cfg;
+    char buf[16];
+    int ret;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    rtnl_lock();
+    cfg = mnet_config_dup(priv);
+    if (!cfg) {
+        ret = -ENOMEM;
+    } else {
+        ret = mnet_vlan_filter_parse(cfg->vlan_mirror, buf);
+        if (ret)
+            kfree(cfg);
+        else
+            ret = mnet_config_commit(priv, cfg);
+    }
+    rtnl_unlock();
+
+    return ret ? ret : count;
+}
+
+const struct file_operations mnet_vlan_filter_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mnet_vlan_filter_open,
+    .read    = seq_read,
+    .write   = mnet_vlan_filter_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/* -------------------- Setup -------------------- */
+void mnet_vlan_setup(struct net_device *dev)
+{
+    dev->features |= NETIF_F_HW_VLAN_CTAG_TX | NETIF_F_HW_VLAN_CTAG_RX |
+                     NETIF_F_HW_VLAN_CTAG_FILTER;
+    dev->hw_features |= NETIF_F_HW_VLAN_CTAG_TX;
+}
@@ -0,0 +1,273 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/skbuff.h>
+#include <linux/u64_stats_sync.h>
+
+#include "mnet.h"
+
+/*
+ * Batched handoff to the lower drivers.
+ *
+ * mnet0 has its own qdisc or the fq scheduler, so dev_queue_xmit() on the
+ * lower device queues every frame a second time. With sysfs direct_xmit
+ * mnet_forward_tx() gives frames straight to the lower driver's
+ * ndo_start_xmit(), as dev_direct_xmit() does for PACKET_QDISC_BYPASS.
+ * That also skips tc/netfilter egress and taps on the lower device, so
+ * without direct_xmit every frame takes dev_queue_xmit(), even to lower
+ * devices without a qdisc.
+ *
+ * Unlike dev_direct_xmit(), frames are held while the caller has more to
+ * send: netdev_xmit_more() on mnet0, or the rest of an fq poll. Each CPU
+ * keeps one list per lower TX queue, for up to MNET_XMIT_LISTS queues. At
+ * the end of the run each list goes to its driver under one TX queue lock
+ * with xmit_more set on all but the last frame, so the doorbell rings once
+ * per list. debugfs xmit_batch has the histogram of list sizes.
+ *
+ * Nothing is dropped for lack of room: when the lower queue is stopped or
+ * the driver returns busy, the rest of the list takes the queued path,
+ * dev_queue_xmit(), and is counted as direct_fallback.
+ */
+
+#define MNET_XMIT_BATCH_MAX     64      // frames per list
+#define MNET_XMIT_LISTS         4       // lower TX queues held at once
+
+struct mnet_xmit_list {
+    struct sk_buff_head q;
+    struct net_device *dev;     // lower device of the frames in q
+    struct netdev_queue *txq;
+};
+
+struct mnet_xmit_batch {
+    struct mnet_xmit_list list[MNET_XMIT_LISTS];
+    unsigned int used;          // lists in use, list[0] first
+    u64_stats_t hist[MNET_XMIT_HIST_BUCKETS];
+    struct u64_stats_sync syncp;
+};
+
+static_assert(MNET_XMIT_BATCH_MAX == 1 << (MNET_XMIT_HIST_BUCKETS - 1));
+
+/* Send one list and release it; BH context, the CPU's batch is ours */
+static void mnet_xmit_flush_list(struct mnet_priv *priv,
+                                 struct mnet_xmit_batch *b,
+                                 struct mnet_xmit_list *l)
+{
+    struct net_device *dev = l->dev;
+    struct netdev_queue *txq = l->txq;
+    unsigned int n = skb_queue_len(&l->q), sent = 0, left;
+    int cpu = smp_processor_id();
+    struct mnet_xmit_list *last;
+    struct sk_buff *skb;
+    netdev_tx_t ret;
+    bool lock;
+
+    /* HARD_TX_LOCK(), unless we are already inside this queue's driver */
+    lock = !(dev->features & NETIF_F_LLTX);
+    if (likely(netif_running(dev) && netif_carrier_ok(dev) &&
+               (!lock || READ_ONCE(txq->xmit_lock_owner) != cpu))) {
+        if (lock)
+            __netif_tx_lock(txq, cpu);
+        while (!netif_xmit_frozen_or_drv_stopped(txq) &&
+               (skb = __skb_dequeue(&l->q)) != NULL) {
+            ret = netdev_start_xmit(skb, dev, txq, !skb_queue_empty(&l->q));
+            if (!dev_xmit_complete(ret)) {
+                __skb_queue_head(&l->q, skb);
+                break;
+            }
+            sent++;
+        }
+        if (lock)
+            __netif_tx_unlock(txq);
+    }
+
+    u64_stats_update_begin(&b->syncp);
+    u64_stats_inc(&b->hist[order_base_2(n)]);
+    u64_stats_update_end(&b->syncp);
+    if (sent)
+        mnet_stats_add(priv, MNET_STAT_DIRECT_PACKETS, sent);
+
+    /* The queued path waits for room, or drops, on our behalf */
+    left = skb_queue_len(&l->q);
+    if (left) {
+        mnet_stats_add(priv, MNET_STAT_DIRECT_FALLBACK, left);
+        while ((skb = __skb_dequeue(&l->q)) != NULL)
+            dev_queue_xmit(skb);
+    }
+
+    /* Move the last list in use into the freed slot */
+    last = &b->list[--b->used];
+    if (l != last) {
+        skb_queue_splice_init(&last->q, &l->q);
+        l->dev = last->dev;
+        l->txq = last->txq;
+    }
+}
+
+/* End of a TX run: send everything this CPU holds */
+void mnet_xmit_flush(struct mnet_priv *priv)
+{
+    struct mnet_xmit_batch *b = this_cpu_ptr(priv->xmit);
+
+    while (b->used)
+        mnet_xmit_flush_list(priv, b, &b->list[b->used - 1]);
+}
+
+/* The lower TX queue dev_queue_xmit() would pick */
+static struct netdev_queue *mnet_xmit_pick_tx(struct net_device *dev,
+                                              struct sk_buff *skb)
+{
+    const struct net_device_ops *ops = dev->netdev_ops;
+    u16 queue = 0;
+
+    if (dev->real_num_tx_queues > 1) {
+        queue = ops->ndo_select_queue ?
+                ops->ndo_select_queue(dev, skb, NULL) :
+                netdev_pick_tx(dev, skb, NULL);
+        if (unlikely(queue >= dev->real_num_tx_queues))
+            queue = 0;
+    }
+    skb_set_queue_mapping(skb, queue);
+    return netdev_get_tx_queue(dev, queue);
+}
+
+/*
+ * Send @skb (skb->dev set to the lower device) from the TX path; consumes
+ * it. Unless @direct it goes through dev_queue_xmit(), otherwise it is
+ * held until mnet_xmit_flush().
+ */
+void mnet_xmit_batched(struct mnet_priv *priv, struct sk_buff *skb,
+                       bool direct)
+{
+    struct net_device *dev = skb->dev;
+    struct mnet_xmit_batch *b;
+    struct netdev_queue *txq;
+    struct mnet_xmit_list *l;
+    struct sk_buff *next;
+    bool again = false;
+    unsigned int i;
+
+    if (!direct) {
+        dev_queue_xmit(skb);
+        return;
+    }
+
+    txq = mnet_xmit_pick_tx(dev, skb);
+
+    /* GSO, checksum and VLAN offloads the lower device lacks */
+    skb = validate_xmit_skb_list(skb, dev, &again);
+    if (!skb)
+        return;
+
+    b = this_cpu_ptr(priv->xmit);
+    for (i = 0; i < b->used; i++) {
+        if (b->list[i].txq == txq)
+            break;
+    }
+    if (i == b->used) {
+        if (b->used == MNET_XMIT_LISTS)
+            mnet_xmit_flush(priv);
+        i = b->used++;
+        b->list[i].dev = dev;
+        b->list[i].txq = txq;
+    }
+    l = &b->list[i];
+
+    skb_list_walk_safe(skb, skb, next) {
+        skb_mark_not_on_list(skb);
+        __skb_queue_tail(&l->q, skb);
+    }
+
+    if (skb_queue_len(&l->q) >= MNET_XMIT_BATCH_MAX)
+        mnet_xmit_flush_list(priv, b, l);
+}
+
+/* -------------------- Batch histogram -------------------- */
+/* Sum over CPUs; bucket i counts lists of 2^(i-1)+1 .. 2^i frames */
+void mnet_xmit_hist_read(struct mnet_priv *priv, u64 *hist)
+{
+    const struct mnet_xmit_batch *b;
+    u64 v[MNET_XMIT_HIST_BUCKETS];
+    unsigned int start;
+    int cpu, i;
+
+    memset(hist, 0, sizeof(v));
+    for_each_possible_cpu(cpu) {
+        b = per_cpu_ptr(priv->xmit, cpu);
+        do {
+            start = u64_stats_fetch_begin(&b->syncp);
+            for (i = 0; i < MNET_XMIT_HIST_BUCKETS; i++)
+                v[i] = u64_stats_read(&b->hist[i]);
+        } while (u64_stats_fetch_retry(&b->syncp, start));
+
+        for (i = 0; i < MNET_XMIT_HIST_BUCKETS; i++)
+            hist[i] += v[i];
+    }
+}
+
+int mnet_xmit_show(struct seq_file *m, void *v)
+{
+    struct mnet_priv *priv = m->private;
+    u64 hist[MNET_XMIT_HIST_BUCKETS], batches = 0, frames;
+    unsigned int lo, hi;
+    char range[16];
+    int i;
+
+    mnet_xmit_hist_read(priv, hist);
+
+    seq_printf(m, "%-8s %s\n", "frames", "batches");
+    for (i = 0; i < MNET_XMIT_HIST_BUCKETS; i++) {
+        hi = 1U << i;
+        lo = hi / 2 + 1;
+        if (lo >= hi)
+            snprintf(range, sizeof(range), "%u", hi);
+        else
+            snprintf(range, sizeof(range), "%u-%u", lo, hi);
+        seq_printf(m, "%-8s %llu\n", range, hist[i]);
+        batches += hist[i];
+    }
+
+    /* Every batched frame is either sent directly or falls back */
+    frames = mnet_stats_read(priv, MNET_STAT_DIRECT_PACKETS) +
+             mnet_stats_read(priv, MNET_STAT_DIRECT_FALLBACK);
+    if (batches)
+        seq_printf(m, "average  %llu.%02llu frames\n",
+                   div64_u64(frames, batches),
+                   div64_u64(frames * 100, batches) % 100);
+    return 0;
+}
+
+/* -------------------- Init / Exit -------------------- */
+int mnet_xmit_init(struct mnet_priv *priv)
+{
+    struct mnet_xmit_batch *b;
+    int cpu, i;
+
+    priv->xmit = alloc_percpu(struct mnet_xmit_batch);
+    if (!priv->xmit)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu) {
+        b = per_cpu_ptr(priv->xmit, cpu);
+        for (i = 0; i < MNET_XMIT_LISTS; i++)
+            __skb_queue_head_init(&b->list[i].q);
+        u64_stats_init(&b->syncp);
+    }
+    return 0;
+}
+
+/* Called once mnet0 is unregistered, batches never outlive a TX run */
+void mnet_xmit_fini(struct mnet_priv *priv)
+{
+    struct mnet_xmit_batch *b;
+    int cpu, i;
+
+    for_each_possible_cpu(cpu) {
+        b = per_cpu_ptr(priv->xmit, cpu);
+        for (i = 0; i < MNET_XMIT_LISTS; i++)
+            __skb_queue_purge(&b->list[i].q);
+    }
+    free_percpu(priv->xmit);
+}